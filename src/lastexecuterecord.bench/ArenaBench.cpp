@@ -0,0 +1,44 @@
+﻿#include "Bench.h"
+#include "Json.h"
+
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+
+namespace lastexecuterecordbench
+{
+	// Counts what passes through it to upstream.
+	class CountingResource : public std::pmr::memory_resource {
+	public:
+		size_t allocations = 0;
+
+	private:
+		void* do_allocate(size_t bytes, size_t alignment) override {
+			allocations++;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+			std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+		}
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+			return this == &other;
+		}
+	};
+
+	// Allocations a DOM of the 50k-command config makes on the heap, and what
+	// reaches the heap when it is built in a monotonic arena instead (as wmain does).
+	void arenaAllocations() {
+		std::string text = generatedConfig(50000);
+		CountingResource heap;
+		double heapMs = bestOfMilliseconds(1, [&] { ler::JsonValue root = ler::parseJsonUtf8(text, &heap); });
+		CountingResource upstream;
+		double arenaMs = bestOfMilliseconds(1, [&] {
+			std::pmr::monotonic_buffer_resource arena(&upstream);
+			ler::JsonValue root = ler::parseJsonUtf8(text, &arena);
+		});
+		std::wcout << std::fixed << std::setprecision(1)
+			<< L"  config " << megabytes(text.size()) << L" MB\n"
+			<< L"  default heap:    " << heap.allocations << L" allocations, " << heapMs << L" ms\n"
+			<< L"  monotonic arena: " << upstream.allocations << L" upstream allocations, " << arenaMs << L" ms\n";
+	}
+}
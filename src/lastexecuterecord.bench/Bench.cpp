@@ -0,0 +1,44 @@
+﻿#include "Bench.h"
+
+namespace lastexecuterecordbench
+{
+	std::string generatedConfig(size_t count) {
+		std::string text =
+			"{\n"
+			"  \"version\": 1,\n"
+			"  \"networkOption\": 2,\n"
+			"  \"defaults\": {\n"
+			"    \"minIntervalSeconds\": 0,\n"
+			"    \"timeoutSeconds\": 0\n"
+			"  },\n"
+			"  \"commands\": [";
+		for (size_t i = 0; i < count; i++) {
+			std::string n = std::to_string(i);
+			text += i == 0 ? "\n" : ",\n";
+			text +=
+				"    {\n"
+				"      \"name\": \"cmd-" + n + "\",\n"
+				"      \"enabled\": true,\n"
+				"      \"exe\": \"c:\\\\windows\\\\system32\\\\sudo.exe\",\n"
+				"      \"args\": [\n"
+				"        \"winget\",\n"
+				"        \"upgrade\",\n"
+				"        \"--id\",\n"
+				"        \"Pkg." + n + "\",\n"
+				"        \"--silent\"\n"
+				"      ],\n"
+				"      \"workingDirectory\": \"C:\\\\work\",\n"
+				"      \"minIntervalSeconds\": 64800,\n"
+				"      \"timeoutSeconds\": 600,\n"
+				"      \"lastRunUtc\": \"2026-01-02T12:34:56Z\",\n"
+				"      \"lastExitCode\": 0\n"
+				"    }";
+		}
+		text += "\n  ]\n}\n";
+		return text;
+	}
+
+	double megabytes(size_t bytes) {
+		return static_cast<double>(bytes) / 1e6;
+	}
+}
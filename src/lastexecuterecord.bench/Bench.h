@@ -0,0 +1,37 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace lastexecuterecordbench
+{
+	// A config like the generated ones the figures in the commit messages were
+	// measured on: count commands of 15 JSON values each (name, enabled, exe, five
+	// args, workingDirectory, intervals and state), indented by two spaces.
+	// 50k commands make about 20 MB and 750k nodes.
+	std::string generatedConfig(size_t count);
+
+	// 10^6 bytes, as the figures were reported
+	double megabytes(size_t bytes);
+
+	// Best wall time of runs calls of f, in milliseconds
+	template <class F>
+	double bestOfMilliseconds(int runs, F f) {
+		double best = 0;
+		for (int i = 0; i < runs; i++) {
+			auto start = std::chrono::steady_clock::now();
+			f();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = i == 0 ? ms : std::min(best, ms);
+		}
+		return best;
+	}
+
+	// One per file; main runs them by name.
+	void jsonNodes();
+	void arenaAllocations();
+	void jsonNumbers();
+	void internStrings();
+}
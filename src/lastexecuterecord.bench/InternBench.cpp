@@ -0,0 +1,85 @@
+﻿#include "Bench.h"
+#include "Config.h"
+#include "FileUtil.h"
+
+#include <Windows.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+// Live heap bytes of the whole process: every operator new in the bench (the
+// core library included) goes through here. The size rides in a 16-byte header
+// so delete can subtract it.
+static std::atomic<size_t> liveBytes{ 0 };
+
+void* operator new(size_t size) {
+	void* p = std::malloc(size + 16);
+	if (!p) throw std::bad_alloc();
+	*static_cast<size_t*>(p) = size;
+	liveBytes += size;
+	return static_cast<char*>(p) + 16;
+}
+
+void operator delete(void* p) noexcept {
+	if (!p) return;
+	void* block = static_cast<char*>(p) - 16;
+	liveBytes -= *static_cast<size_t*>(block);
+	std::free(block);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+namespace lastexecuterecordbench
+{
+	// count commands sharing 4 executables, 3 working directories and 5 args
+	// each, the last one of 50 scripts
+	static std::string internConfig(size_t count) {
+		const char* exes[] = { "C:\\\\Windows\\\\System32\\\\sudo.exe", "C:\\\\Program Files\\\\PowerShell\\\\7\\\\pwsh.exe",
+			"C:\\\\tools\\\\backup\\\\robocopy.exe", "C:\\\\Windows\\\\System32\\\\schtasks.exe" };
+		const char* dirs[] = { "C:\\\\work\\\\jobs\\\\nightly", "C:\\\\Users\\\\svc\\\\AppData\\\\Local\\\\Temp", "D:\\\\data\\\\exports" };
+		std::string text = "{\n  \"commands\": [\n";
+		for (size_t i = 0; i < count; i++) {
+			if (i) text += ",\n";
+			text += "    { \"name\": \"job-" + std::to_string(i) + "\", \"exe\": \"" + exes[i % 4]
+				+ "\", \"workingDirectory\": \"" + dirs[i % 3]
+				+ "\", \"args\": [\"-NoProfile\", \"-ExecutionPolicy\", \"Bypass\", \"-File\", \"C:\\\\scripts\\\\task"
+				+ std::to_string(i % 50) + ".ps1\"], \"minIntervalSeconds\": 3600 }";
+		}
+		text += "\n  ]\n}\n";
+		return text;
+	}
+
+	// Heap a loaded 100k-command config keeps once its source text is released,
+	// and the load time (best of three).
+	void internStrings() {
+		wchar_t tmpDir[MAX_PATH] = {};
+		GetTempPathW(MAX_PATH, tmpDir);
+		std::wstring path = std::wstring(tmpDir) + L"ler_bench_intern.json";
+		std::string text = internConfig(100000);
+		ler::writeUtf8FileAtomic(path, text);
+		text.clear();
+		text.shrink_to_fit();
+
+		size_t commands = 0;
+		size_t before = liveBytes;
+		size_t kept = 0;
+		{
+			ler::AppConfig cfg = ler::loadAndValidateConfig(path);
+			cfg.source.reset();
+			commands = cfg.commands.size();
+			kept = liveBytes - before;
+		}
+		double loadMs = bestOfMilliseconds(3, [&] { ler::AppConfig cfg = ler::loadAndValidateConfig(path); });
+		DeleteFileW(path.c_str());
+
+		std::wcout << std::fixed << std::setprecision(1)
+			<< L"  " << commands << L" commands\n"
+			<< L"  heap after load: " << kept / 1048576.0 << L" MiB\n"
+			<< L"  load: " << loadMs << L" ms\n";
+	}
+}
@@ -0,0 +1,31 @@
+﻿#include "Bench.h"
+#include "Json.h"
+
+#include <iomanip>
+#include <iostream>
+
+namespace lastexecuterecordbench
+{
+	static size_t countNodes(const ler::JsonValue& v) {
+		size_t n = 1;
+		if (v.isArray()) {
+			for (const ler::JsonValue& item : v.items()) n += countNodes(item);
+		}
+		else if (v.isObject()) {
+			for (const auto& member : v.members()) n += countNodes(member.second);
+		}
+		return n;
+	}
+
+	// What a DOM costs per node, not counting the strings and container buffers
+	// the nodes own.
+	void jsonNodes() {
+		std::string text = generatedConfig(50000);
+		ler::JsonValue root = ler::parseJsonUtf8(text);
+		size_t nodes = countNodes(root);
+		std::wcout << std::fixed << std::setprecision(1)
+			<< L"  config " << megabytes(text.size()) << L" MB, " << nodes << L" nodes\n"
+			<< L"  " << sizeof(ler::JsonValue) << L" bytes/node, "
+			<< megabytes(nodes * sizeof(ler::JsonValue)) << L" MB of node storage\n";
+	}
+}
@@ -0,0 +1,32 @@
+﻿#include "Bench.h"
+#include "Json.h"
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+namespace lastexecuterecordbench
+{
+	// A 1M-element array, half integers and half fractional doubles, read and
+	// written through each entry point; best of three runs.
+	void jsonNumbers() {
+		std::mt19937_64 rng(2);
+		std::string text = "[";
+		for (int i = 0; i < 1000000; i++) {
+			if (i) text += ",";
+			text += (i % 2) ? std::to_string(rng() % 1000000000) : std::to_string((double)(rng() % 100000) / 7.0);
+		}
+		text += "]";
+		std::wstring wide(text.begin(), text.end());
+
+		double utf8Ms = bestOfMilliseconds(3, [&] { ler::JsonValue v = ler::parseJsonUtf8(text); });
+		double wideMs = bestOfMilliseconds(3, [&] { ler::JsonValue v = ler::parseJson(wide); });
+		ler::JsonValue doc = ler::parseJsonUtf8(text);
+		double writeMs = bestOfMilliseconds(3, [&] { std::string out = ler::writeJsonUtf8(doc, -1); });
+		std::wcout << std::fixed << std::setprecision(1)
+			<< L"  array " << megabytes(text.size()) << L" MB\n"
+			<< L"  parseJsonUtf8: " << utf8Ms << L" ms\n"
+			<< L"  parseJson:     " << wideMs << L" ms\n"
+			<< L"  writeJsonUtf8: " << writeMs << L" ms\n";
+	}
+}
@@ -0,0 +1,41 @@
+﻿#include "Bench.h"
+
+#include <iostream>
+#include <string>
+
+namespace
+{
+	struct Benchmark {
+		const wchar_t* name;
+		const wchar_t* about;
+		void (*run)();
+	};
+
+	const Benchmark kBenchmarks[] = {
+		{ L"json-nodes", L"JsonValue node size and DOM storage, 50k-command config", lastexecuterecordbench::jsonNodes },
+		{ L"arena", L"DOM allocations, default heap vs monotonic arena", lastexecuterecordbench::arenaAllocations },
+		{ L"json-numbers", L"Number parsing and writing, 1M-element array", lastexecuterecordbench::jsonNumbers },
+		{ L"intern-strings", L"Heap kept by a loaded 100k-command config", lastexecuterecordbench::internStrings },
+	};
+}
+
+// Runs the benchmarks named on the command line, or all of them. This project
+// is not built with the solution (nor by CI): build it on its own in Release
+// x64 and compare its output before and after a change.
+int wmain(int argc, wchar_t* argv[]) {
+	bool any = false;
+	for (const Benchmark& b : kBenchmarks) {
+		bool selected = argc <= 1;
+		for (int i = 1; i < argc; i++) selected = selected || std::wstring(argv[i]) == b.name;
+		if (!selected) continue;
+		any = true;
+		std::wcout << b.name << L": " << b.about << L"\n";
+		b.run();
+	}
+	if (!any) {
+		std::wcerr << L"Benchmarks:\n";
+		for (const Benchmark& b : kBenchmarks) std::wcerr << L"  " << b.name << L"  " << b.about << L"\n";
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,273 @@
+﻿#include "CppUnitTest.h"
+#include "Config.h"
+#include "ConfigSnapshot.h"
+#include "FileUtil.h"
+#include <Windows.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace lastexecuterecordmstest
+{
+	// Helper to create temp file path
+	static std::wstring makeTempPath(const wchar_t* leaf) {
+		wchar_t tmpDir[MAX_PATH] = {};
+		DWORD n = GetTempPathW(MAX_PATH, tmpDir);
+		if (n == 0) {
+			throw std::runtime_error("GetTempPathW failed");
+		}
+
+		wchar_t nameBuf[MAX_PATH] = {};
+		wsprintfW(nameBuf, L"ler_%lu_%ls", GetCurrentProcessId(), leaf);
+
+		return std::wstring(tmpDir) + nameBuf;
+	}
+
+	// A config file and its snapshot, both deleted at the end
+	class TempConfig {
+	public:
+		std::wstring path;
+		explicit TempConfig(const wchar_t* leaf) : path(makeTempPath(leaf)) {}
+		~TempConfig() {
+			DeleteFileW(path.c_str());
+			DeleteFileW(ler::configSnapshotPath(path).c_str());
+		}
+	};
+
+	static void setLastWriteTime(const std::wstring& path, std::uint64_t t) {
+		FILETIME ft{};
+		ft.dwLowDateTime = static_cast<DWORD>(t);
+		ft.dwHighDateTime = static_cast<DWORD>(t >> 32);
+		HANDLE h = CreateFileW(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+		Assert::IsTrue(h != INVALID_HANDLE_VALUE);
+		Assert::IsTrue(SetFileTime(h, nullptr, nullptr, &ft) != 0);
+		CloseHandle(h);
+	}
+
+	// Moves the last write time of path an hour back, so a snapshot taken now
+	// trusts the file's stamp without reading it again
+	static void backdate(const std::wstring& path) {
+		setLastWriteTime(path, ler::currentFileTime() - 3600ull * 10'000'000);
+	}
+
+	static const wchar_t* kSnapshotConfig =
+		L"{\n"
+		L"  \"version\": 3,\n"
+		L"  \"networkOption\": 1,\n"
+		L"  \"defaults\": { \"minIntervalSeconds\": 60, \"timeoutSeconds\": 5 },\n"
+		L"  \"commands\": [\n"
+		L"    { \"name\": \"a\", \"exe\": \"tool.exe\", \"args\": [\"-v\", \"\\u00e9\"], \"workingDirectory\": \"C:\\\\work\" },\n"
+		L"    { \"name\": \"b\", \"exe\": \"tool.exe\", \"enabled\": false, \"minIntervalSeconds\": 0,\n"
+		L"      \"lastRunUtc\": \"2025-01-01T00:00:00Z\", \"lastExitCode\": 4 }\n"
+		L"  ]\n"
+		L"}\n";
+
+	TEST_CLASS(ConfigSnapshotTests)
+	{
+	public:
+		TEST_METHOD(Snapshot_RoundTrip_RestoresConfig)
+		{
+			TempConfig tmp(L"snapshot_roundtrip.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			ler::AppConfig loaded = ler::loadAndValidateConfig(tmp.path);
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, loaded));
+
+			ler::AppConfig cfg;
+			Assert::IsTrue(ler::loadConfigSnapshot(tmp.path, cfg));
+			Assert::AreEqual(3LL, cfg.version);
+			Assert::IsTrue(cfg.networkOption == ler::NetworkOption::ExecuteOnMetered);
+			Assert::AreEqual(60LL, cfg.defaultMinIntervalSeconds);
+			Assert::AreEqual(5LL, cfg.defaultTimeoutSeconds);
+			Assert::AreEqual(2u, static_cast<unsigned>(cfg.commands.size()));
+			for (size_t i = 0; i < cfg.commands.size(); i++) {
+				const ler::CommandConfig& want = loaded.commands[i];
+				const ler::CommandConfig& got = cfg.commands[i];
+				Assert::AreEqual(want.name, got.name);
+				Assert::AreEqual(want.enabled, got.enabled);
+				Assert::AreEqual(want.exe.str(), got.exe.str());
+				Assert::AreEqual(static_cast<unsigned>(want.args.size()), static_cast<unsigned>(got.args.size()));
+				for (size_t k = 0; k < want.args.size(); k++) Assert::AreEqual(want.args[k].str(), got.args[k].str());
+				Assert::AreEqual(want.workingDirectory.str(), got.workingDirectory.str());
+				Assert::AreEqual(want.minIntervalSeconds, got.minIntervalSeconds);
+				Assert::AreEqual(want.timeoutSeconds, got.timeoutSeconds);
+				Assert::AreEqual(want.hasLastRunUtc, got.hasLastRunUtc);
+				Assert::AreEqual(want.lastRunUtc, got.lastRunUtc);
+				Assert::AreEqual(want.hasLastExitCode, got.hasLastExitCode);
+				Assert::AreEqual(want.lastExitCode, got.lastExitCode);
+				Assert::AreEqual(static_cast<unsigned>(loaded.commandSpans[i].objectEnd), static_cast<unsigned>(cfg.commandSpans[i].objectEnd));
+				Assert::AreEqual(static_cast<unsigned>(loaded.commandSpans[i].exitBegin), static_cast<unsigned>(cfg.commandSpans[i].exitBegin));
+				Assert::IsTrue(loaded.commandDigests[i].hash == cfg.commandDigests[i].hash);
+			}
+			Assert::AreEqual(std::wstring(L"\u00e9"), cfg.commands[0].args[1].str());
+			Assert::AreEqual(0LL, cfg.commands[1].minIntervalSeconds);
+		}
+
+		TEST_METHOD(Snapshot_ConfigEdited_FallsBack)
+		{
+			TempConfig tmp(L"snapshot_stale.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, ler::loadAndValidateConfig(tmp.path)));
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path, L"{ \"commands\": [] }");
+			ler::AppConfig cfg;
+			cfg.version = 7;
+			Assert::IsFalse(ler::loadConfigSnapshot(tmp.path, cfg));
+			Assert::AreEqual(7LL, cfg.version);
+		}
+
+		TEST_METHOD(Snapshot_ConfigEdited_SeedsReload)
+		{
+			TempConfig tmp(L"snapshot_seed.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, ler::loadAndValidateConfig(tmp.path)));
+
+			// only b is edited
+			std::wstring edited = kSnapshotConfig;
+			size_t at = edited.find(L"\"tool.exe\", \"enabled\"");
+			edited.replace(at, 10, L"\"other.exe\"");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, edited);
+
+			ler::AppConfig cfg;
+			ler::AppConfig stale;
+			Assert::IsFalse(ler::loadConfigSnapshot(tmp.path, cfg, std::pmr::get_default_resource(), &stale));
+			Assert::AreEqual(0u, static_cast<unsigned>(cfg.commands.size()));
+			Assert::AreEqual(2u, static_cast<unsigned>(stale.commands.size()));
+
+			// mark the snapshot's commands, so a reused one is recognizable
+			for (auto& c : stale.commands) c.workingDirectory = L"reused";
+			cfg = ler::loadAndValidateConfig(tmp.path, std::pmr::get_default_resource(), &stale);
+			Assert::AreEqual(std::wstring(L"reused"), cfg.commands[0].workingDirectory.str());
+			Assert::AreEqual(std::wstring(L"-v"), cfg.commands[0].args[0].str());
+			Assert::AreEqual(std::wstring(L""), cfg.commands[1].workingDirectory.str());
+			Assert::AreEqual(std::wstring(L"other.exe"), cfg.commands[1].exe.str());
+			Assert::AreEqual(4LL, cfg.commands[1].lastExitCode);
+		}
+
+		TEST_METHOD(Snapshot_Damaged_FallsBack)
+		{
+			TempConfig tmp(L"snapshot_damaged.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, ler::loadAndValidateConfig(tmp.path)));
+			std::wstring snapshotPath = ler::configSnapshotPath(tmp.path);
+			std::string bytes = ler::readUtf8File(snapshotPath);
+
+			ler::AppConfig cfg;
+			std::string flipped = bytes;
+			flipped[flipped.size() - 9] ^= 0x20;
+			ler::writeUtf8FileAtomic(snapshotPath, flipped);
+			Assert::IsFalse(ler::loadConfigSnapshot(tmp.path, cfg));
+
+			ler::writeUtf8FileAtomic(snapshotPath, std::string_view(bytes).substr(0, bytes.size() / 2));
+			Assert::IsFalse(ler::loadConfigSnapshot(tmp.path, cfg));
+			Assert::AreEqual(0u, static_cast<unsigned>(cfg.commands.size()));
+		}
+
+		TEST_METHOD(Snapshot_NotWrittenWhenFileDiffers)
+		{
+			TempConfig tmp(L"snapshot_differs.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			ler::AppConfig loaded = ler::loadAndValidateConfig(tmp.path);
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path, L"{ \"commands\": [] }");
+			Assert::IsFalse(ler::writeConfigSnapshot(tmp.path, loaded));
+			Assert::IsFalse(ler::fileExists(ler::configSnapshotPath(tmp.path)));
+		}
+
+		TEST_METHOD(Snapshot_AfterSave_RacyUntilHashChecked)
+		{
+			TempConfig tmp(L"snapshot_racy.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			backdate(tmp.path);
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			cfg.commands[1].lastExitCode = 7;
+			ler::saveConfig(tmp.path, cfg);
+
+			// written from the saved text, not read back: a same-size rewrite
+			// that keeps the stamp is caught by the hash on restore
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, cfg));
+			ler::FileStamp stamp = ler::getFileStamp(tmp.path);
+			std::wstring rewritten = ler::readUtf8FileToWString(tmp.path);
+			rewritten.replace(rewritten.find(L"tool.exe"), 8, L"TOOL.EXE");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, rewritten);
+			setLastWriteTime(tmp.path, stamp.lastWriteTime);
+
+			ler::AppConfig restored;
+			Assert::IsFalse(ler::loadConfigSnapshot(tmp.path, restored));
+		}
+
+		TEST_METHOD(Snapshot_SaveRestored_SplicesState)
+		{
+			TempConfig tmp(L"snapshot_save.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			backdate(tmp.path);
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, ler::loadAndValidateConfig(tmp.path)));
+
+			// a settled file is trusted by its stamp and not read
+			ler::AppConfig cfg;
+			Assert::IsTrue(ler::loadConfigSnapshot(tmp.path, cfg));
+			Assert::IsFalse(static_cast<bool>(cfg.source));
+
+			cfg.commands[0].hasLastExitCode = true;
+			cfg.commands[0].lastExitCode = 12;
+			cfg.commands[1].lastExitCode = 0;
+			ler::saveConfig(tmp.path, cfg);
+
+			std::wstring expected = kSnapshotConfig;
+			expected.replace(expected.find(L"\"lastExitCode\": 4"), 17, L"\"lastExitCode\": 0");
+			expected.insert(expected.find(L" },\n    { \"name\": \"b\""), L", \"lastExitCode\": 12");
+			Assert::AreEqual(expected, ler::readUtf8FileToWString(tmp.path));
+
+			// the snapshot follows the save
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, cfg));
+			ler::AppConfig again;
+			Assert::IsTrue(ler::loadConfigSnapshot(tmp.path, again));
+			Assert::AreEqual(12LL, again.commands[0].lastExitCode);
+			Assert::AreEqual(0LL, again.commands[1].lastExitCode);
+		}
+
+		TEST_METHOD(Snapshot_SaveRestored_FileEdited_CarriesStateByName)
+		{
+			TempConfig tmp(L"snapshot_edited.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			backdate(tmp.path);
+			Assert::IsTrue(ler::writeConfigSnapshot(tmp.path, ler::loadAndValidateConfig(tmp.path)));
+			ler::AppConfig cfg;
+			Assert::IsTrue(ler::loadConfigSnapshot(tmp.path, cfg));
+
+			// no text was kept to splice into, so the edited file is loaded again
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"b\", \"exe\": \"tool.exe\" }, { \"name\": \"new\", \"exe\": \"n.exe\" } ] }");
+			cfg.commands[0].hasLastExitCode = true;
+			cfg.commands[0].lastExitCode = 1;
+			cfg.commands[1].lastExitCode = 2;
+			ler::saveConfig(tmp.path, cfg);
+
+			Assert::AreEqual(
+				std::wstring(L"{ \"commands\": [ { \"name\": \"b\", \"exe\": \"tool.exe\", \"lastRunUtc\": \"2025-01-01T00:00:00Z\", \"lastExitCode\": 2 }, { \"name\": \"new\", \"exe\": \"n.exe\" } ] }"),
+				ler::readUtf8FileToWString(tmp.path));
+		}
+
+		TEST_METHOD(Save_SettledStamp_FileNotReadBack)
+		{
+			TempConfig tmp(L"save_settled.json");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kSnapshotConfig);
+			backdate(tmp.path);
+			ler::FileStamp stamp = ler::getFileStamp(tmp.path);
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+
+			// a rewrite that keeps size and last write time is not noticed: the
+			// save trusts the stamp and splices into the text it loaded
+			std::wstring rewritten = kSnapshotConfig;
+			rewritten.replace(rewritten.find(L"tool.exe"), 8, L"TOOL.EXE");
+			ler::writeWStringToUtf8FileAtomic(tmp.path, rewritten);
+			setLastWriteTime(tmp.path, stamp.lastWriteTime);
+			Assert::IsTrue(ler::getFileStamp(tmp.path) == stamp);
+
+			cfg.commands[1].lastExitCode = 0;
+			ler::saveConfig(tmp.path, cfg);
+			std::wstring expected = kSnapshotConfig;
+			expected.replace(expected.find(L"\"lastExitCode\": 4"), 17, L"\"lastExitCode\": 0");
+			Assert::AreEqual(expected, ler::readUtf8FileToWString(tmp.path));
+		}
+	};
+}
@@ -1,5 +1,6 @@
-#include "CppUnitTest.h"
+﻿#include "CppUnitTest.h"
 #include "Config.h"
+#include "ConfigSnapshot.h"
 #include "FileUtil.h"
 #include <Windows.h>
 #include <algorithm> // for std::find_if
@@ -54,6 +55,18 @@ namespace lastexecuterecordmstest
 		}
 	};
 
+	// A config of count commands, large enough (over 1 MB) for the parallel loader
+	static std::string manyCommandsConfig(size_t count) {
+		std::string pad(200, 'd');
+		std::string text = "{\n  \"commands\": [\n";
+		for (size_t i = 0; i < count; i++) {
+			if (i > 0) text += ",\n";
+			text += "    { \"name\": \"c" + std::to_string(i) + "\", \"exe\": \"x.exe\", \"workingDirectory\": \"" + pad + "\" }";
+		}
+		text += "\n  ]\n}\n";
+		return text;
+	}
+
 	TEST_CLASS(ConfigTests)
 	{
 	public:
@@ -165,7 +178,30 @@ namespace lastexecuterecordmstest
 			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
 			Assert::AreEqual(1u, static_cast<unsigned>(cfg.commands.size()));
 			Assert::AreEqual(std::wstring(L"c1"), cfg.commands[0].name);
-			Assert::AreEqual(std::wstring(L"C:\\Windows\\System32\\whoami.exe"), cfg.commands[0].exe);
+			Assert::AreEqual(std::wstring(L"C:\\Windows\\System32\\whoami.exe"), cfg.commands[0].exe.str());
+		}
+
+		TEST_METHOD(Load_WithArena_AllocatesRootFromArena)
+		{
+			TempFile tmp(L"arena.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\", \"args\": [\"--a\"] } ]\n"
+				L"}\n");
+
+			std::pmr::monotonic_buffer_resource arena;
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path, &arena);
+			// loading binds straight into the structs; root is built on first use
+			Assert::IsTrue(cfg.root.isNull());
+			cfg.commands[0].hasLastRunUtc = true;
+			cfg.commands[0].lastRunUtc = L"2026-01-02T12:34:56Z";
+			ler::applyCommandsToJson(cfg);
+			Assert::IsTrue(cfg.root.members().get_allocator().resource() == &arena);
+			Assert::AreEqual(std::wstring(L"--a"), cfg.commands[0].args[0].str());
+			// state written into the DOM comes from the arena too
+			const ler::JsonValue* run = cfg.root.tryGet(L"commands")->items()[0].tryGet(L"lastRunUtc");
+			Assert::IsTrue(run->asString(L"ctx").get_allocator().resource() == &arena);
 		}
 
 		TEST_METHOD(Load_CommandNameMissing_Throws)
@@ -211,6 +247,98 @@ namespace lastexecuterecordmstest
 			Assert::AreEqual(0LL, cfg.commands[0].timeoutSeconds);
 		}
 
+		TEST_METHOD(Load_DefaultsAfterCommands_AppliesDefaults)
+		{
+			TempFile tmp(L"defaults_last.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\", \"timeoutSeconds\": null },\n"
+				L"                { \"name\": \"c2\", \"exe\": \"y.exe\", \"minIntervalSeconds\": 5 } ],\n"
+				L"  \"defaults\": { \"minIntervalSeconds\": 60, \"timeoutSeconds\": 30 }\n"
+				L"}\n");
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			Assert::AreEqual(60LL, cfg.commands[0].minIntervalSeconds);
+			Assert::AreEqual(30LL, cfg.commands[0].timeoutSeconds);
+			Assert::AreEqual(5LL, cfg.commands[1].minIntervalSeconds);
+			Assert::AreEqual(30LL, cfg.commands[1].timeoutSeconds);
+		}
+
+		TEST_METHOD(Load_IdAndDuplicateKeys_FirstNameOrIdWins)
+		{
+			TempFile tmp(L"alias.json");
+
+			// id is only read when name is missing; of duplicate keys the first counts
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"commands\": [ { \"id\": \"i1\", \"name\": null, \"exe\": \"x.exe\", \"exe\": 1 },\n"
+				L"                { \"name\": \"c2\", \"id\": 2, \"exe\": \"y.exe\" } ]\n"
+				L"}\n");
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			Assert::AreEqual(std::wstring(L"i1"), cfg.commands[0].name);
+			Assert::AreEqual(std::wstring(L"x.exe"), cfg.commands[0].exe.str());
+			Assert::AreEqual(std::wstring(L"c2"), cfg.commands[1].name);
+		}
+
+		TEST_METHOD(Load_DuplicateNames_Throws)
+		{
+			TempFile tmp(L"duplicate_names.json");
+
+			// an id counts as the name, so it may not repeat one either
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\" },\n"
+				L"                { \"name\": \"c2\", \"exe\": \"y.exe\" },\n"
+				L"                { \"id\": \"c1\", \"exe\": \"z.exe\" } ]\n"
+				L"}\n");
+			ler::ConfigLoadResult r = ler::tryLoadAndValidateConfig(tmp.path);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(std::wstring(L"/commands/2/id"), r.error.path);
+
+			auto func = [&tmp]() { ler::loadConfigStreaming(tmp.path); };
+			Assert::ExpectException<ler::JsonParseError>(func);
+		}
+
+		TEST_METHOD(Load_ManyCommands_KeepsOrderAndSpans)
+		{
+			TempFile tmp(L"many.json");
+			std::string text = manyCommandsConfig(6000);
+			ler::writeUtf8FileAtomic(tmp.path, text);
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			Assert::AreEqual(6000u, static_cast<unsigned>(cfg.commands.size()));
+			Assert::AreEqual(6000u, static_cast<unsigned>(cfg.commandSpans.size()));
+			for (size_t i = 0; i < cfg.commands.size(); i += 997) {
+				Assert::AreEqual(L"c" + std::to_wstring(i), cfg.commands[i].name);
+				const ler::CommandSpan& span = cfg.commandSpans[i];
+				std::string entry = text.substr(span.objectBegin, span.objectEnd - span.objectBegin);
+				Assert::AreEqual(size_t(0), entry.find("{ \"name\": \"c" + std::to_string(i) + "\""));
+				Assert::AreEqual('}', entry.back());
+			}
+		}
+
+		TEST_METHOD(Load_ManyCommands_ReportsFirstError)
+		{
+			TempFile tmp(L"many_bad.json");
+			std::string text = manyCommandsConfig(6000);
+			// a type error in entry 1000 and a syntax error near the end
+			size_t first = text.find("\"c1000\", \"exe\": \"x.exe\"");
+			text.replace(text.find("\"x.exe\"", first), 7, "1");
+			text.replace(text.find("\"c5999\","), 8, "\"c5999\" ");
+
+			ler::writeUtf8FileAtomic(tmp.path, text);
+			std::string message;
+			try {
+				ler::loadAndValidateConfig(tmp.path);
+			}
+			catch (const ler::JsonParseError& e) {
+				message = e.what();
+			}
+			Assert::AreEqual(std::string("Expected string at exe"), message);
+		}
+
 		TEST_METHOD(Load_WithLastRunUtc_ParsesCorrectly)
 		{
 			TempFile tmp(L"lastrun.json");
@@ -256,13 +384,252 @@ namespace lastexecuterecordmstest
 			Assert::IsTrue(
 				cfg.root.isObject() &&
 				std::find_if(
-					cfg.root.o.begin(),
-					cfg.root.o.end(),
+					cfg.root.members().begin(),
+					cfg.root.members().end(),
 					[](const auto& kv) { return kv.first == L"commands"; }
-				) != cfg.root.o.end()
+				) != cfg.root.members().end()
 			);
 		}
 
+		TEST_METHOD(ApplyCommandsToJson_UnknownFields_RoundTripVerbatim)
+		{
+			TempFile tmp(L"metadata.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\", \"meta\": {\"owner\":\"team-a\",  \"tags\":[1,2]} } ]\n"
+				L"}\n");
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			cfg.commands[0].hasLastExitCode = true;
+			cfg.commands[0].lastExitCode = 3;
+			ler::applyCommandsToJson(cfg);
+
+			std::wstring json = ler::writeJson(cfg.root);
+			Assert::IsTrue(json.find(L"\"meta\": {\"owner\":\"team-a\",  \"tags\":[1,2]}") != std::wstring::npos);
+			Assert::IsTrue(json.find(L"\"lastExitCode\": 3") != std::wstring::npos);
+		}
+
+		TEST_METHOD(SaveConfig_SplicesStateIntoOriginalText)
+		{
+			TempFile tmp(L"patch.json");
+
+			std::string text =
+				"{\r\n"
+				"\t\"commands\" : [\r\n"
+				"\t\t{\r\n"
+				"\t\t\t\"name\":\"c1\",\r\n"
+				"\t\t\t\"exe\":\"x.exe\", \"lastExitCode\" : 0 ,\r\n"
+				"\t\t\t\"meta\": [1,2]\r\n"
+				"\t\t},\r\n"
+				"\t\t{ \"name\": \"c2\", \"exe\": \"y.exe\", \"lastRunUtc\": null }\r\n"
+				"\t]\r\n"
+				"}\r\n";
+			ler::writeUtf8FileAtomic(tmp.path, text);
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			cfg.commands[0].hasLastRunUtc = true;
+			cfg.commands[0].lastRunUtc = L"2026-01-02T12:34:56Z";
+			cfg.commands[0].lastExitCode = 12;
+			cfg.commands[1].hasLastRunUtc = true;
+			cfg.commands[1].lastRunUtc = L"2026-01-03T00:00:00Z";
+			cfg.commands[1].hasLastExitCode = true;
+			cfg.commands[1].lastExitCode = -3;
+			ler::saveConfig(tmp.path, cfg);
+
+			// only the state tokens change; missing ones follow the entry's own layout
+			std::string expected =
+				"{\r\n"
+				"\t\"commands\" : [\r\n"
+				"\t\t{\r\n"
+				"\t\t\t\"name\":\"c1\",\r\n"
+				"\t\t\t\"exe\":\"x.exe\", \"lastExitCode\" : 12 ,\r\n"
+				"\t\t\t\"meta\": [1,2],\r\n"
+				"\t\t\t\"lastRunUtc\":\"2026-01-02T12:34:56Z\"\r\n"
+				"\t\t},\r\n"
+				"\t\t{ \"name\": \"c2\", \"exe\": \"y.exe\", \"lastRunUtc\": \"2026-01-03T00:00:00Z\", \"lastExitCode\": -3 }\r\n"
+				"\t]\r\n"
+				"}\r\n";
+			Assert::AreEqual(expected, ler::readUtf8File(tmp.path));
+		}
+
+		TEST_METHOD(SaveConfig_SecondSave_PatchesUpdatedOffsets)
+		{
+			TempFile tmp(L"patch_twice.json");
+
+			ler::writeUtf8FileAtomic(tmp.path,
+				"{\"commands\": [{\"name\": \"c1\", \"exe\": \"x.exe\", \"lastExitCode\": 0}, {\"name\": \"c2\", \"exe\": \"y.exe\"}]}");
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			cfg.commands[0].lastExitCode = 100;
+			cfg.commands[1].hasLastExitCode = true;
+			cfg.commands[1].lastExitCode = 1;
+			ler::saveConfig(tmp.path, cfg);
+			cfg.commands[0].lastExitCode = 5;
+			cfg.commands[1].lastExitCode = 20;
+			ler::saveConfig(tmp.path, cfg);
+
+			Assert::AreEqual(
+				std::string("{\"commands\": [{\"name\": \"c1\", \"exe\": \"x.exe\", \"lastExitCode\": 5}, {\"name\": \"c2\", \"exe\": \"y.exe\", \"lastExitCode\": 20}]}"),
+				ler::readUtf8File(tmp.path));
+		}
+
+		TEST_METHOD(SaveConfig_RevertedFile_ReloadWithPreviousReadsItAgain)
+		{
+			TempFile tmp(L"patch_revert.json");
+
+			std::string original =
+				"{\"commands\": [{\"name\": \"a\", \"exe\": \"a.exe\"}, {\"name\": \"b\", \"exe\": \"b.exe\", \"lastExitCode\": 0}]}";
+			ler::writeUtf8FileAtomic(tmp.path, original);
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			cfg.commands[0].hasLastRunUtc = true;
+			cfg.commands[0].lastRunUtc = L"2026-01-02T12:34:56Z";
+			cfg.commands[1].lastExitCode = 7;
+			ler::saveConfig(tmp.path, cfg);
+
+			// the saved entries no longer match the original text, so neither is reused for it
+			ler::writeUtf8FileAtomic(tmp.path, original);
+			ler::AppConfig next = ler::loadAndValidateConfig(tmp.path, std::pmr::get_default_resource(), &cfg);
+			ler::AppConfig fresh = ler::loadAndValidateConfig(tmp.path);
+			Assert::IsFalse(next.commands[0].hasLastRunUtc);
+			Assert::AreEqual(0LL, next.commands[1].lastExitCode);
+			for (size_t i = 0; i < next.commands.size(); i++) {
+				Assert::AreEqual(static_cast<unsigned>(fresh.commandSpans[i].exitBegin), static_cast<unsigned>(next.commandSpans[i].exitBegin));
+				Assert::IsTrue(fresh.commandDigests[i].hash == next.commandDigests[i].hash);
+				Assert::AreEqual(fresh.commandDigests[i].present, next.commandDigests[i].present);
+			}
+
+			next.commands[1].lastExitCode = 9;
+			ler::saveConfig(tmp.path, next);
+			Assert::AreEqual(
+				std::string("{\"commands\": [{\"name\": \"a\", \"exe\": \"a.exe\"}, {\"name\": \"b\", \"exe\": \"b.exe\", \"lastExitCode\": 9}]}"),
+				ler::readUtf8File(tmp.path));
+		}
+
+		TEST_METHOD(SaveConfig_FileEditedSinceLoad_CarriesStateByName)
+		{
+			TempFile domFile(L"edited_dom.json");
+			TempFile streamFile(L"edited_stream.json");
+
+			std::string text =
+				"{\"commands\": [{\"name\": \"c1\", \"exe\": \"x.exe\", \"lastExitCode\": 3}, {\"name\": \"c2\", \"exe\": \"y.exe\"}]}";
+			ler::writeUtf8FileAtomic(domFile.path, text);
+			ler::writeUtf8FileAtomic(streamFile.path, text);
+			ler::AppConfig dom = ler::loadAndValidateConfig(domFile.path);
+			ler::AppConfig streamed = ler::loadConfigStreaming(streamFile.path);
+
+			// while the commands run, the file is edited: c2 moves to the front, c0
+			// is added and c1 gets a new exit code by hand
+			std::string edited =
+				"{\"commands\": [{\"name\": \"c2\", \"exe\": \"y.exe\"}, {\"name\": \"c0\", \"exe\": \"w.exe\"}, {\"name\": \"c1\", \"exe\": \"x.exe\", \"lastExitCode\": 9}]}";
+			ler::writeUtf8FileAtomic(domFile.path, edited);
+			ler::writeUtf8FileAtomic(streamFile.path, edited);
+			for (ler::AppConfig* cfg : { &dom, &streamed }) {
+				cfg->commands[1].hasLastExitCode = true;
+				cfg->commands[1].lastExitCode = 7;
+			}
+			ler::saveConfig(domFile.path, dom);
+			ler::saveConfig(streamFile.path, streamed);
+
+			// c2's run lands on c2 and c1's hand edit, which no run touched, stays
+			Assert::AreEqual(
+				std::string("{\"commands\": [{\"name\": \"c2\", \"exe\": \"y.exe\", \"lastExitCode\": 7}, {\"name\": \"c0\", \"exe\": \"w.exe\"}, {\"name\": \"c1\", \"exe\": \"x.exe\", \"lastExitCode\": 9}]}"),
+				ler::readUtf8File(domFile.path));
+			Assert::AreEqual(3u, static_cast<unsigned>(dom.commands.size()));
+			Assert::AreEqual(std::wstring(L"c2"), dom.commands[0].name);
+			Assert::AreEqual(7LL, dom.commands[0].lastExitCode);
+
+			// a streamed load keeps no text to tell what the run changed, so all of
+			// its state is carried over
+			ler::AppConfig reread = ler::loadAndValidateConfig(streamFile.path);
+			Assert::AreEqual(std::wstring(L"c2"), reread.commands[0].name);
+			Assert::AreEqual(7LL, reread.commands[0].lastExitCode);
+			Assert::IsFalse(reread.commands[1].hasLastExitCode);
+			Assert::AreEqual(3LL, reread.commands[2].lastExitCode);
+		}
+
+		TEST_METHOD(LoadStreaming_MatchesDomLoader)
+		{
+			TempFile tmp(L"streaming.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"version\": 1,\n"
+				L"  \"commands\": [\n"
+				L"    { \"name\": \"c1\", \"exe\": \"x.exe\", \"args\": [\"a\", \"b\"], \"meta\": {\"k\": [1, 2]}, \"lastExitCode\": 4 },\n"
+				L"    { \"id\": \"c2\", \"exe\": \"y.exe\", \"enabled\": false, \"minIntervalSeconds\": 5 }\n"
+				L"  ],\n"
+				L"  \"defaults\": { \"minIntervalSeconds\": 60, \"timeoutSeconds\": 10 }\n"
+				L"}\n");
+
+			ler::AppConfig dom = ler::loadAndValidateConfig(tmp.path);
+			ler::AppConfig streamed = ler::loadConfigStreaming(tmp.path);
+
+			Assert::IsTrue(streamed.streamed);
+			Assert::IsTrue(streamed.root.isNull());
+			Assert::AreEqual(static_cast<unsigned>(dom.commands.size()), static_cast<unsigned>(streamed.commands.size()));
+			for (size_t i = 0; i < dom.commands.size(); i++) {
+				const ler::CommandConfig& a = dom.commands[i];
+				const ler::CommandConfig& b = streamed.commands[i];
+				Assert::AreEqual(a.name, b.name);
+				Assert::AreEqual(a.exe.str(), b.exe.str());
+				Assert::IsTrue(a.args == b.args);
+				Assert::AreEqual(a.enabled, b.enabled);
+				// defaults appear after the commands and still apply
+				Assert::AreEqual(a.minIntervalSeconds, b.minIntervalSeconds);
+				Assert::AreEqual(a.timeoutSeconds, b.timeoutSeconds);
+				Assert::AreEqual(a.hasLastExitCode, b.hasLastExitCode);
+				Assert::AreEqual(a.lastExitCode, b.lastExitCode);
+			}
+		}
+
+		TEST_METHOD(LoadStreaming_CommandWithoutExe_Throws)
+		{
+			TempFile tmp(L"streaming_invalid.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"c1\" } ] }\n");
+
+			auto func = [&tmp]() { ler::loadConfigStreaming(tmp.path); };
+			Assert::ExpectException<ler::JsonParseError>(func);
+		}
+
+		TEST_METHOD(WriteConfigStreaming_MatchesDomWriteBack)
+		{
+			TempFile domFile(L"writeback_dom.json");
+			TempFile streamFile(L"writeback_stream.json");
+
+			std::wstring text =
+				L"{\n"
+				L"  \"commands\": [\n"
+				L"    { \"name\": \"c1\", \"exe\": \"x.exe\", \"lastRunUtc\": \"2024-01-01T00:00:00Z\", \"tags\": [\"t\"] },\n"
+				L"    { \"name\": \"c2\", \"exe\": \"y.exe\" }\n"
+				L"  ]\n"
+				L"}\n";
+			ler::writeWStringToUtf8FileAtomic(domFile.path, text);
+			ler::writeWStringToUtf8FileAtomic(streamFile.path, text);
+
+			ler::AppConfig dom = ler::loadAndValidateConfig(domFile.path);
+			ler::AppConfig streamed = ler::loadConfigStreaming(streamFile.path);
+			for (ler::AppConfig* cfg : { &dom, &streamed }) {
+				for (ler::CommandConfig& cc : cfg->commands) {
+					cc.hasLastRunUtc = true;
+					cc.lastRunUtc = L"2025-02-03T04:05:06Z";
+					cc.hasLastExitCode = true;
+					cc.lastExitCode = 1;
+				}
+			}
+			ler::saveConfig(domFile.path, dom);
+			ler::saveConfig(streamFile.path, streamed);
+
+			// the streaming writer re-serializes every value, so compare normalized output
+			std::wstring expected = ler::writeJson(ler::parseJsonUtf8(ler::readUtf8File(domFile.path)));
+			std::wstring actual = ler::readUtf8FileToWString(streamFile.path);
+			Assert::AreEqual(expected, actual);
+			Assert::IsTrue(actual.find(L"\"lastRunUtc\": \"2025-02-03T04:05:06Z\"") != std::wstring::npos);
+		}
+
 		TEST_METHOD(Load_WithNetworkOption_ParsesCorrectly)
 		{
 			TempFile tmp(L"networkoption.json");
@@ -317,5 +684,374 @@ namespace lastexecuterecordmstest
 			auto func = [&tmp]() { ler::loadAndValidateConfig(tmp.path); };
 			Assert::ExpectException<ler::JsonParseError>(func);
 		}
+
+		TEST_METHOD(Load_StateStore_ParsesAndValidates)
+		{
+			TempFile tmp(L"statestore.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\" } ] }");
+			Assert::IsTrue(ler::loadAndValidateConfig(tmp.path).stateStore == ler::StateStore::Config);
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"stateStore\": \"journal\", \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\" } ] }");
+			Assert::IsTrue(ler::loadAndValidateConfig(tmp.path).stateStore == ler::StateStore::Journal);
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"stateStore\": \"registry\", \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\" } ] }");
+			ler::ConfigLoadResult r = ler::tryLoadAndValidateConfig(tmp.path);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(std::wstring(L"/stateStore"), r.error.path);
+		}
+
+		TEST_METHOD(TryLoad_Invalid_ReportsCodeAndPath)
+		{
+			TempFile tmp(L"tryload.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"commands\": [\n"
+				L"    { \"name\": \"c1\", \"exe\": \"x.exe\" },\n"
+				L"    { \"name\": \"c2\", \"exe\": \"y.exe\", \"minIntervalSeconds\": -5 }\n"
+				L"  ]\n"
+				L"}\n");
+			ler::ConfigLoadResult r = ler::tryLoadAndValidateConfig(tmp.path);
+			Assert::IsFalse(r.ok());
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(std::wstring(L"/commands/1/minIntervalSeconds"), r.error.path);
+			Assert::AreEqual(4u, static_cast<unsigned>(r.error.line));
+			Assert::IsTrue(r.config.commands.empty());
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\" }, { \"name\": \"c2\" } ] }");
+			r = ler::tryLoadAndValidateConfig(tmp.path);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(std::wstring(L"/commands/1"), r.error.path);
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"c1\", \"exe\": 7 } ] }");
+			r = ler::tryLoadAndValidateConfig(tmp.path);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Type);
+			Assert::AreEqual(std::wstring(L"/commands/0/exe"), r.error.path);
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"c1\", \"exe\": \"x.exe\" } ] }");
+			r = ler::tryLoadAndValidateConfig(tmp.path);
+			Assert::IsTrue(r.ok());
+			Assert::AreEqual(1u, static_cast<unsigned>(r.config.commands.size()));
+		}
+
+		TEST_METHOD(TryLoad_MissingFile_ReportsIo)
+		{
+			ler::ConfigLoadResult r = ler::tryLoadAndValidateConfig(makeTempPath(L"does_not_exist.json"));
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Io);
+			Assert::IsFalse(r.error.message.empty());
+		}
+
+		TEST_METHOD(LintConfigFiles_ReportsEachFile)
+		{
+			TempDirectory tempDir(L"configtest_lint");
+			ler::ensureDirectoryExists(tempDir.path);
+			std::vector<std::wstring> paths;
+			for (int i = 0; i < 8; i++) {
+				paths.push_back(ler::joinPath(tempDir.path, L"c" + std::to_wstring(i) + L".json"));
+				ler::writeWStringToUtf8FileAtomic(paths.back(), i % 3 == 1
+					? L"{ \"commands\": [ { \"name\": \"c\" } ] }"
+					: L"{ \"commands\": [ { \"name\": \"c\", \"exe\": \"x.exe\" } ] }");
+			}
+
+			std::vector<std::wstring> found = ler::listFilesRecursive(tempDir.path, L".JSON");
+			Assert::AreEqual(8u, static_cast<unsigned>(found.size()));
+			std::vector<ler::JsonError> errors = ler::lintConfigFiles(found);
+			Assert::AreEqual(8u, static_cast<unsigned>(errors.size()));
+			for (size_t i = 0; i < found.size(); i++) {
+				bool invalid = found[i] == paths[1] || found[i] == paths[4] || found[i] == paths[7];
+				Assert::AreEqual(invalid, errors[i].code != ler::JsonErrorCode::None);
+			}
+		}
+
+		TEST_METHOD(LintConfigFiles_LargeFilesReportedInPlace)
+		{
+			TempDirectory tempDir(L"configtest_lint_large");
+			ler::ensureDirectoryExists(tempDir.path);
+			std::vector<std::wstring> paths;
+			for (int i = 0; i < 4; i++) paths.push_back(ler::joinPath(tempDir.path, L"c" + std::to_wstring(i) + L".json"));
+
+			// the large files are linted after the small ones, one at a time
+			std::string broken = manyCommandsConfig(6000);
+			broken.replace(broken.find("\"exe\"", broken.find("\"c4321\"")), 16, "");
+			ler::writeUtf8FileAtomic(paths[0], manyCommandsConfig(6000));
+			ler::writeWStringToUtf8FileAtomic(paths[1], L"{ \"commands\": [ { \"name\": \"c\" } ] }");
+			ler::writeUtf8FileAtomic(paths[2], broken);
+			ler::writeWStringToUtf8FileAtomic(paths[3], L"{ \"commands\": [] }");
+
+			std::vector<ler::JsonError> errors = ler::lintConfigFiles(paths);
+			Assert::IsTrue(errors[0].code == ler::JsonErrorCode::None);
+			Assert::IsTrue(errors[1].code == ler::JsonErrorCode::Invalid);
+			Assert::IsTrue(errors[2].code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(std::wstring(L"/commands/4321"), errors[2].path);
+			Assert::IsTrue(errors[3].code == ler::JsonErrorCode::None);
+		}
+
+		TEST_METHOD(Load_WithPrevious_ReusesUnchangedCommands)
+		{
+			TempFile tmp(L"reload.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"defaults\": { \"minIntervalSeconds\": 60 },\n"
+				L"  \"commands\": [\n"
+				L"    { \"name\": \"a\", \"exe\": \"a.exe\" },\n"
+				L"    { \"name\": \"b\", \"exe\": \"b.exe\", \"lastExitCode\": 1 },\n"
+				L"    { \"id\": \"c\", \"exe\": \"c.exe\", \"args\": [\"-x\"], \"lastRunUtc\": \"2025-01-01T00:00:00Z\" }\n"
+				L"  ]\n"
+				L"}\n");
+			ler::AppConfig previous = ler::loadAndValidateConfig(tmp.path);
+			Assert::AreEqual(3u, static_cast<unsigned>(previous.commandDigests.size()));
+
+			// mark the loaded commands, so a reused one is recognizable; state held
+			// only in memory must not survive the reload
+			for (auto& c : previous.commands) c.workingDirectory = L"reused";
+			previous.commands[2].lastRunUtc = L"2026-06-01T00:00:00Z";
+
+			// b changes, c moves to the front, the default interval changes
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{\n"
+				L"  \"commands\": [\n"
+				L"    { \"id\": \"c\", \"exe\": \"c.exe\", \"args\": [\"-x\"], \"lastRunUtc\": \"2025-01-01T00:00:00Z\" },\n"
+				L"    { \"name\": \"a\", \"exe\": \"a.exe\" },\n"
+				L"    { \"name\": \"b\", \"exe\": \"b2.exe\", \"lastExitCode\": 1 }\n"
+				L"  ],\n"
+				L"  \"defaults\": { \"minIntervalSeconds\": 5 }\n"
+				L"}\n");
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path, std::pmr::get_default_resource(), &previous);
+			ler::AppConfig fresh = ler::loadAndValidateConfig(tmp.path);
+
+			Assert::AreEqual(3u, static_cast<unsigned>(cfg.commands.size()));
+			Assert::AreEqual(std::wstring(L"c"), cfg.commands[0].name);
+			Assert::AreEqual(std::wstring(L"reused"), cfg.commands[0].workingDirectory.str());
+			Assert::AreEqual(std::wstring(L"reused"), cfg.commands[1].workingDirectory.str());
+			Assert::AreEqual(std::wstring(L""), cfg.commands[2].workingDirectory.str());
+			Assert::AreEqual(std::wstring(L"b2.exe"), cfg.commands[2].exe.str());
+			Assert::AreEqual(std::wstring(L"2025-01-01T00:00:00Z"), cfg.commands[0].lastRunUtc);
+			for (size_t i = 0; i < cfg.commands.size(); i++) {
+				Assert::AreEqual(5LL, cfg.commands[i].minIntervalSeconds);
+				Assert::AreEqual(fresh.commands[i].name, cfg.commands[i].name);
+				Assert::AreEqual(static_cast<unsigned>(fresh.commands[i].args.size()), static_cast<unsigned>(cfg.commands[i].args.size()));
+				Assert::AreEqual(fresh.commands[i].hasLastExitCode, cfg.commands[i].hasLastExitCode);
+				Assert::AreEqual(static_cast<unsigned>(fresh.commandSpans[i].objectBegin), static_cast<unsigned>(cfg.commandSpans[i].objectBegin));
+				Assert::AreEqual(static_cast<unsigned>(fresh.commandSpans[i].runBegin), static_cast<unsigned>(cfg.commandSpans[i].runBegin));
+				Assert::IsTrue(fresh.commandDigests[i].hash == cfg.commandDigests[i].hash);
+			}
+		}
+
+		TEST_METHOD(Load_WithPrevious_FailureLeavesPreviousIntact)
+		{
+			TempFile tmp(L"reloadinvalid.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"defaults\": { \"timeoutSeconds\": 9 },"
+				L"  \"commands\": [ { \"name\": \"a\", \"exe\": \"a.exe\" }, { \"name\": \"b\", \"exe\": \"b.exe\" } ] }");
+			ler::AppConfig previous = ler::loadAndValidateConfig(tmp.path);
+
+			// a is unchanged, but the new default makes it invalid
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"defaults\": { \"timeoutSeconds\": -1 },"
+				L"  \"commands\": [ { \"name\": \"a\", \"exe\": \"a.exe\" }, { \"name\": \"b\", \"exe\": \"b.exe\", \"timeoutSeconds\": 3 } ] }");
+			ler::ConfigLoadResult r = ler::tryLoadAndValidateConfig(tmp.path, std::pmr::get_default_resource(), &previous);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(std::wstring(L"/commands/0"), r.error.path);
+
+			Assert::AreEqual(std::wstring(L"a"), previous.commands[0].name);
+			Assert::AreEqual(std::wstring(L"a.exe"), previous.commands[0].exe.str());
+			Assert::AreEqual(9LL, previous.commands[0].timeoutSeconds);
+			Assert::AreEqual(std::wstring(L"b"), previous.commands[1].name);
+		}
+
+		TEST_METHOD(Load_RepeatedStrings_ShareOneBuffer)
+		{
+			TempFile tmp(L"interned.json");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [\n"
+				L"  { \"name\": \"a\", \"exe\": \"pwsh.exe\", \"args\": [\"-File\", \"a.ps1\"], \"workingDirectory\": \"C:\\\\jobs\" },\n"
+				L"  { \"name\": \"b\", \"exe\": \"pwsh.exe\", \"args\": [\"-File\", \"b.ps1\"], \"workingDirectory\": \"C:\\\\jobs\" } ] }");
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			Assert::IsTrue(&cfg.commands[0].exe.str() == &cfg.commands[1].exe.str());
+			Assert::IsTrue(&cfg.commands[0].workingDirectory.str() == &cfg.commands[1].workingDirectory.str());
+			Assert::IsTrue(&cfg.commands[0].args[0].str() == &cfg.commands[1].args[0].str());
+			Assert::AreEqual(std::wstring(L"b.ps1"), cfg.commands[1].args[1].str());
+			// only strings used more than once stay indexed
+			Assert::AreEqual(3u, static_cast<unsigned>(cfg.strings.size()));
+
+			// a command added on reload shares with the reused ones
+			ler::writeWStringToUtf8FileAtomic(tmp.path,
+				L"{ \"commands\": [\n"
+				L"  { \"name\": \"a\", \"exe\": \"pwsh.exe\", \"args\": [\"-File\", \"a.ps1\"], \"workingDirectory\": \"C:\\\\jobs\" },\n"
+				L"  { \"name\": \"c\", \"exe\": \"pwsh.exe\" } ] }");
+			ler::AppConfig next = ler::loadAndValidateConfig(tmp.path, std::pmr::get_default_resource(), &cfg);
+			Assert::IsTrue(&next.commands[0].exe.str() == &next.commands[1].exe.str());
+		}
+
+		TEST_METHOD(Load_Include_AppendsFragmentCommands)
+		{
+			TempDirectory rootDir(L"configtest_include");
+			TempDirectory fragmentDir(L"configtest_include_d");
+			ler::ensureDirectoryExists(rootDir.path);
+			ler::ensureDirectoryExists(fragmentDir.path);
+			std::wstring configPath = ler::joinPath(rootDir.path, L"config.json");
+			std::wstring f1 = ler::joinPath(fragmentDir.path, L"f1.json");
+			std::wstring f2 = ler::joinPath(fragmentDir.path, L"f2.json");
+
+			// a directory (absolute) and a file (relative to the config)
+			std::wstring escaped;
+			for (wchar_t ch : fragmentDir.path) {
+				if (ch == L'\\') escaped += L'\\';
+				escaped += ch;
+			}
+			ler::writeWStringToUtf8FileAtomic(configPath,
+				L"{ \"defaults\": { \"minIntervalSeconds\": 60 },\n"
+				L"  \"include\": [\"" + escaped + L"\", \"extra.json\"],\n"
+				L"  \"commands\": [ { \"name\": \"own\", \"exe\": \"own.exe\" } ] }\n");
+			ler::writeWStringToUtf8FileAtomic(f1,
+				L"{ \"commands\": [ { \"name\": \"a\", \"exe\": \"a.exe\", \"minIntervalSeconds\": 5 } ] }\n");
+			ler::writeWStringToUtf8FileAtomic(f2,
+				L"{ \"commands\": [\n  { \"name\": \"b\", \"exe\": \"b.exe\" }\n] }\n");
+			ler::writeWStringToUtf8FileAtomic(ler::joinPath(rootDir.path, L"extra.json"),
+				L"{ \"commands\": [ { \"name\": \"c\", \"exe\": \"c.exe\" } ] }\n");
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(configPath);
+			Assert::AreEqual(4u, static_cast<unsigned>(cfg.commands.size()));
+			Assert::AreEqual(std::wstring(L"own"), cfg.commands[0].name);
+			Assert::AreEqual(std::wstring(L"a"), cfg.commands[1].name);
+			Assert::AreEqual(std::wstring(L"b"), cfg.commands[2].name);
+			Assert::AreEqual(std::wstring(L"c"), cfg.commands[3].name);
+			Assert::AreEqual(5LL, cfg.commands[1].minIntervalSeconds);
+			Assert::AreEqual(60LL, cfg.commands[2].minIntervalSeconds);
+			Assert::AreEqual(3u, static_cast<unsigned>(cfg.fragments.size()));
+			Assert::AreEqual(f2, cfg.fragments[1].path);
+			// fragments are cached individually; the config itself is not
+			Assert::IsTrue(ler::fileExists(ler::configSnapshotPath(f1)));
+			Assert::IsFalse(ler::writeConfigSnapshot(configPath, cfg));
+
+			// state is written into the file the command came from
+			cfg.commands[2].hasLastExitCode = true;
+			cfg.commands[2].lastExitCode = 7;
+			std::string rootBefore = ler::readUtf8File(configPath);
+			ler::saveConfig(configPath, cfg);
+			Assert::AreEqual(rootBefore, ler::readUtf8File(configPath));
+			Assert::AreEqual(std::string("{ \"commands\": [\n  { \"name\": \"b\", \"exe\": \"b.exe\", \"lastExitCode\": 7 }\n] }\n"),
+				ler::readUtf8File(f2));
+			Assert::AreEqual(4u, static_cast<unsigned>(cfg.commands.size()));
+
+			ler::AppConfig reloaded = ler::loadAndValidateConfig(configPath, std::pmr::get_default_resource(), &cfg);
+			Assert::AreEqual(4u, static_cast<unsigned>(reloaded.commands.size()));
+			Assert::AreEqual(std::wstring(L"b"), reloaded.commands[2].name);
+			Assert::AreEqual(7LL, reloaded.commands[2].lastExitCode);
+			Assert::AreEqual(60LL, reloaded.commands[3].minIntervalSeconds);
+			Assert::AreEqual(4u, static_cast<unsigned>(cfg.commands.size()));
+
+			// a command moved to another file keeps the state saved for it
+			reloaded.commands[1].hasLastExitCode = true;
+			reloaded.commands[1].lastExitCode = 3;
+			ler::writeWStringToUtf8FileAtomic(f1, L"{ \"commands\": [] }\n");
+			ler::writeWStringToUtf8FileAtomic(f2,
+				L"{ \"commands\": [ { \"name\": \"a\", \"exe\": \"a.exe\" }, { \"name\": \"b\", \"exe\": \"b.exe\" } ] }\n");
+			ler::saveConfig(configPath, reloaded);
+			ler::AppConfig moved = ler::loadAndValidateConfig(configPath);
+			Assert::AreEqual(std::wstring(L"a"), moved.commands[1].name);
+			Assert::AreEqual(3LL, moved.commands[1].lastExitCode);
+			Assert::IsFalse(moved.commands[2].hasLastExitCode);
+		}
+
+		TEST_METHOD(Load_Include_FragmentStringsShareTheConfigPool)
+		{
+			TempDirectory dir(L"configtest_include_pool");
+			ler::ensureDirectoryExists(dir.path);
+			std::wstring configPath = ler::joinPath(dir.path, L"config.json");
+			ler::writeWStringToUtf8FileAtomic(configPath,
+				L"{ \"include\": [\"f1.json\", \"f2.json\"],\n"
+				L"  \"commands\": [ { \"name\": \"own\", \"exe\": \"pwsh.exe\" } ] }\n");
+			ler::writeWStringToUtf8FileAtomic(ler::joinPath(dir.path, L"f1.json"),
+				L"{ \"commands\": [ { \"name\": \"a\", \"exe\": \"pwsh.exe\", \"args\": [\"-File\"] } ] }\n");
+			ler::writeWStringToUtf8FileAtomic(ler::joinPath(dir.path, L"f2.json"),
+				L"{ \"commands\": [ { \"name\": \"b\", \"exe\": \"pwsh.exe\", \"args\": [\"-File\"] } ] }\n");
+
+			// the same text in the config and its fragments is one buffer, indexed once
+			ler::AppConfig cfg = ler::loadAndValidateConfig(configPath);
+			Assert::IsTrue(&cfg.commands[0].exe.str() == &cfg.commands[1].exe.str());
+			Assert::IsTrue(&cfg.commands[1].exe.str() == &cfg.commands[2].exe.str());
+			Assert::IsTrue(&cfg.commands[1].args[0].str() == &cfg.commands[2].args[0].str());
+			Assert::AreEqual(2u, static_cast<unsigned>(cfg.strings.size()));
+			Assert::AreEqual(0u, static_cast<unsigned>(cfg.fragments[0].config.strings.size()));
+
+			// fragments restored from their snapshots are pooled the same way
+			ler::AppConfig again = ler::loadAndValidateConfig(configPath);
+			Assert::IsTrue(&again.commands[0].exe.str() == &again.commands[2].exe.str());
+		}
+
+		TEST_METHOD(Load_Include_LargeFragmentKeepsItsPlace)
+		{
+			TempDirectory dir(L"configtest_include_large");
+			ler::ensureDirectoryExists(dir.path);
+			std::wstring configPath = ler::joinPath(dir.path, L"config.json");
+
+			// the large fragment is loaded after the small ones, on threads of its own
+			ler::writeWStringToUtf8FileAtomic(configPath,
+				L"{ \"include\": [\"first.json\", \"large.json\", \"last.json\"], \"commands\": [] }\n");
+			ler::writeWStringToUtf8FileAtomic(ler::joinPath(dir.path, L"first.json"),
+				L"{ \"commands\": [ { \"name\": \"first\", \"exe\": \"a.exe\" } ] }\n");
+			ler::writeUtf8FileAtomic(ler::joinPath(dir.path, L"large.json"), manyCommandsConfig(6000));
+			ler::writeWStringToUtf8FileAtomic(ler::joinPath(dir.path, L"last.json"),
+				L"{ \"commands\": [ { \"name\": \"last\", \"exe\": \"b.exe\" } ] }\n");
+
+			ler::AppConfig cfg = ler::loadAndValidateConfig(configPath);
+			Assert::AreEqual(6002u, static_cast<unsigned>(cfg.commands.size()));
+			Assert::AreEqual(std::wstring(L"first"), cfg.commands[0].name);
+			Assert::AreEqual(std::wstring(L"c0"), cfg.commands[1].name);
+			Assert::AreEqual(std::wstring(L"c5999"), cfg.commands[6000].name);
+			Assert::AreEqual(std::wstring(L"last"), cfg.commands[6001].name);
+			Assert::AreEqual(6000u, static_cast<unsigned>(cfg.fragments[1].commandCount));
+		}
+
+		TEST_METHOD(Load_Include_ErrorsReportTheirFragment)
+		{
+			TempDirectory dir(L"configtest_include_err");
+			ler::ensureDirectoryExists(dir.path);
+			std::wstring configPath = ler::joinPath(dir.path, L"config.json");
+			std::wstring fragment = ler::joinPath(dir.path, L"more.json");
+			ler::writeWStringToUtf8FileAtomic(configPath,
+				L"{ \"include\": [\"more.json\"], \"commands\": [ { \"name\": \"a\", \"exe\": \"a.exe\" } ] }");
+
+			// a name already used by the config
+			ler::writeWStringToUtf8FileAtomic(fragment,
+				L"{ \"commands\": [\n  { \"name\": \"b\", \"exe\": \"b.exe\" },\n  { \"exe\": \"a.exe\", \"name\": \"a\" }\n] }");
+			ler::ConfigLoadResult r = ler::tryLoadAndValidateConfig(configPath);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(fragment, r.errorFile);
+			Assert::AreEqual(std::wstring(L"/commands/1/name"), r.error.path);
+			Assert::AreEqual(3u, static_cast<unsigned>(r.error.line));
+			Assert::ExpectException<ler::JsonParseError>([&]() { ler::loadAndValidateConfig(configPath); });
+
+			// fragments do not nest
+			ler::writeWStringToUtf8FileAtomic(fragment,
+				L"{ \"include\": [\"config.json\"], \"commands\": [] }");
+			r = ler::tryLoadAndValidateConfig(configPath);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Invalid);
+			Assert::AreEqual(fragment, r.errorFile);
+			Assert::AreEqual(std::wstring(L"/include"), r.error.path);
+
+			// a missing fragment
+			DeleteFileW(fragment.c_str());
+			r = ler::tryLoadAndValidateConfig(configPath);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Io);
+			Assert::AreEqual(fragment, r.errorFile);
+
+			// errors in the config itself are reported there
+			ler::writeWStringToUtf8FileAtomic(configPath, L"{ \"include\": \"more.json\", \"commands\": [] }");
+			r = ler::tryLoadAndValidateConfig(configPath);
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Type);
+			Assert::AreEqual(configPath, r.errorFile);
+		}
 	};
 }
@@ -1,4 +1,4 @@
-#include "CppUnitTest.h"
+﻿#include "CppUnitTest.h"
 #include "FileUtil.h"
 #include <Windows.h>
 
@@ -66,6 +66,59 @@ namespace lastexecuterecordmstest
 			Assert::AreEqual(std::wstring(L""), read);
 		}
 
+		TEST_METHOD(ReadUtf8File_WithBom_StripsBomWithoutTranscoding)
+		{
+			TempFile tmp(L"bom.txt");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path, L"\uFEFFabc\u00e9");
+			std::string bytes = ler::readUtf8File(tmp.path);
+
+			Assert::AreEqual(std::string("abc\xC3\xA9"), bytes);
+		}
+
+		TEST_METHOD(WriteUtf8FileAtomic_WritesBytesUnchanged)
+		{
+			TempFile tmp(L"bytes.txt");
+
+			ler::writeUtf8FileAtomic(tmp.path, "abc\xC3\xA9");
+
+			Assert::AreEqual(std::string("abc\xC3\xA9"), ler::readUtf8File(tmp.path));
+		}
+
+		TEST_METHOD(MappedFile_WithBom_ExposesTextWithoutBom)
+		{
+			TempFile tmp(L"mapped.txt");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path, L"\uFEFF{\"a\":1}");
+			ler::MappedFile file(tmp.path);
+
+			Assert::AreEqual(std::string("{\"a\":1}"), std::string(file.text));
+		}
+
+		TEST_METHOD(MappedFile_EmptyFile_HasEmptyText)
+		{
+			TempFile tmp(L"mapped_empty.txt");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path, L"");
+			ler::MappedFile file(tmp.path);
+
+			Assert::IsTrue(file.text.empty());
+		}
+
+		TEST_METHOD(AtomicFileWriter_Uncommitted_LeavesTargetUntouched)
+		{
+			TempFile tmp(L"atomic.txt");
+
+			ler::writeWStringToUtf8FileAtomic(tmp.path, L"old");
+			{
+				ler::AtomicFileWriter out(tmp.path);
+				out.write("new");
+			}
+
+			Assert::AreEqual(std::string("old"), ler::readUtf8File(tmp.path));
+			Assert::IsFalse(ler::fileExists(tmp.path + L".tmp"));
+		}
+
 		TEST_METHOD(Read_NonExistentFile_Throws)
 		{
 			std::wstring nonExistent = makeTempPath(L"doesnotexist.txt");
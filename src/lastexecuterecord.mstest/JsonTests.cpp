@@ -1,10 +1,51 @@
 ﻿#include "CppUnitTest.h"
 #include "Json.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace lastexecuterecordmstest
 {
+	// Forwards every parse event to a stream writer
+	struct EchoHandler : ler::JsonEventHandler {
+		ler::JsonStreamWriter& w;
+		explicit EchoHandler(ler::JsonStreamWriter& writer) : w(writer) {}
+		void onObjectStart() override { w.beginObject(); }
+		void onObjectEnd() override { w.endObject(); }
+		void onArrayStart() override { w.beginArray(); }
+		void onArrayEnd() override { w.endArray(); }
+		void onKey(std::wstring_view k) override { w.key(k); }
+		void onString(std::wstring_view v) override { w.stringValue(v); }
+		void onInt(std::int64_t v) override { w.intValue(v); }
+		void onDouble(double v) override { w.doubleValue(v); }
+		void onBool(bool v) override { w.boolValue(v); }
+		void onNull() override { w.nullValue(); }
+	};
+
+	// Worst-case parser inputs of roughly `bytes` bytes: sibling arrays nested to
+	// the depth limit, one long string full of escapes, or long digit runs
+	static std::string worstCaseCorpus(int shape, size_t bytes) {
+		std::string text = "[";
+		if (shape == 0) {
+			std::string block = std::string(ler::kJsonMaxDepth - 1, '[') + std::string(ler::kJsonMaxDepth - 1, ']');
+			while (text.size() < bytes) text += block + ",";
+		}
+		else if (shape == 1) {
+			text += "\"";
+			while (text.size() < bytes) text += "ab\\n\\u00e9\xC3\xA9";
+			text += "\",";
+		}
+		else {
+			std::string digits(300, '7');
+			while (text.size() < bytes) text += "-" + digits + "." + digits + "e-300,";
+		}
+		text.back() = ']';
+		return text;
+	}
+
 	TEST_CLASS(JsonTests)
 	{
 	public:
@@ -32,50 +73,84 @@ namespace lastexecuterecordmstest
 		{
 			ler::JsonValue v = ler::parseJson(L"1.25");
 			Assert::IsTrue(v.isDouble());
-			Assert::AreEqual(1.25, v.d);
+			Assert::AreEqual(1.25, v.asDouble(L"ctx"));
+		}
+
+		TEST_METHOD(Parse_Int64Limits_ReturnsExactInt)
+		{
+			ler::JsonValue hi = ler::parseJsonUtf8("9223372036854775807");
+			ler::JsonValue lo = ler::parseJson(L"-9223372036854775808");
+			Assert::IsTrue(hi.isInt());
+			Assert::AreEqual(INT64_MAX, hi.asInt(L"ctx"));
+			Assert::IsTrue(lo.isInt());
+			Assert::AreEqual(INT64_MIN, lo.asInt(L"ctx"));
+		}
+
+		TEST_METHOD(Parse_IntBeyondInt64_FallsBackToDouble)
+		{
+			ler::JsonValue v = ler::parseJsonUtf8("18446744073709551616");
+			Assert::IsTrue(v.isDouble());
+			Assert::AreEqual(18446744073709551616.0, v.asDouble(L"ctx"));
+		}
+
+		TEST_METHOD(Parse_DoubleOutOfRange_Throws)
+		{
+			Assert::ExpectException<ler::JsonParseError>([]() { ler::parseJsonUtf8("1e400"); });
+			Assert::ExpectException<ler::JsonParseError>([]() { ler::parseJson(L"-1e400"); });
+		}
+
+		TEST_METHOD(WriteUtf8_Doubles_RoundTripWithShortestText)
+		{
+			const double values[] = { 0.1, 1234567.891, 5e-324, 1.7976931348623157e308, -2.5e-7 };
+			for (double d : values) {
+				std::string text = ler::writeJsonUtf8(ler::JsonValue::makeDouble(d), -1);
+				Assert::AreEqual(d, ler::parseJsonUtf8(text).asDouble(L"ctx"));
+			}
+			Assert::AreEqual(std::string("0.1"), ler::writeJsonUtf8(ler::JsonValue::makeDouble(0.1), -1));
+			Assert::AreEqual(std::string("1234567.891"), ler::writeJsonUtf8(ler::JsonValue::makeDouble(1234567.891), -1));
 		}
 
 		TEST_METHOD(Parse_String_EscapesHandled)
 		{
 			ler::JsonValue v = ler::parseJson(L"\"a\\n\\t\\\"\\\\b\"");
 			Assert::IsTrue(v.isString());
-			Assert::AreEqual(std::wstring(L"a\n\t\"\\b"), v.s);
+			Assert::AreEqual(std::wstring(L"a\n\t\"\\b"), std::wstring(v.asString(L"ctx")));
 		}
 
 		TEST_METHOD(Parse_Array_ReturnsArray)
 		{
 			ler::JsonValue v = ler::parseJson(L"[1,2,3]");
 			Assert::IsTrue(v.isArray());
-			Assert::AreEqual(3u, static_cast<unsigned>(v.a.size()));
-			Assert::AreEqual(1LL, v.a[0].asInt(L"ctx"));
-			Assert::AreEqual(2LL, v.a[1].asInt(L"ctx"));
-			Assert::AreEqual(3LL, v.a[2].asInt(L"ctx"));
+			Assert::AreEqual(3u, static_cast<unsigned>(v.items().size()));
+			Assert::AreEqual(1LL, v.items()[0].asInt(L"ctx"));
+			Assert::AreEqual(2LL, v.items()[1].asInt(L"ctx"));
+			Assert::AreEqual(3LL, v.items()[2].asInt(L"ctx"));
 		}
 
 		TEST_METHOD(Parse_Object_PreservesInsertionOrder)
 		{
 			ler::JsonValue v = ler::parseJson(L"{\"b\":1,\"a\":2}");
 			Assert::IsTrue(v.isObject());
-			Assert::AreEqual(2u, static_cast<unsigned>(v.o.size()));
-			Assert::AreEqual(std::wstring(L"b"), v.o[0].first);
-			Assert::AreEqual(std::wstring(L"a"), v.o[1].first);
+			Assert::AreEqual(2u, static_cast<unsigned>(v.members().size()));
+			Assert::AreEqual(std::wstring(L"b"), std::wstring(v.members()[0].first));
+			Assert::AreEqual(std::wstring(L"a"), std::wstring(v.members()[1].first));
 		}
 
 		TEST_METHOD(Parse_NestedObject_Works)
 		{
 			ler::JsonValue v = ler::parseJson(L"{\"x\":{\"y\":42}}");
 			Assert::IsTrue(v.isObject());
-			Assert::AreEqual(1u, static_cast<unsigned>(v.o.size()));
-			Assert::IsTrue(v.o[0].second.isObject());
-			Assert::AreEqual(42LL, v.o[0].second.o[0].second.asInt(L"ctx"));
+			Assert::AreEqual(1u, static_cast<unsigned>(v.members().size()));
+			Assert::IsTrue(v.members()[0].second.isObject());
+			Assert::AreEqual(42LL, v.members()[0].second.members()[0].second.asInt(L"ctx"));
 		}
 
 		TEST_METHOD(Write_SimpleObject_FormatsCorrectly)
 		{
 			ler::JsonValue root;
-			root = ler::JsonValue::makeObject(std::vector<std::pair<std::wstring, ler::JsonValue>>{});
-			root.o.emplace_back(L"name", ler::JsonValue::makeString(L"test"));
-			root.o.emplace_back(L"value", ler::JsonValue::makeInt(123));
+			root = ler::JsonValue::makeObject(ler::JsonValue::Object{});
+			root.members().emplace_back(L"name", ler::JsonValue::makeString(L"test"));
+			root.members().emplace_back(L"value", ler::JsonValue::makeInt(123));
 
 			std::wstring json = ler::writeJson(root);
 			// Should contain both keys
@@ -88,7 +163,7 @@ namespace lastexecuterecordmstest
 		TEST_METHOD(Write_Array_FormatsCorrectly)
 		{
 			ler::JsonValue root;
-			root = ler::JsonValue::makeArray(std::vector<ler::JsonValue>{});
+			root = ler::JsonValue::makeArray(ler::JsonValue::Array{});
 			root.addItem(ler::JsonValue::makeInt(1));
 			root.addItem(ler::JsonValue::makeInt(2));
 			root.addItem(ler::JsonValue::makeInt(3));
@@ -101,6 +176,270 @@ namespace lastexecuterecordmstest
 			Assert::IsTrue(json.find(L"3") != std::wstring::npos);
 		}
 
+		TEST_METHOD(WriteUtf8_Indented_MatchesWriteJson)
+		{
+			ler::JsonValue v = ler::parseJsonUtf8("{\"a\": [1, {\"b\": \"q\\\"x\"}], \"c\": {}, \"d\": []}");
+
+			std::wstring wide = ler::writeJson(v);
+			Assert::AreEqual(std::string(wide.begin(), wide.end()), ler::writeJsonUtf8(v));
+			Assert::AreEqual(std::string("{\n  \"a\": [\n    1,\n    {\n      \"b\": \"q\\\"x\"\n    }\n  ],\n  \"c\": {},\n  \"d\": []\n}\n"), ler::writeJsonUtf8(v));
+		}
+
+		TEST_METHOD(WriteUtf8_Compact_HasNoWhitespace)
+		{
+			ler::JsonValue v = ler::parseJsonUtf8("{ \"a\": [1, 2], \"b\": { \"c\": null } }");
+
+			Assert::AreEqual(std::string("{\"a\":[1,2],\"b\":{\"c\":null}}"), ler::writeJsonUtf8(v, -1));
+		}
+
+		TEST_METHOD(WriteUtf8_NonAsciiAndControl_EncodedDirectly)
+		{
+			// long plain runs go through the block copy; the rest is escaped or encoded
+			ler::JsonValue v = ler::JsonValue::makeString(L"abcdefghijklmnop\u00e9\t\u0001\U0001F600\xD800z");
+
+			Assert::AreEqual(std::string("\"abcdefghijklmnop\xC3\xA9\\t\\u0001\xF0\x9F\x98\x80\\ud800z\"\n"), ler::writeJsonUtf8(v));
+		}
+
+		TEST_METHOD(Layout_ScalarNode_HoldsOnlyActiveAlternative)
+		{
+			// tag + the largest alternative (std::wstring); previously every node
+			// carried bool, int64, double, wstring and both containers at once
+			Assert::IsTrue(sizeof(ler::JsonValue) <= sizeof(ler::JsonValue::String) + sizeof(std::int64_t));
+
+			ler::JsonValue v = ler::JsonValue::makeInt(7);
+			Assert::IsTrue(v.type() == ler::JsonValue::Type::Int);
+			Assert::AreEqual(7.0, v.asDouble(L"ctx"));
+			auto func = [&v]() { v.asString(L"ctx"); };
+			Assert::ExpectException<ler::JsonParseError>(func);
+		}
+
+		TEST_METHOD(Parse_WithArena_AllocatesDomFromResource)
+		{
+			std::pmr::monotonic_buffer_resource arena;
+			ler::JsonValue v = ler::parseJsonUtf8("{\"name\": \"a fairly long string value\", \"list\": [1, 2, 3]}", &arena);
+
+			Assert::IsTrue(v.members().get_allocator().resource() == &arena);
+			Assert::IsTrue(v.tryGet(L"name")->asString(L"name").get_allocator().resource() == &arena);
+			Assert::IsTrue(v.tryGet(L"list")->items().get_allocator().resource() == &arena);
+		}
+
+		TEST_METHOD(Object_WideObject_LookupAndSetPreserveOrder)
+		{
+			ler::JsonValue obj = ler::JsonValue::makeObject(ler::JsonValue::Object{});
+			for (int i = 0; i < 100; i++) {
+				obj.set(L"host" + std::to_wstring(i), ler::JsonValue::makeInt(i));
+			}
+			Assert::AreEqual(42LL, obj.tryGet(L"host42")->asInt(L"ctx"));
+			Assert::IsNull(obj.tryGet(L"host100"));
+
+			// replacing keeps position; appending goes to the end
+			obj.set(L"host0", ler::JsonValue::makeInt(-1));
+			obj.set(L"extra", ler::JsonValue::makeBool(true));
+			Assert::AreEqual(101u, static_cast<unsigned>(obj.members().size()));
+			Assert::AreEqual(std::wstring(L"host0"), std::wstring(obj.members()[0].first));
+			Assert::AreEqual(-1LL, obj.members()[0].second.asInt(L"ctx"));
+			Assert::IsTrue(obj.tryGet(L"extra")->asBool(L"ctx"));
+		}
+
+		TEST_METHOD(Object_WideObject_ConstLookupsShareTheIndex)
+		{
+			// outlives w, which ends up holding its storage
+			std::pmr::monotonic_buffer_resource arena;
+			std::string text = "{";
+			for (int i = 0; i < 40; i++) text += (i ? ", \"k" : "\"k") + std::to_string(i) + "\": " + std::to_string(i);
+			text += "}";
+			const ler::JsonValue v = ler::parseJsonUtf8(text);
+
+			// const lookups never build the index, so threads may share the value
+			std::vector<std::thread> readers;
+			std::atomic<int> misses{ 0 };
+			for (int t = 0; t < 4; t++) {
+				readers.emplace_back([&] {
+					for (int i = 0; i < 40; i++) {
+						const ler::JsonValue* m = v.tryGet(L"k" + std::to_wstring(i));
+						if (!m || m->asInt(L"ctx") != i) misses++;
+					}
+				});
+			}
+			for (std::thread& r : readers) r.join();
+			Assert::AreEqual(0, misses.load());
+
+			// renamed through members(): const lookups scan until a non-const one reindexes
+			ler::JsonValue w = v;
+			w.members()[5].first = L"renamed";
+			const ler::JsonValue& cw = w;
+			Assert::IsNull(cw.tryGet(L"k5"));
+			Assert::AreEqual(5LL, cw.tryGet(L"renamed")->asInt(L"ctx"));
+			w.set(L"added", ler::JsonValue::makeInt(-1));
+			Assert::AreEqual(-1LL, cw.tryGet(L"added")->asInt(L"ctx"));
+			Assert::AreEqual(39LL, cw.tryGet(L"k39")->asInt(L"ctx"));
+
+			// moving an object over one from another resource takes its storage along
+			ler::JsonValue fromArena = ler::parseJsonUtf8(text, &arena);
+			w = std::move(fromArena);
+			Assert::IsTrue(w.members().get_allocator().resource() == &arena);
+			Assert::AreEqual(5LL, w.tryGet(L"k5")->asInt(L"ctx"));
+			Assert::IsNull(w.tryGet(L"added"));
+		}
+
+		TEST_METHOD(Object_WideObjectDuplicateKey_FirstWins)
+		{
+			std::string text = "{";
+			for (int i = 0; i < 20; i++) text += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + ", ";
+			text += "\"k3\": 99}";
+			ler::JsonValue v = ler::parseJsonUtf8(text);
+			Assert::AreEqual(3LL, v.tryGet(L"k3")->asInt(L"ctx"));
+		}
+
+		TEST_METHOD(Pointer_Find_KeysIndexesAndEscapes)
+		{
+			ler::JsonValue v = ler::parseJsonUtf8(
+				"{\"defaults\": {\"minIntervalSeconds\": 60}, \"commands\": [{\"exe\": \"a\"}, {\"exe\": \"b\"}],"
+				" \"a/b\": 1, \"m~n\": 2, \"0\": 3, \"\": 4}");
+			Assert::AreEqual(60LL, ler::JsonPointer(L"/defaults/minIntervalSeconds").find(v)->asInt(L"ctx"));
+			Assert::AreEqual(std::wstring(L"b"), std::wstring(ler::JsonPointer(L"/commands/1/exe").find(v)->asString(L"ctx")));
+			Assert::AreEqual(1LL, ler::JsonPointer(L"/a~1b").find(v)->asInt(L"ctx"));
+			Assert::AreEqual(2LL, ler::JsonPointer(L"/m~0n").find(v)->asInt(L"ctx"));
+			Assert::AreEqual(3LL, ler::JsonPointer(L"/0").find(v)->asInt(L"ctx"));
+			Assert::AreEqual(4LL, ler::JsonPointer(L"/").find(v)->asInt(L"ctx"));
+			Assert::IsTrue(ler::JsonPointer(L"").find(v) == &v);
+
+			Assert::IsNull(ler::JsonPointer(L"/commands/2").find(v));
+			Assert::IsNull(ler::JsonPointer(L"/commands/01").find(v));
+			Assert::IsNull(ler::JsonPointer(L"/commands/-").find(v));
+			Assert::IsNull(ler::JsonPointer(L"/defaults/minIntervalSeconds/x").find(v));
+
+			// one past SIZE_MAX (which ends in 5 on Win32 and x64) must not wrap around to 0
+			std::wstring pastMax = std::to_wstring(SIZE_MAX);
+			pastMax.back() = L'6';
+			Assert::IsNull(ler::JsonPointer(L"/commands/" + pastMax).find(v));
+			Assert::IsNull(ler::JsonPointer(L"/commands/" + pastMax + L"0").find(v));
+		}
+
+		TEST_METHOD(Pointer_InvalidSyntax_Throws)
+		{
+			auto noSlash = []() { ler::JsonPointer p(L"defaults"); };
+			Assert::ExpectException<ler::JsonParseError>(noSlash);
+
+			auto badEscape = []() { ler::JsonPointer p(L"/a~2"); };
+			Assert::ExpectException<ler::JsonParseError>(badEscape);
+		}
+
+		TEST_METHOD(PointerSet_FindAll_MatchesSinglePointers)
+		{
+			std::string text = "{\"defaults\": {\"minIntervalSeconds\": 60, \"timeoutSeconds\": 5}";
+			for (int i = 0; i < 20; i++) text += ", \"k" + std::to_string(i) + "\": " + std::to_string(i);
+			text += ", \"commands\": [{\"exe\": \"a\"}]}";
+			ler::JsonValue v = ler::parseJsonUtf8(text);
+
+			const ler::JsonPointer pointers[] = {
+				ler::JsonPointer(L"/defaults/minIntervalSeconds"),
+				ler::JsonPointer(L"/defaults/timeoutSeconds"),
+				ler::JsonPointer(L"/k17"),
+				ler::JsonPointer(L"/commands/0/exe"),
+				ler::JsonPointer(L"/defaults/missing"),
+				ler::JsonPointer(L"/k17"),
+			};
+			ler::JsonPointerSet set(pointers);
+			Assert::AreEqual(6u, static_cast<unsigned>(set.size()));
+
+			const ler::JsonValue* results[6] = {};
+			set.findAll(v, results);
+			for (size_t i = 0; i < 6; i++) {
+				Assert::IsTrue(results[i] == pointers[i].find(v));
+			}
+			Assert::AreEqual(17LL, results[5]->asInt(L"ctx"));
+			Assert::IsNull(results[4]);
+		}
+
+		TEST_METHOD(ParseOnDemand_UnlistedKeys_KeptRawAndWrittenVerbatim)
+		{
+			static const std::wstring_view keys[] = { L"name" };
+			ler::JsonParseOptions options;
+			options.eagerKeys = keys;
+
+			std::string text = "{\"name\": \"c1\", \"meta\": {\"a\":[1,  2,{\"b\":\"\\u00e9\"}]}}";
+			ler::JsonValue v = ler::parseJsonUtf8(text, std::pmr::get_default_resource(), options);
+
+			Assert::AreEqual(std::wstring(L"c1"), std::wstring(v.tryGet(L"name")->asString(L"name")));
+			ler::JsonValue* meta = v.tryGet(L"meta");
+			Assert::IsTrue(meta->isRaw());
+			Assert::AreEqual(std::string("{\"a\":[1,  2,{\"b\":\"\\u00e9\"}]}"), std::string(meta->rawText()));
+			Assert::IsTrue(ler::writeJson(v).find(L"\"meta\": {\"a\":[1,  2,{\"b\":\"\\u00e9\"}]}") != std::wstring::npos);
+
+			meta->materialize();
+			Assert::IsTrue(meta->isObject());
+			Assert::AreEqual(2LL, meta->tryGet(L"a")->items()[1].asInt(L"ctx"));
+		}
+
+		TEST_METHOD(RawArrayElements_ReturnsElementSpans)
+		{
+			static const std::wstring_view keys[] = { L"name" };
+			ler::JsonParseOptions options;
+			options.eagerKeys = keys;
+
+			std::string text = "{\"list\": [ {\"a\": \"],\\\"\"} ,\n  [1, [2]], \"s\" ]}";
+			ler::JsonValue v = ler::parseJsonUtf8(text, std::pmr::get_default_resource(), options);
+
+			std::vector<std::string_view> elements = v.tryGet(L"list")->rawArrayElements();
+			Assert::AreEqual(3u, static_cast<unsigned>(elements.size()));
+			Assert::AreEqual(std::string("{\"a\": \"],\\\"\"}"), std::string(elements[0]));
+			Assert::AreEqual(std::string("[1, [2]]"), std::string(elements[1]));
+			Assert::AreEqual(std::string("\"s\""), std::string(elements[2]));
+		}
+
+		TEST_METHOD(ParseOnDemand_InvalidSkippedValue_Throws)
+		{
+			static const std::wstring_view keys[] = { L"name" };
+			ler::JsonParseOptions options;
+			options.eagerKeys = keys;
+
+			auto func = [&options]() {
+				ler::parseJsonUtf8("{\"name\": \"c1\", \"meta\": [1, 2,]}", std::pmr::get_default_resource(), options);
+			};
+			Assert::ExpectException<ler::JsonParseError>(func);
+		}
+
+		TEST_METHOD(ParseEvents_EchoedThroughStreamWriter_MatchesWriteJson)
+		{
+			std::string text = "{\"a\": [1, 2.5, {\"b\": null, \"c\": []}, true], \"d\": {}, \"e\": \"x\\ty\"}";
+
+			std::string out;
+			int chunks = 0;
+			// tiny flush size so the output is handed over in several pieces
+			ler::JsonStreamWriter w([&](std::string_view bytes) { out += bytes; chunks++; }, 2, 8);
+			EchoHandler echo(w);
+			ler::parseJsonUtf8Events(text, echo);
+			w.finish();
+
+			std::wstring expected = ler::writeJson(ler::parseJsonUtf8(text));
+			Assert::AreEqual(std::string(expected.begin(), expected.end()), out);
+			Assert::IsTrue(chunks > 1);
+		}
+
+		TEST_METHOD(StreamWriter_NonAscii_WritesUtf8)
+		{
+			std::string out;
+			ler::JsonStreamWriter w([&](std::string_view bytes) { out += bytes; });
+			w.beginArray();
+			w.stringValue(L"\u00e9\U0001F600");
+			w.endArray();
+			w.finish();
+
+			Assert::AreEqual(std::string("[\n  \"\xC3\xA9\xF0\x9F\x98\x80\"\n]\n"), out);
+		}
+
+		TEST_METHOD(ParseEvents_TrailingCharacters_Throws)
+		{
+			auto func = []() {
+				std::string out;
+				ler::JsonStreamWriter w([&](std::string_view bytes) { out += bytes; });
+				EchoHandler echo(w);
+				ler::parseJsonUtf8Events("{\"a\": 1} x", echo);
+			};
+			Assert::ExpectException<ler::JsonParseError>(func);
+		}
+
 		TEST_METHOD(Parse_TrailingComma_Throws)
 		{
 			auto func = []() { ler::parseJson(L"[1,2,]"); };
@@ -112,5 +451,184 @@ namespace lastexecuterecordmstest
 			auto func = []() { ler::parseJson(L"{invalid}"); };
 			Assert::ExpectException<std::runtime_error>(func);
 		}
+
+		TEST_METHOD(ParseUtf8_MultiByteString_DecodesToUtf16)
+		{
+			// "\u00e9" (2 bytes), "\u4e16" (3 bytes), U+1F600 (4 bytes -> surrogate pair)
+			ler::JsonValue v = ler::parseJsonUtf8("{\"s\": \"\xC3\xA9\xE4\xB8\x96\xF0\x9F\x98\x80\"}");
+			const ler::JsonValue* s = v.tryGet(L"s");
+			Assert::IsNotNull(s);
+			Assert::AreEqual(std::wstring(L"\u00e9\u4e16\xD83D\xDE00"), std::wstring(s->asString(L"s")));
+		}
+
+		TEST_METHOD(ParseUtf8_MatchesWideParser)
+		{
+			ler::JsonValue v = ler::parseJsonUtf8("{\"a\": [1, 2.5, true, null, \"x\\n\"]}");
+			Assert::AreEqual(ler::writeJson(ler::parseJson(L"{\"a\": [1, 2.5, true, null, \"x\\n\"]}")), ler::writeJson(v));
+		}
+
+		TEST_METHOD(ParseUtf8_InvalidSequence_Throws)
+		{
+			auto truncated = []() { ler::parseJsonUtf8("\"\xC3\""); };
+			Assert::ExpectException<ler::JsonParseError>(truncated);
+
+			auto overlong = []() { ler::parseJsonUtf8("\"\xC0\xAF\""); };
+			Assert::ExpectException<ler::JsonParseError>(overlong);
+		}
+
+		TEST_METHOD(ParseUtf8_LongRunsAcrossBlocks_Handled)
+		{
+			// whitespace and string runs longer than one 16-byte scan block, with an
+			// escape and a multi-byte character in the middle of the string
+			ler::JsonValue v = ler::parseJsonUtf8(
+				"  \n\t                                [\r\n"
+				"    \"abcdefghijklmnopqrstuvwxyz\\t0123456789\xC3\xA9" "ABCDEFGHIJKLMNOPQRSTUVWXYZ\"\n"
+				"                                   ]   ");
+			Assert::IsTrue(v.isArray());
+			Assert::AreEqual(std::wstring(L"abcdefghijklmnopqrstuvwxyz\t0123456789\u00e9ABCDEFGHIJKLMNOPQRSTUVWXYZ"),
+				std::wstring(v.items()[0].asString(L"ctx")));
+		}
+
+		TEST_METHOD(ParseUtf8_UnterminatedString_Throws)
+		{
+			auto func = []() { ler::parseJsonUtf8("[\"abcdefghijklmnopqrstuvwxyz"); };
+			Assert::ExpectException<ler::JsonParseError>(func);
+		}
+
+		TEST_METHOD(Reader_Keys_ViewSourceUnlessEscaped)
+		{
+			std::string text = "{\"name\": \"a\", \"n\\u0061me\": \"\\u00e9x\\\\y\"}";
+			ler::JsonReader r(text);
+			r.beginObject();
+			std::string_view key;
+			Assert::IsTrue(r.nextMember(key));
+			Assert::AreEqual(std::string("name"), std::string(key));
+			Assert::IsTrue(key.data() >= text.data() && key.data() < text.data() + text.size());
+			std::wstring value;
+			r.readString(value, L"name");
+			Assert::AreEqual(std::wstring(L"a"), value);
+			Assert::IsTrue(r.nextMember(key));
+			Assert::AreEqual(std::string("name"), std::string(key));
+			r.readString(value, L"name");
+			Assert::AreEqual(std::wstring(L"\u00e9x\\y"), value);
+			Assert::IsFalse(r.nextMember(key));
+			r.finish();
+		}
+
+		TEST_METHOD(TryParse_Invalid_ReportsOffsetLineAndPath)
+		{
+			std::string text = "{\n  \"a\": [1, 2, tru],\n  \"b\": 3\n}";
+			ler::JsonParseResult r = ler::tryParseJsonUtf8(text);
+			Assert::IsFalse(r.ok());
+			Assert::IsTrue(r.error.code == ler::JsonErrorCode::Syntax);
+			Assert::AreEqual(static_cast<unsigned>(text.find("tru")), static_cast<unsigned>(r.error.offset));
+			Assert::AreEqual(2u, static_cast<unsigned>(r.error.line));
+			Assert::AreEqual(15u, static_cast<unsigned>(r.error.column));
+			Assert::AreEqual(std::wstring(L"/a/2"), r.error.path);
+			Assert::IsTrue(r.value.isNull());
+		}
+
+		TEST_METHOD(TryParse_Valid_ReturnsValue)
+		{
+			ler::JsonParseResult r = ler::tryParseJsonUtf8("{\"a/b\": {\"~\": [true]}}");
+			Assert::IsTrue(r.ok());
+			Assert::IsTrue(r.value.isObject());
+			Assert::AreEqual(std::wstring(L"/a~1b/~0/0"), ler::jsonPointerAt("{\"a/b\": {\"~\": [true]}}", 16));
+		}
+
+		TEST_METHOD(Parse_NestingAtMaxDepth_Parses)
+		{
+			std::string text = std::string(ler::kJsonMaxDepth, '[') + std::string(ler::kJsonMaxDepth, ']');
+			ler::JsonValue v = ler::parseJsonUtf8(text);
+			Assert::IsTrue(v.isArray());
+			Assert::AreEqual(static_cast<unsigned>(text.size()), static_cast<unsigned>(ler::JsonReader(text).skipValue().size()));
+
+			ler::JsonParseOptions options;
+			options.maxDepth = 3;
+			ler::parseJsonUtf8("{\"a\": [{}]}", std::pmr::get_default_resource(), options);
+			try {
+				ler::parseJsonUtf8("{\"a\": [{\"b\": []}]}", std::pmr::get_default_resource(), options);
+				Assert::Fail(L"expected JsonParseError");
+			}
+			catch (const ler::JsonParseError& e) {
+				Assert::AreEqual(std::string("Nesting too deep"), std::string(e.what()));
+				Assert::AreEqual(13u, static_cast<unsigned>(e.offset));
+			}
+		}
+
+		TEST_METHOD(Parse_NestingBeyondMaxDepth_ThrowsWithoutRecursing)
+		{
+			// a million levels would overflow the native stack of a recursive parser
+			std::string text = std::string(1000000, '[') + std::string(1000000, ']');
+			auto dom = [&text]() { ler::parseJsonUtf8(text); };
+			Assert::ExpectException<ler::JsonParseError>(dom);
+			auto skip = [&text]() { ler::JsonReader(text).skipValue(); };
+			Assert::ExpectException<ler::JsonParseError>(skip);
+			auto events = [&text]() {
+				std::string out;
+				ler::JsonStreamWriter w([&](std::string_view bytes) { out += bytes; });
+				EchoHandler h(w);
+				ler::parseJsonUtf8Events(text, h);
+			};
+			Assert::ExpectException<ler::JsonParseError>(events);
+
+			ler::JsonParseResult r = ler::tryParseJsonUtf8(text);
+			Assert::AreEqual(static_cast<unsigned>(ler::kJsonMaxDepth), static_cast<unsigned>(r.error.offset));
+		}
+
+		TEST_METHOD(Parse_WorstCaseCorpus_ParsesEveryShape)
+		{
+			for (int shape = 0; shape < 3; shape++) {
+				std::string text = worstCaseCorpus(shape, 1 << 20);
+				ler::JsonValue v = ler::parseJsonUtf8(text);
+				Assert::IsTrue(v.isArray() && !v.items().empty(), (L"shape " + std::to_wstring(shape)).c_str());
+				Assert::AreEqual(static_cast<unsigned>(text.size()), static_cast<unsigned>(ler::JsonReader(text).skipValue().size()));
+			}
+		}
+
+		TEST_METHOD(Parse_DeepNestingWithRaisedLimit_DoesNotRecurse)
+		{
+			// 100k levels would overflow the native stack of a recursive parser. The
+			// deep value is kept Raw: it is validated all the same, but destroying a
+			// DOM that deep would recurse.
+			const size_t depth = 100000;
+			std::string deep = std::string(depth, '[') + std::string(depth, ']');
+			std::string text = "{\"deep\": " + deep + ", \"keep\": [1]}";
+			const std::wstring_view eager[] = { L"keep" };
+			ler::JsonParseOptions options;
+			options.eagerKeys = eager;
+			options.maxDepth = depth + 1;
+			ler::JsonValue v = ler::parseJsonUtf8(text, std::pmr::get_default_resource(), options);
+			Assert::IsTrue(v.tryGet(L"deep")->isRaw());
+			Assert::AreEqual(deep, std::string(v.tryGet(L"deep")->rawText()));
+			Assert::AreEqual(1LL, v.tryGet(L"keep")->items()[0].asInt(L"ctx"));
+
+			// one level less fails at the innermost bracket
+			options.maxDepth = depth;
+			try {
+				ler::parseJsonUtf8(text, std::pmr::get_default_resource(), options);
+				Assert::Fail(L"expected JsonParseError");
+			}
+			catch (const ler::JsonParseError& e) {
+				Assert::AreEqual(std::string("Nesting too deep"), std::string(e.what()));
+				Assert::AreEqual(static_cast<unsigned>(9 + depth - 1), static_cast<unsigned>(e.offset));
+			}
+		}
+
+		TEST_METHOD(ContentHash_EqualForEqualBytesOnly)
+		{
+			std::string text = "{ \"name\": \"a\", \"exe\": \"C:\\\\tools\\\\a.exe\", \"args\": [\"-x\"] }";
+			Assert::IsTrue(ler::contentHash(text) == ler::contentHash(std::string(text)));
+			// every prefix length exercises the 8-, 4- and 1-byte steps
+			std::vector<std::uint64_t> seen;
+			for (size_t n = 0; n <= text.size(); n++) seen.push_back(ler::contentHash(std::string_view(text).substr(0, n)));
+			for (size_t i = 0; i < text.size(); i++) {
+				std::string flipped = text;
+				flipped[i] ^= 1;
+				seen.push_back(ler::contentHash(flipped));
+			}
+			std::sort(seen.begin(), seen.end());
+			Assert::IsTrue(std::adjacent_find(seen.begin(), seen.end()) == seen.end());
+		}
 	};
 }
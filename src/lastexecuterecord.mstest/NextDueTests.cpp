@@ -0,0 +1,139 @@
+﻿#include "CppUnitTest.h"
+#include "Config.h"
+#include "FileUtil.h"
+#include "NextDue.h"
+#include <Windows.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace lastexecuterecordmstest
+{
+	// Helper to create temp file path
+	static std::wstring makeTempPath(const wchar_t* leaf) {
+		wchar_t tmpDir[MAX_PATH] = {};
+		DWORD n = GetTempPathW(MAX_PATH, tmpDir);
+		if (n == 0) {
+			throw std::runtime_error("GetTempPathW failed");
+		}
+
+		wchar_t nameBuf[MAX_PATH] = {};
+		wsprintfW(nameBuf, L"ler_%lu_%ls", GetCurrentProcessId(), leaf);
+
+		return std::wstring(tmpDir) + nameBuf;
+	}
+
+	// A config file and its sidecar, both deleted at the end
+	class TempConfig {
+	public:
+		std::wstring path;
+		explicit TempConfig(const wchar_t* leaf) : path(makeTempPath(leaf)) {}
+		~TempConfig() {
+			DeleteFileW(path.c_str());
+			DeleteFileW(ler::nextDuePath(path).c_str());
+		}
+	};
+
+	// Moves the last write time of path an hour back, so a stamp taken now is settled
+	static void backdate(const std::wstring& path) {
+		std::uint64_t t = ler::currentFileTime() - 3600ull * 10'000'000;
+		FILETIME ft{};
+		ft.dwLowDateTime = static_cast<DWORD>(t);
+		ft.dwHighDateTime = static_cast<DWORD>(t >> 32);
+		HANDLE h = CreateFileW(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+		Assert::IsTrue(h != INVALID_HANDLE_VALUE);
+		Assert::IsTrue(SetFileTime(h, nullptr, nullptr, &ft) != 0);
+		CloseHandle(h);
+	}
+
+	// 2025-01-01T00:00:00Z
+	static constexpr std::int64_t kJan1 = 1735689600;
+
+	// a ran at kJan1 and waits an hour, b ran 10 minutes later and waits a day
+	static const wchar_t* kDueConfig =
+		L"{\n"
+		L"  \"commands\": [\n"
+		L"    { \"name\": \"a\", \"exe\": \"a.exe\", \"minIntervalSeconds\": 3600, \"lastRunUtc\": \"2025-01-01T00:00:00Z\" },\n"
+		L"    { \"name\": \"b\", \"exe\": \"b.exe\", \"minIntervalSeconds\": 86400, \"lastRunUtc\": \"2025-01-01T00:10:00Z\" },\n"
+		L"    { \"name\": \"c\", \"exe\": \"c.exe\", \"enabled\": false }\n"
+		L"  ]\n"
+		L"}\n";
+
+	static void writeSettled(const std::wstring& path, const wchar_t* text) {
+		ler::writeWStringToUtf8FileAtomic(path, text);
+		backdate(path);
+	}
+
+	TEST_CLASS(NextDueTests)
+	{
+	public:
+		TEST_METHOD(NextDue_Window_IsEarliestDueOfEnabledCommands)
+		{
+			TempConfig tmp(L"nextdue_window.json");
+			writeSettled(tmp.path, kDueConfig);
+			ler::ConfigStamp stamp = ler::stampConfig(tmp.path);
+			Assert::IsTrue(ler::writeNextDue(tmp.path, stamp, ler::loadAndValidateConfig(tmp.path)));
+
+			Assert::IsTrue(ler::nothingDue(tmp.path, kJan1 + 600));
+			Assert::IsTrue(ler::nothingDue(tmp.path, kJan1 + 3599));
+			// a is due again
+			Assert::IsFalse(ler::nothingDue(tmp.path, kJan1 + 3600));
+			// the clock went back past b's run
+			Assert::IsFalse(ler::nothingDue(tmp.path, kJan1 + 599));
+		}
+
+		TEST_METHOD(NextDue_EditedConfig_IsNotTrusted)
+		{
+			TempConfig tmp(L"nextdue_edited.json");
+			writeSettled(tmp.path, kDueConfig);
+			ler::ConfigStamp stamp = ler::stampConfig(tmp.path);
+			Assert::IsTrue(ler::writeNextDue(tmp.path, stamp, ler::loadAndValidateConfig(tmp.path)));
+
+			std::wstring edited = kDueConfig;
+			edited.replace(edited.find(L"86400"), 5, L"86401");
+			writeSettled(tmp.path, edited.c_str());
+			Assert::IsFalse(ler::nothingDue(tmp.path, kJan1 + 600));
+		}
+
+		TEST_METHOD(NextDue_CommandAlwaysDue_RemovesSidecar)
+		{
+			TempConfig tmp(L"nextdue_always.json");
+			writeSettled(tmp.path, kDueConfig);
+			Assert::IsTrue(ler::writeNextDue(tmp.path, ler::stampConfig(tmp.path), ler::loadAndValidateConfig(tmp.path)));
+
+			// no minIntervalSeconds: due on every run
+			writeSettled(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"a\", \"exe\": \"a.exe\", \"lastRunUtc\": \"2025-01-01T00:00:00Z\" } ] }\n");
+			Assert::IsFalse(ler::writeNextDue(tmp.path, ler::stampConfig(tmp.path), ler::loadAndValidateConfig(tmp.path)));
+			Assert::IsFalse(ler::fileExists(ler::nextDuePath(tmp.path)));
+
+			// never run: due on every run
+			writeSettled(tmp.path,
+				L"{ \"commands\": [ { \"name\": \"a\", \"exe\": \"a.exe\", \"minIntervalSeconds\": 60 } ] }\n");
+			Assert::IsFalse(ler::writeNextDue(tmp.path, ler::stampConfig(tmp.path), ler::loadAndValidateConfig(tmp.path)));
+			Assert::IsFalse(ler::nothingDue(tmp.path, kJan1));
+		}
+
+		TEST_METHOD(NextDue_RacyStamp_IsNotRecorded)
+		{
+			TempConfig tmp(L"nextdue_racy.json");
+			// just written: an edit within the same timestamp tick would go unnoticed
+			ler::writeWStringToUtf8FileAtomic(tmp.path, kDueConfig);
+			ler::ConfigStamp stamp = ler::stampConfig(tmp.path);
+			Assert::IsFalse(ler::writeNextDue(tmp.path, stamp, ler::loadAndValidateConfig(tmp.path)));
+			Assert::IsFalse(ler::nothingDue(tmp.path, kJan1 + 600));
+		}
+
+		TEST_METHOD(NextDue_DamagedSidecar_IsNotTrusted)
+		{
+			TempConfig tmp(L"nextdue_damaged.json");
+			writeSettled(tmp.path, kDueConfig);
+			Assert::IsTrue(ler::writeNextDue(tmp.path, ler::stampConfig(tmp.path), ler::loadAndValidateConfig(tmp.path)));
+
+			std::string bytes = ler::readUtf8File(ler::nextDuePath(tmp.path));
+			bytes[bytes.size() / 2] ^= 1;
+			ler::writeUtf8FileAtomic(ler::nextDuePath(tmp.path), bytes);
+			Assert::IsFalse(ler::nothingDue(tmp.path, kJan1 + 600));
+		}
+	};
+}
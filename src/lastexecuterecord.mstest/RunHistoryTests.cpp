@@ -0,0 +1,142 @@
+﻿#include "CppUnitTest.h"
+#include "FileUtil.h"
+#include "RunHistory.h"
+#include <Windows.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace lastexecuterecordmstest
+{
+	// Helper to create temp file path
+	static std::wstring makeTempPath(const wchar_t* leaf) {
+		wchar_t tmpDir[MAX_PATH] = {};
+		DWORD n = GetTempPathW(MAX_PATH, tmpDir);
+		if (n == 0) {
+			throw std::runtime_error("GetTempPathW failed");
+		}
+
+		wchar_t nameBuf[MAX_PATH] = {};
+		wsprintfW(nameBuf, L"ler_%lu_%ls", GetCurrentProcessId(), leaf);
+
+		return std::wstring(tmpDir) + nameBuf;
+	}
+
+	// The history files of a config path, deleted at the end (the config itself is not needed)
+	class TempHistory {
+	public:
+		std::wstring path;
+		explicit TempHistory(const wchar_t* leaf) : path(makeTempPath(leaf)) {}
+		~TempHistory() {
+			DeleteFileW(ler::runHistoryPath(path).c_str());
+			DeleteFileW(ler::runHistoryJournalPath(path).c_str());
+		}
+	};
+
+	// 2025-01-01T00:00:00Z
+	static constexpr std::int64_t kJan1 = 1735689600;
+
+	static ler::RunRecord run(std::int64_t start, std::uint64_t ms, std::uint32_t exitCode = 0, bool timedOut = false) {
+		return ler::RunRecord{ start, ms, exitCode, timedOut };
+	}
+
+	static void assertRuns(const std::vector<ler::RunRecord>& expected, const std::vector<ler::RunRecord>& actual) {
+		Assert::AreEqual(expected.size(), actual.size());
+		for (size_t i = 0; i < expected.size(); i++) {
+			Assert::IsTrue(expected[i] == actual[i]);
+		}
+	}
+
+	TEST_CLASS(RunHistoryTests)
+	{
+	public:
+		TEST_METHOD(RunHistory_Appended_ReadBackPerCommandInOrder)
+		{
+			TempHistory tmp(L"history_append.json");
+			ler::RunHistory history(tmp.path);
+			history.append(L"a", run(kJan1, 1500));
+			history.append(L"b", run(kJan1 + 10, 20, 3));
+			history.append(L"a", run(kJan1 + 3600, 1400, 0, true));
+
+			assertRuns({ run(kJan1, 1500), run(kJan1 + 3600, 1400, 0, true) },
+				ler::readRunHistory(tmp.path, L"a", INT64_MIN));
+			assertRuns({ run(kJan1 + 10, 20, 3) }, ler::readRunHistory(tmp.path, L"b", INT64_MIN));
+			Assert::IsTrue(ler::readRunHistory(tmp.path, L"c", INT64_MIN).empty());
+		}
+
+		TEST_METHOD(RunHistory_Compact_ContinuesColumnsOfEarlierRuns)
+		{
+			TempHistory tmp(L"history_compact.json");
+			std::vector<ler::RunRecord> expected;
+			ler::RunHistory history(tmp.path);
+			// 11 runs: the second compaction starts inside a byte of the timeout bitmap
+			for (int i = 0; i < 11; i++) {
+				expected.push_back(run(kJan1 + i * 86400, 30000 + i, i % 3 ? 0 : 1, i % 4 == 1));
+				history.append(L"a", expected.back());
+			}
+			history.compact();
+			Assert::AreEqual(size_t{ 0 }, history.journalRecords);
+
+			// the clock set back, an NTSTATUS exit code, a timeout
+			expected.push_back(run(kJan1 - 600, 0, 0xC0000005u));
+			expected.push_back(run(kJan1 + 20 * 86400, 600000, 1, true));
+			for (size_t i = expected.size() - 2; i < expected.size(); i++) history.append(L"a", expected[i]);
+			history.append(L"b", run(kJan1, 1));
+			history.compact();
+
+			expected.push_back(run(kJan1 + 21 * 86400, 29000));
+			history.append(L"a", expected.back());
+
+			assertRuns(expected, ler::readRunHistory(tmp.path, L"a", INT64_MIN));
+			assertRuns({ run(kJan1, 1) }, ler::readRunHistory(tmp.path, L"b", INT64_MIN));
+		}
+
+		TEST_METHOD(RunHistory_Since_ReturnsRunsStartedFromThen)
+		{
+			TempHistory tmp(L"history_since.json");
+			ler::RunHistory history(tmp.path);
+			for (int i = 0; i < 5; i++) history.append(L"a", run(kJan1 + i * 60, 1000));
+			history.compact();
+			history.append(L"a", run(kJan1 + 300, 1000));
+
+			assertRuns({ run(kJan1 + 180, 1000), run(kJan1 + 240, 1000), run(kJan1 + 300, 1000) },
+				ler::readRunHistory(tmp.path, L"a", kJan1 + 180));
+			Assert::IsTrue(ler::readRunHistory(tmp.path, L"a", kJan1 + 301).empty());
+		}
+
+		TEST_METHOD(RunHistory_TornJournalTail_IsDroppedOnOpen)
+		{
+			TempHistory tmp(L"history_torn.json");
+			{
+				ler::RunHistory history(tmp.path);
+				history.append(L"a", run(kJan1, 10));
+				history.append(L"a", run(kJan1 + 60, 20));
+			}
+			// a crash in the middle of the next append
+			ler::appendToFile(ler::runHistoryJournalPath(tmp.path), std::string(7, '\x5a'));
+
+			ler::RunHistory history(tmp.path);
+			history.append(L"a", run(kJan1 + 120, 30));
+			assertRuns({ run(kJan1, 10), run(kJan1 + 60, 20), run(kJan1 + 120, 30) },
+				ler::readRunHistory(tmp.path, L"a", INT64_MIN));
+		}
+
+		TEST_METHOD(RunHistory_YearOfDailyRuns_TakesFewBytesPerRun)
+		{
+			TempHistory tmp(L"history_size.json");
+			ler::RunHistory history(tmp.path);
+			const int commands = 50;
+			const int days = 365;
+			for (int d = 0; d < days; d++) {
+				for (int c = 0; c < commands; c++) {
+					std::int64_t start = kJan1 + d * 86400 + c * 5 + (d * 7 + c) % 13;
+					history.append(L"cmd" + std::to_wstring(c), run(start, 20000 + (d * 37 + c) % 5000, d % 50 == 0 ? 1 : 0));
+				}
+			}
+			Assert::IsTrue(history.compactIfDue());
+
+			std::uint64_t bytes = ler::getFileSizeBytes(ler::runHistoryPath(tmp.path));
+			Assert::IsTrue(bytes < std::uint64_t{ commands } * days * 8);
+			Assert::AreEqual(size_t{ days }, ler::readRunHistory(tmp.path, L"cmd7", INT64_MIN).size());
+		}
+	};
+}
@@ -0,0 +1,182 @@
+﻿#include "CppUnitTest.h"
+#include "FileUtil.h"
+#include "RunStats.h"
+#include "StateJournal.h"
+#include <Windows.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace lastexecuterecordmstest
+{
+	// Helper to create temp file path
+	static std::wstring makeTempPath(const wchar_t* leaf) {
+		wchar_t tmpDir[MAX_PATH] = {};
+		DWORD n = GetTempPathW(MAX_PATH, tmpDir);
+		if (n == 0) {
+			throw std::runtime_error("GetTempPathW failed");
+		}
+
+		wchar_t nameBuf[MAX_PATH] = {};
+		wsprintfW(nameBuf, L"ler_%lu_%ls", GetCurrentProcessId(), leaf);
+
+		return std::wstring(tmpDir) + nameBuf;
+	}
+
+	// True if actual is within the sketch's relative accuracy of expected
+	static bool nearlyEqual(double expected, std::uint64_t actual) {
+		return std::abs(static_cast<double>(actual) - expected) <= expected * ler::DurationSketch::kRelativeAccuracy + 0.5;
+	}
+
+	// The value at rank q * (n - 1) of sorted values
+	static double exactQuantile(const std::vector<std::uint64_t>& sorted, double q) {
+		return static_cast<double>(sorted[static_cast<size_t>(q * static_cast<double>(sorted.size() - 1))]);
+	}
+
+	// Commands with these names, as a config would list them
+	static std::vector<ler::CommandConfig> commandsNamed(std::initializer_list<const wchar_t*> names) {
+		std::vector<ler::CommandConfig> commands;
+		for (const wchar_t* name : names) {
+			ler::CommandConfig c;
+			c.name = name;
+			commands.push_back(c);
+		}
+		return commands;
+	}
+
+	TEST_CLASS(RunStatsTests)
+	{
+	public:
+		TEST_METHOD(DurationSketch_Quantiles_WithinRelativeAccuracy)
+		{
+			ler::DurationSketch sketch;
+			std::vector<std::uint64_t> values;
+			// a skewed distribution: mostly around 2 s, a tail up to 10 min
+			for (std::uint64_t i = 0; i < 20000; i++) {
+				std::uint64_t v = 1500 + (i * 7919) % 1000;
+				if (i % 50 == 0) v = 60000 + (i * 104729) % 540000;
+				values.push_back(v);
+				sketch.add(v);
+			}
+			std::sort(values.begin(), values.end());
+
+			for (double q : { 0.0, 0.5, 0.95, 0.99, 1.0 }) {
+				Assert::IsTrue(nearlyEqual(exactQuantile(values, q), sketch.quantile(q)));
+			}
+			Assert::AreEqual(values.front(), sketch.min());
+			Assert::AreEqual(values.back(), sketch.max());
+		}
+
+		TEST_METHOD(DurationSketch_WideRange_KeepsBinsBoundedAndHighQuantiles)
+		{
+			ler::DurationSketch sketch;
+			std::vector<std::uint64_t> values;
+			// 1 ms to about 11 days: more distinct bins than kMaxBins
+			for (std::uint64_t v = 1; v < 1'000'000'000; v = v * 21 / 20 + 1) {
+				for (int k = 0; k < 3; k++) {
+					values.push_back(v);
+					sketch.add(v);
+				}
+			}
+			std::sort(values.begin(), values.end());
+
+			Assert::IsTrue(sketch.binCount() <= ler::DurationSketch::kMaxBins);
+			Assert::AreEqual(static_cast<std::uint64_t>(values.size()), sketch.count());
+			for (double q : { 0.5, 0.95, 0.99 }) {
+				Assert::IsTrue(nearlyEqual(exactQuantile(values, q), sketch.quantile(q)));
+			}
+		}
+
+		TEST_METHOD(DurationSketch_Merge_EqualsAddingBoth)
+		{
+			ler::DurationSketch a, b, both;
+			for (std::uint64_t i = 0; i < 1000; i++) {
+				a.add(i * 3);
+				both.add(i * 3);
+				b.add(5000 + i * 11);
+				both.add(5000 + i * 11);
+			}
+			a.merge(b);
+
+			std::string merged, direct;
+			a.encode(merged);
+			both.encode(direct);
+			Assert::IsTrue(merged == direct);
+		}
+
+		TEST_METHOD(RunStats_Saved_ReadBackPerCommand)
+		{
+			std::wstring path = makeTempPath(L"stats_roundtrip.json");
+			{
+				ler::RunStats stats(path);
+				for (int i = 0; i < 10; i++) stats.record(L"a", ler::RunRecord{ 0, 1000u + i, i < 2 ? 1u : 0u, false });
+				stats.record(L"b", ler::RunRecord{ 0, 30000, 1, true });
+				stats.save(commandsNamed({ L"a", L"b" }));
+			}
+			{
+				// a later run adds to what is on file
+				ler::RunStats stats(path);
+				stats.record(L"a", ler::RunRecord{ 0, 5000, 0, false });
+				stats.save(commandsNamed({ L"a", L"b" }));
+			}
+
+			auto byKey = ler::readRunStats(path);
+			DeleteFileW(ler::runStatsPath(path).c_str());
+			Assert::AreEqual(size_t{ 2 }, byKey.size());
+			const ler::CommandStats& a = byKey[ler::stateKey(L"a")];
+			Assert::AreEqual(std::uint64_t{ 11 }, a.runs);
+			Assert::AreEqual(std::uint64_t{ 2 }, a.failures);
+			Assert::AreEqual(std::uint64_t{ 0 }, a.timeouts);
+			Assert::AreEqual(std::uint64_t{ 5000 }, a.durations.max());
+			Assert::IsTrue(nearlyEqual(1005, a.durations.quantile(0.5)));
+			const ler::CommandStats& b = byKey[ler::stateKey(L"b")];
+			Assert::AreEqual(std::uint64_t{ 1 }, b.failures);
+			Assert::AreEqual(std::uint64_t{ 1 }, b.timeouts);
+		}
+
+		TEST_METHOD(RunStats_Save_DropsRemovedCommands)
+		{
+			std::wstring path = makeTempPath(L"stats_removed.json");
+			{
+				ler::RunStats stats(path);
+				stats.record(L"a", ler::RunRecord{ 0, 1000, 0, false });
+				stats.record(L"b", ler::RunRecord{ 0, 2000, 0, false });
+				stats.save(commandsNamed({ L"a", L"b" }));
+			}
+			{
+				// b was removed from the config (or renamed to c) since
+				ler::RunStats stats(path);
+				stats.record(L"c", ler::RunRecord{ 0, 3000, 0, false });
+				stats.save(commandsNamed({ L"a", L"c" }));
+			}
+
+			auto byKey = ler::readRunStats(path);
+			DeleteFileW(ler::runStatsPath(path).c_str());
+			Assert::AreEqual(size_t{ 2 }, byKey.size());
+			Assert::AreEqual(std::uint64_t{ 1 }, byKey[ler::stateKey(L"a")].runs);
+			Assert::AreEqual(std::uint64_t{ 1 }, byKey[ler::stateKey(L"c")].runs);
+			Assert::IsTrue(byKey.find(ler::stateKey(L"b")) == byKey.end());
+		}
+
+		TEST_METHOD(RunStats_DamagedFile_IsStartedOver)
+		{
+			std::wstring path = makeTempPath(L"stats_damaged.json");
+			ler::RunStats stats(path);
+			stats.record(L"a", ler::RunRecord{ 0, 1000, 0, false });
+			stats.save(commandsNamed({ L"a" }));
+
+			std::string bytes = ler::readUtf8File(ler::runStatsPath(path));
+			bytes.back() ^= 1;
+			ler::writeUtf8FileAtomic(ler::runStatsPath(path), bytes);
+			Assert::IsTrue(ler::readRunStats(path).empty());
+
+			ler::RunStats next(path);
+			next.record(L"a", ler::RunRecord{ 0, 2000, 0, false });
+			next.save(commandsNamed({ L"a" }));
+			auto byKey = ler::readRunStats(path);
+			DeleteFileW(ler::runStatsPath(path).c_str());
+			Assert::AreEqual(std::uint64_t{ 1 }, byKey[ler::stateKey(L"a")].runs);
+		}
+	};
+}
@@ -0,0 +1,139 @@
+﻿#include "CppUnitTest.h"
+#include "Config.h"
+#include "FileUtil.h"
+#include "StateJournal.h"
+#include <Windows.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace lastexecuterecordmstest
+{
+	// Helper to create temp file path
+	static std::wstring makeTempPath(const wchar_t* leaf) {
+		wchar_t tmpDir[MAX_PATH] = {};
+		DWORD n = GetTempPathW(MAX_PATH, tmpDir);
+		if (n == 0) {
+			throw std::runtime_error("GetTempPathW failed");
+		}
+
+		wchar_t nameBuf[MAX_PATH] = {};
+		wsprintfW(nameBuf, L"ler_%lu_%ls", GetCurrentProcessId(), leaf);
+
+		return std::wstring(tmpDir) + nameBuf;
+	}
+
+	// A config file with its journal and state file, all deleted at the end
+	class TempJournalConfig {
+	public:
+		std::wstring path;
+		explicit TempJournalConfig(const wchar_t* leaf) : path(makeTempPath(leaf)) {
+			ler::writeWStringToUtf8FileAtomic(path,
+				L"{\n"
+				L"  \"stateStore\": \"journal\",\n"
+				L"  \"commands\": [\n"
+				L"    { \"name\": \"a\", \"exe\": \"a.exe\", \"lastRunUtc\": \"2025-01-01T00:00:00Z\", \"lastExitCode\": 3 },\n"
+				L"    { \"name\": \"b\", \"exe\": \"b.exe\" }\n"
+				L"  ]\n"
+				L"}\n");
+		}
+		~TempJournalConfig() {
+			DeleteFileW(path.c_str());
+			DeleteFileW(ler::stateJournalPath(path).c_str());
+			DeleteFileW(ler::stateFilePath(path).c_str());
+		}
+	};
+
+	static void recordRun(ler::CommandConfig& c, const wchar_t* when, std::int64_t exitCode) {
+		c.hasLastRunUtc = true;
+		c.lastRunUtc = when;
+		c.hasLastExitCode = true;
+		c.lastExitCode = exitCode;
+	}
+
+	TEST_CLASS(StateJournalTests)
+	{
+	public:
+		TEST_METHOD(Journal_AppendedState_OverridesConfigValues)
+		{
+			TempJournalConfig tmp(L"journal_apply.json");
+			std::wstring configText = ler::readUtf8FileToWString(tmp.path);
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			Assert::IsTrue(cfg.stateStore == ler::StateStore::Journal);
+
+			ler::StateJournal journal(tmp.path);
+			journal.apply(cfg);
+			Assert::AreEqual(std::wstring(L"2025-01-01T00:00:00Z"), cfg.commands[0].lastRunUtc);
+			Assert::IsFalse(cfg.commands[1].hasLastRunUtc);
+
+			recordRun(cfg.commands[1], L"2026-02-03T04:05:06Z", 7);
+			journal.append(cfg.commands[1]);
+			recordRun(cfg.commands[1], L"2026-02-04T00:00:00Z", 0);
+			journal.append(cfg.commands[1]);
+			Assert::AreEqual(2u, static_cast<unsigned>(journal.journalRecords));
+
+			ler::AppConfig next = ler::loadAndValidateConfig(tmp.path);
+			ler::StateJournal reopened(tmp.path);
+			reopened.apply(next);
+			Assert::AreEqual(2u, static_cast<unsigned>(reopened.journalRecords));
+			Assert::AreEqual(std::wstring(L"2025-01-01T00:00:00Z"), next.commands[0].lastRunUtc);
+			Assert::AreEqual(3LL, next.commands[0].lastExitCode);
+			Assert::IsTrue(next.commands[1].hasLastRunUtc);
+			Assert::AreEqual(std::wstring(L"2026-02-04T00:00:00Z"), next.commands[1].lastRunUtc);
+			Assert::AreEqual(0LL, next.commands[1].lastExitCode);
+
+			// the config itself is never written
+			Assert::AreEqual(configText, ler::readUtf8FileToWString(tmp.path));
+		}
+
+		TEST_METHOD(Journal_Compact_FoldsJournalIntoStateFile)
+		{
+			TempJournalConfig tmp(L"journal_compact.json");
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			ler::StateJournal journal(tmp.path);
+			journal.apply(cfg);
+
+			recordRun(cfg.commands[0], L"2026-01-01T00:00:00Z", 1);
+			for (int i = 0; i < 255; i++) journal.append(cfg.commands[0]);
+			Assert::IsFalse(journal.compactIfDue(cfg));
+			journal.append(cfg.commands[0]);
+			Assert::IsTrue(journal.compactIfDue(cfg));
+			Assert::AreEqual(0u, static_cast<unsigned>(journal.journalRecords));
+			Assert::AreEqual(8ull, static_cast<unsigned long long>(ler::getFileSizeBytes(ler::stateJournalPath(tmp.path))));
+
+			ler::AppConfig next = ler::loadAndValidateConfig(tmp.path);
+			ler::StateJournal reopened(tmp.path);
+			reopened.apply(next);
+			Assert::AreEqual(std::wstring(L"2026-01-01T00:00:00Z"), next.commands[0].lastRunUtc);
+			Assert::AreEqual(1LL, next.commands[0].lastExitCode);
+			Assert::IsFalse(next.commands[1].hasLastRunUtc);
+		}
+
+		TEST_METHOD(Journal_TornRecord_IsDroppedAndCompacted)
+		{
+			TempJournalConfig tmp(L"journal_torn.json");
+			ler::AppConfig cfg = ler::loadAndValidateConfig(tmp.path);
+			ler::StateJournal journal(tmp.path);
+			journal.apply(cfg);
+			recordRun(cfg.commands[1], L"2026-03-01T00:00:00Z", 5);
+			journal.append(cfg.commands[1]);
+
+			// a crash in the middle of the next append
+			ler::appendToFile(ler::stateJournalPath(tmp.path), std::string(13, '\x7f'));
+
+			ler::AppConfig next = ler::loadAndValidateConfig(tmp.path);
+			ler::StateJournal reopened(tmp.path);
+			reopened.apply(next);
+			Assert::AreEqual(std::wstring(L"2026-03-01T00:00:00Z"), next.commands[1].lastRunUtc);
+			Assert::AreEqual(5LL, next.commands[1].lastExitCode);
+			Assert::AreEqual(0u, static_cast<unsigned>(reopened.journalRecords));
+			Assert::AreEqual(8ull, static_cast<unsigned long long>(ler::getFileSizeBytes(ler::stateJournalPath(tmp.path))));
+
+			// appends after the repair line up again
+			recordRun(next.commands[1], L"2026-03-02T00:00:00Z", 6);
+			reopened.append(next.commands[1]);
+			ler::AppConfig last = ler::loadAndValidateConfig(tmp.path);
+			ler::StateJournal(tmp.path).apply(last);
+			Assert::AreEqual(6LL, last.commands[1].lastExitCode);
+		}
+	};
+}
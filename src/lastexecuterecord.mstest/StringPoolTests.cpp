@@ -0,0 +1,56 @@
+#include "CppUnitTest.h"
+#include "StringPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace lastexecuterecordmstest
+{
+	TEST_CLASS(StringPoolTests)
+	{
+	public:
+		TEST_METHOD(Intern_SameText_SharesOneBuffer)
+		{
+			ler::StringPool pool;
+			ler::SharedString a = pool.intern(L"C:\\Windows\\System32\\sudo.exe");
+			ler::SharedString b = pool.intern(std::wstring(L"C:\\Windows\\System32\\sudo.exe"));
+			ler::SharedString c = pool.intern(L"pwsh.exe");
+
+			Assert::IsTrue(&a.str() == &b.str());
+			Assert::IsFalse(&a.str() == &c.str());
+			Assert::IsTrue(a == b);
+			Assert::IsFalse(a == c);
+			Assert::AreEqual(2u, static_cast<unsigned>(pool.size()));
+		}
+
+		TEST_METHOD(SharedString_Unpooled_ComparesByText)
+		{
+			ler::StringPool pool;
+			ler::SharedString own = L"x.exe";
+			Assert::IsTrue(own == pool.intern(L"x.exe"));
+			Assert::AreEqual(std::wstring(L"x.exe"), own.str());
+
+			// empty strings own no buffer, pooled or not
+			ler::SharedString empty;
+			Assert::IsTrue(empty.empty());
+			Assert::IsTrue(empty == pool.intern(L""));
+			Assert::AreEqual(std::wstring(), empty.str());
+			Assert::AreEqual(1u, static_cast<unsigned>(pool.size()));
+		}
+
+		TEST_METHOD(PruneUnshared_KeepsSharedStringsAlive)
+		{
+			ler::StringPool pool;
+			ler::SharedString once = pool.intern(L"once");
+			ler::SharedString twice1 = pool.intern(L"twice");
+			ler::SharedString twice2 = pool.intern(L"twice");
+			pool.intern(L"dropped");
+
+			pool.pruneUnshared();
+			Assert::AreEqual(1u, static_cast<unsigned>(pool.size()));
+			// a pruned string stays valid for whoever holds it
+			Assert::AreEqual(std::wstring(L"once"), once.str());
+			Assert::IsTrue(&twice1.str() == &pool.intern(L"twice").str());
+			Assert::IsFalse(&once.str() == &pool.intern(L"once").str());
+		}
+	};
+}
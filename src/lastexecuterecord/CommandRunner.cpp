@@ -56,7 +56,7 @@ std::wstring quoteArgForWindowsCommandLine(const std::wstring& arg) {
     return out;
 }
 
-static std::wstring buildCommandLine(const std::wstring& exePath, const std::vector<std::wstring>& args) {
+static std::wstring buildCommandLine(const std::wstring& exePath, const std::vector<SharedString>& args) {
     std::wstring cmd;
     cmd += quoteArgForWindowsCommandLine(exePath);
     for (const auto& a : args) {
@@ -67,7 +67,7 @@ static std::wstring buildCommandLine(const std::wstring& exePath, const std::vec
 }
 
 RunResult runProcess(const std::wstring& exePath,
-    const std::vector<std::wstring>& args,
+    const std::vector<SharedString>& args,
     const std::wstring& workingDirectory,
     std::int64_t timeoutSeconds) {
 
@@ -82,6 +82,7 @@ RunResult runProcess(const std::wstring& exePath,
     si.cb = sizeof(si);
     PROCESS_INFORMATION pi{};
 
+    ULONGLONG startTicks = GetTickCount64();
     BOOL ok = CreateProcessW(
         exePath.c_str(),
         cmdBuf.data(),
@@ -118,6 +119,7 @@ RunResult runProcess(const std::wstring& exePath,
         TerminateProcess(pi.hProcess, 1);
         WaitForSingleObject(pi.hProcess, 5000);
     }
+    rr.elapsedMilliseconds = GetTickCount64() - startTicks;
 
     DWORD ec = 0;
     if (!GetExitCodeProcess(pi.hProcess, &ec)) ec = 1;
@@ -4,18 +4,22 @@
 #include <string>
 #include <vector>
 
+#include "StringPool.h"
+
 namespace ler {
 
 struct RunResult {
     bool started = false;
     bool timedOut = false;
     std::uint32_t exitCode = 0;
+    // from process creation until it exited or was terminated
+    std::uint64_t elapsedMilliseconds = 0;
 };
 
 std::wstring quoteArgForWindowsCommandLine(const std::wstring& arg);
 
 RunResult runProcess(const std::wstring& exePath,
-    const std::vector<std::wstring>& args,
+    const std::vector<SharedString>& args,
     const std::wstring& workingDirectory,
     std::int64_t timeoutSeconds);
 
@@ -1,50 +1,23 @@
 ﻿#include "Config.h"
 
+#include "ConfigSnapshot.h"
 #include "FileUtil.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cwctype>
+#include <iterator>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 namespace ler {
 
-static const JsonValue& requireObjectField(const JsonValue& obj, const std::wstring& key, const wchar_t* ctx) {
-    const JsonValue* v = obj.tryGet(key);
-    if (!v) throw JsonParseError(std::string("Missing field: ") + std::string(key.begin(), key.end()) + " at " + std::string(std::wstring(ctx).begin(), std::wstring(ctx).end()));
-    return *v;
-}
-
-static std::wstring getStringFieldOrEmpty(const JsonValue& obj, const std::wstring& key) {
-    const JsonValue* v = obj.tryGet(key);
-    if (!v) return L"";
-    if (v->isNull()) return L"";
-    return v->asString(key.c_str());
-}
-
-static bool getBoolFieldOrDefault(const JsonValue& obj, const std::wstring& key, bool def) {
-    const JsonValue* v = obj.tryGet(key);
-    if (!v) return def;
-    if (v->isNull()) return def;
-    return v->asBool(key.c_str());
-}
-
-static std::int64_t getIntFieldOrDefault(const JsonValue& obj, const std::wstring& key, std::int64_t def) {
-    const JsonValue* v = obj.tryGet(key);
-    if (!v) return def;
-    if (v->isNull()) return def;
-    return v->asInt(key.c_str());
-}
-
-static void upsertObjectField(JsonValue& obj, const std::wstring& key, JsonValue value) {
-    if (!obj.isObject()) throw std::runtime_error("not an object");
-    for (auto& kv : obj.o) {
-        if (kv.first == key) {
-            kv.second = std::move(value);
-            return;
-        }
-    }
-    obj.o.push_back(std::make_pair(key, std::move(value)));
-}
+// Keys decoded when root is rebuilt for a full rewrite (see applyCommandsToJson).
+static const std::wstring_view kRewriteKeys[] = { L"commands" };
 
 static std::wstring sampleConfigText() {
     // Minimal and safe: default command is disabled.
@@ -96,106 +69,1431 @@ std::wstring defaultConfigPath() {
     return changeExtension(getModulePath(), L".json");
 }
 
-AppConfig loadAndValidateConfig(const std::wstring& configPath) {
-    AppConfig cfg;
+namespace {
 
-    std::wstring text = readUtf8FileToWString(configPath);
-    cfg.root = parseJson(text);
+// A commands[] entry as read from the file, before defaults and checks.
+struct CommandDraft : CommandConfig {
+    // "id" is only an alias for a missing name, so it is decoded on demand
+    std::string_view idText;
+    CommandSpan span;
+    std::uint32_t present = 0;
+    std::uint64_t hash = 0;
+    // index of the command of the previous load swapped in, or npos
+    size_t reused = CommandSpan::npos;
+    // where exe, args and workingDirectory are interned
+    StringPool* strings = nullptr;
+};
 
-    if (!cfg.root.isObject()) throw JsonParseError("Config root must be object");
+// The root object as read from the file.
+struct ConfigDraft {
+    std::int64_t version = 1;
+    std::int64_t networkOption = 2;
+    std::int64_t defaultMinIntervalSeconds = 0;
+    std::int64_t defaultTimeoutSeconds = 0;
+    std::wstring stateStore;
+    std::vector<std::wstring> includes;
+    bool hasCommands = false;
+    std::vector<CommandDraft> commands;
+    // earlier load of the same file whose unchanged commands are reused
+    AppConfig* previous = nullptr;
+    // becomes AppConfig::strings (taken over from previous, if any)
+    StringPool strings;
+};
 
-    cfg.version = getIntFieldOrDefault(cfg.root, L"version", 1);
+// Where bindConfig loads the fragments a config includes from. The config's
+// own directory anchors relative include paths.
+struct IncludeContext {
+    const std::wstring* configPath = nullptr;
+    std::pmr::memory_resource* mr = nullptr;
+    std::vector<ConfigFragment> fragments;
+};
 
-    // networkOption: 0=connected only, 1=metered ok, 2=always (default: 2)
-    std::int64_t netOpt = getIntFieldOrDefault(cfg.root, L"networkOption", 2);
-    if (netOpt < 0 || netOpt > 2) {
-        throw JsonParseError("networkOption must be 0, 1, or 2");
+// A fragment failed to load. error locates the problem in that file, not in
+// the one being bound, so it travels outside JsonParseError.
+struct FragmentError : std::runtime_error {
+    FragmentError(std::wstring file, JsonError e)
+        : std::runtime_error(e.message), path(std::move(file)), error(std::move(e)) {}
+
+    std::wstring path;
+    JsonError error;
+};
+
+// Binds one JSON member to a field of T. read() consumes the value and returns
+// false if it was null, which counts as absent (the field keeps its default).
+// check(), if any, runs once defaults are applied; message is thrown when it fails.
+template <class T>
+struct FieldBinding {
+    const wchar_t* key;
+    bool (*read)(JsonReader& r, T& out, const wchar_t* key);
+    bool (*check)(const T& v) = nullptr;
+    const char* message = nullptr;
+};
+
+} // namespace
+
+static bool readField(JsonReader& r, std::wstring& out, const wchar_t* key) {
+    if (r.readNull()) return false;
+    r.readString(out, key);
+    return true;
+}
+
+static bool readField(JsonReader& r, bool& out, const wchar_t* key) {
+    if (r.readNull()) return false;
+    out = r.readBool(key);
+    return true;
+}
+
+static bool readField(JsonReader& r, std::int64_t& out, const wchar_t* key) {
+    if (r.readNull()) return false;
+    out = r.readInt(key);
+    return true;
+}
+
+template <auto Member, class T>
+static bool bindField(JsonReader& r, T& out, const wchar_t* key) {
+    return readField(r, out.*Member, key);
+}
+
+// Like bindField, for the strings commands tend to repeat: decoded into scratch
+// and interned, so a repeat costs a lookup instead of an allocation.
+template <auto Member>
+static bool bindShared(JsonReader& r, CommandDraft& out, const wchar_t* key) {
+    thread_local std::wstring scratch;
+    if (!readField(r, scratch, key)) return false;
+    out.*Member = out.strings->intern(scratch);
+    return true;
+}
+
+template <auto Member, class T>
+static bool notEmpty(const T& v) {
+    return !(v.*Member).empty();
+}
+
+template <auto Member, class T>
+static bool nonNegative(const T& v) {
+    return v.*Member >= 0;
+}
+
+// Field keys are ASCII, so a UTF-8 key matches when every byte equals the
+// corresponding character.
+static bool keyEquals(std::string_view utf8, const wchar_t* key) {
+    size_t i = 0;
+    for (; key[i]; i++) {
+        if (i == utf8.size() || static_cast<unsigned char>(utf8[i]) != static_cast<unsigned>(key[i])) return false;
     }
-    cfg.networkOption = static_cast<NetworkOption>(netOpt);
+    return i == utf8.size();
+}
 
-    // defaults
-    const JsonValue* defaults = cfg.root.tryGet(L"defaults");
-    if (defaults && defaults->isObject()) {
-        cfg.defaultMinIntervalSeconds = getIntFieldOrDefault(*defaults, L"minIntervalSeconds", 0);
-        cfg.defaultTimeoutSeconds = getIntFieldOrDefault(*defaults, L"timeoutSeconds", 0);
+// Reads the object at r into out in one pass. Members without a binding are
+// validated and skipped; of duplicate keys the first wins, as with
+// JsonValue::tryGet. Returns one bit per field that was present and not null.
+template <class T, size_t N>
+static std::uint32_t bindObject(JsonReader& r, T& out, const FieldBinding<T> (&fields)[N]) {
+    static_assert(N < 32, "field masks are 32 bits");
+    std::uint32_t seen = 0;
+    std::uint32_t present = 0;
+    r.beginObject();
+    std::string_view key;
+    while (r.nextMember(key)) {
+        size_t i = 0;
+        while (i < N && !keyEquals(key, fields[i].key)) i++;
+        std::uint32_t bit = 1u << i;
+        if (i == N || (seen & bit)) {
+            r.skipValue();
+            continue;
+        }
+        seen |= bit;
+        if (fields[i].read(r, out, fields[i].key)) present |= bit;
     }
+    return present;
+}
 
-    const JsonValue& cmdsV = requireObjectField(cfg.root, L"commands", L"root");
-    if (!cmdsV.isArray()) throw JsonParseError("commands must be array");
+// Offset of the value of the first member named key in the object at
+// text[objectBegin], or objectBegin if it has none. Only used to report errors.
+static size_t memberOffset(std::string_view text, size_t objectBegin, const wchar_t* key) {
+    JsonReader r(text, objectBegin);
+    r.beginObject();
+    std::string_view k;
+    while (r.nextMember(k)) {
+        if (keyEquals(k, key)) {
+            r.peekType();
+            return r.offset();
+        }
+        r.skipValue();
+    }
+    return objectBegin;
+}
 
-    cfg.commands.clear();
-    cfg.commands.reserve(cmdsV.a.size());
+// v was read from the object at text[objectBegin]; a failed check is reported
+// at the offending member, or at the object if the member is missing.
+template <class T, size_t N>
+static void checkFields(const T& v, const FieldBinding<T> (&fields)[N], std::string_view text, size_t objectBegin) {
+    for (const FieldBinding<T>& f : fields) {
+        if (f.check && !f.check(v)) {
+            throw JsonParseError(f.message, memberOffset(text, objectBegin, f.key), JsonErrorCode::Invalid);
+        }
+    }
+}
+
+template <class T, size_t N>
+static constexpr std::uint32_t fieldBit(const FieldBinding<T> (&fields)[N], std::wstring_view key) {
+    for (size_t i = 0; i < N; i++) {
+        if (key == fields[i].key) return 1u << i;
+    }
+    return 0;
+}
 
-    for (size_t idx = 0; idx < cmdsV.a.size(); idx++) {
-        const JsonValue& c = cmdsV.a[idx];
-        if (!c.isObject()) throw JsonParseError("command entry must be object");
+static bool readArgs(JsonReader& r, CommandDraft& d, const wchar_t*) {
+    if (r.peekType() != JsonValue::Type::Array) {
+        throw JsonParseError("command.args must be array", r.offset(), JsonErrorCode::Type);
+    }
+    // Read into a per-thread scratch vector and move the strings over, so args
+    // is allocated once at its final size instead of regrowing per element.
+    thread_local std::vector<SharedString> scratch;
+    thread_local std::wstring text;
+    scratch.clear();
+    r.beginArray();
+    while (r.nextElement()) {
+        r.readString(text, L"command.args[]");
+        scratch.push_back(d.strings->intern(text));
+    }
+    d.args.assign(std::make_move_iterator(scratch.begin()), std::make_move_iterator(scratch.end()));
+    return true;
+}
 
-        CommandConfig cc;
-        cc.name = getStringFieldOrEmpty(c, L"name");
-        if (cc.name.empty()) {
-            // allow id as alias
-            cc.name = getStringFieldOrEmpty(c, L"id");
+static bool readCommandId(JsonReader& r, CommandDraft& d, const wchar_t*) {
+    d.idText = r.skipValue();
+    return true;
+}
+
+// The state fields also record where their value sits, for saveConfig.
+static bool readLastRunUtc(JsonReader& r, CommandDraft& d, const wchar_t* key) {
+    r.peekType();
+    d.span.runBegin = r.offset();
+    bool set = readField(r, d.lastRunUtc, key);
+    d.span.runEnd = r.offset();
+    d.hasLastRunUtc = !d.lastRunUtc.empty();
+    return set;
+}
+
+static bool readLastExitCode(JsonReader& r, CommandDraft& d, const wchar_t* key) {
+    r.peekType();
+    d.span.exitBegin = r.offset();
+    d.hasLastExitCode = readField(r, d.lastExitCode, key);
+    d.span.exitEnd = r.offset();
+    return d.hasLastExitCode;
+}
+
+// Checks run in table order, so name is reported before exe.
+static constexpr FieldBinding<CommandDraft> kCommandFields[] = {
+    { L"name", bindField<&CommandConfig::name>, notEmpty<&CommandConfig::name>, "command.name (or id) is required" },
+    { L"id", readCommandId },
+    { L"enabled", bindField<&CommandConfig::enabled> },
+    { L"exe", bindShared<&CommandConfig::exe>, notEmpty<&CommandConfig::exe>, "command.exe is required" },
+    { L"args", readArgs },
+    { L"workingDirectory", bindShared<&CommandConfig::workingDirectory> },
+    { L"minIntervalSeconds", bindField<&CommandConfig::minIntervalSeconds>,
+        nonNegative<&CommandConfig::minIntervalSeconds>, "minIntervalSeconds must be >= 0" },
+    { L"timeoutSeconds", bindField<&CommandConfig::timeoutSeconds>,
+        nonNegative<&CommandConfig::timeoutSeconds>, "timeoutSeconds must be >= 0" },
+    { L"lastRunUtc", readLastRunUtc },
+    { L"lastExitCode", readLastExitCode },
+};
+
+// The checks only run for a config with include: without one, a default no
+// command takes is never used.
+static constexpr FieldBinding<ConfigDraft> kDefaultsFields[] = {
+    { L"minIntervalSeconds", bindField<&ConfigDraft::defaultMinIntervalSeconds>,
+        nonNegative<&ConfigDraft::defaultMinIntervalSeconds>, "defaults.minIntervalSeconds must be >= 0" },
+    { L"timeoutSeconds", bindField<&ConfigDraft::defaultTimeoutSeconds>,
+        nonNegative<&ConfigDraft::defaultTimeoutSeconds>, "defaults.timeoutSeconds must be >= 0" },
+};
+
+static bool readDefaults(JsonReader& r, ConfigDraft& d, const wchar_t*) {
+    // anything but an object is ignored
+    if (r.peekType() != JsonValue::Type::Object) {
+        r.skipValue();
+        return false;
+    }
+    bindObject(r, d, kDefaultsFields);
+    return true;
+}
+
+static void readCommandEntry(JsonReader& r, CommandDraft& c, StringPool& strings) {
+    if (r.peekType() != JsonValue::Type::Object) {
+        throw JsonParseError("command entry must be object", r.offset(), JsonErrorCode::Type);
+    }
+    c.strings = &strings;
+    c.span.objectBegin = r.offset();
+    c.present = bindObject(r, c, kCommandFields);
+    c.span.objectEnd = r.offset();
+}
+
+// Smaller files, and machines with a single hardware thread, read on the calling
+// thread alone: splitting the array and starting threads would cost more than
+// it saves.
+static constexpr size_t kParallelMinBytes = 1024 * 1024;
+static constexpr size_t kMinCommandsPerThread = 256;
+
+// Reads pre-split commands[] entries on several threads, each taking a
+// contiguous run, into out (in order). Returns false once any entry fails; the
+// caller then reads the array serially, so the error reported is exactly the
+// first one a serial read meets. Each thread interns into a pool of its own,
+// merged into strings at the end (so a string is held at most once per thread).
+static bool readCommandsParallel(std::string_view text, const std::vector<std::string_view>& entries,
+    std::vector<CommandDraft>& out, StringPool& strings) {
+    out.resize(entries.size());
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+        std::max<size_t>(1, entries.size() / kMinCommandsPerThread));
+    std::vector<StringPool> pools(threads);
+
+    std::atomic<bool> failed{ false };
+    auto work = [&](size_t t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !failed.load(std::memory_order_relaxed); i++) {
+            try {
+                size_t offset = static_cast<size_t>(entries[i].data() - text.data());
+                JsonReader r(text, offset);
+                readCommandEntry(r, out[i], pools[t]);
+                // the split found a single value here only if the read ends with it
+                if (r.offset() != offset + entries[i].size()) failed = true;
+            }
+            catch (...) {
+                failed = true;
+            }
         }
-        if (cc.name.empty()) {
-            throw JsonParseError("command.name (or id) is required");
+    };
+
+    size_t per = entries.size() / threads;
+    std::vector<std::jthread> pool;
+    pool.reserve(threads - 1);
+    try {
+        for (size_t t = 1; t < threads; t++) {
+            pool.emplace_back(work, t, t * per, t + 1 == threads ? entries.size() : (t + 1) * per);
         }
+    }
+    catch (const std::system_error&) {
+        // out of threads: fall back to the serial read
+        failed = true;
+    }
+    work(0, 0, per);
+    pool.clear();
+    for (StringPool& p : pools) strings.merge(p);
+    return !failed;
+}
 
-        cc.enabled = getBoolFieldOrDefault(c, L"enabled", true);
+static CommandSpan shiftSpan(CommandSpan span, std::ptrdiff_t delta) {
+    span.objectBegin += delta;
+    span.objectEnd += delta;
+    if (span.runBegin != CommandSpan::npos) {
+        span.runBegin += delta;
+        span.runEnd += delta;
+    }
+    if (span.exitBegin != CommandSpan::npos) {
+        span.exitBegin += delta;
+        span.exitEnd += delta;
+    }
+    return span;
+}
 
-        cc.exe = getStringFieldOrEmpty(c, L"exe");
-        if (cc.exe.empty()) {
-            throw JsonParseError("command.exe is required");
+// Reads pre-split commands[] entries. An entry whose text hashes to one of the
+// previous load (same length too) swaps that command in instead of binding and
+// checking it again: it was read from identical text. Returns false once an
+// entry fails; the caller then puts the swapped commands back and reads the
+// array serially for the exact error.
+static bool readCommandsReusing(std::string_view text, const std::vector<std::string_view>& entries,
+    AppConfig& previous, std::vector<CommandDraft>& out, StringPool& strings) {
+    // (hash, index) of the previous commands, sorted for lookup
+    std::vector<std::pair<std::uint64_t, size_t>> byHash(previous.commandDigests.size());
+    for (size_t j = 0; j < byHash.size(); j++) byHash[j] = { previous.commandDigests[j].hash, j };
+    std::sort(byHash.begin(), byHash.end());
+    std::vector<bool> taken(byHash.size());
+
+    out.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        size_t offset = static_cast<size_t>(entries[i].data() - text.data());
+        CommandDraft& c = out[i];
+        c.hash = contentHash(entries[i]);
+        auto it = std::lower_bound(byHash.begin(), byHash.end(), std::make_pair(c.hash, size_t{ 0 }));
+        for (; it != byHash.end() && it->first == c.hash; ++it) {
+            size_t j = it->second;
+            const CommandDigest& digest = previous.commandDigests[j];
+            if (taken[j] || digest.length != entries[i].size()) continue;
+            taken[j] = true;
+            std::swap(static_cast<CommandConfig&>(c), previous.commands[j]);
+            c.present = digest.present;
+            const CommandSpan& old = previous.commandSpans[j];
+            c.span = shiftSpan(old, static_cast<std::ptrdiff_t>(offset) - static_cast<std::ptrdiff_t>(old.objectBegin));
+            c.reused = j;
+            break;
+        }
+        if (c.reused != CommandSpan::npos) continue;
+        try {
+            JsonReader r(text, offset);
+            readCommandEntry(r, c, strings);
+            if (r.offset() != offset + entries[i].size()) return false;
         }
+        catch (...) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        // args
-        const JsonValue* argsV = c.tryGet(L"args");
-        if (argsV) {
-            if (!argsV->isArray()) throw JsonParseError("command.args must be array");
-            for (const auto& av : argsV->a) {
-                cc.args.push_back(av.asString(L"command.args[]"));
-            }
+// Undoes the swaps of readCommandsReusing, so a failed load leaves previous as
+// it was (the defaults applied since are those of previous again).
+static void returnReused(std::vector<CommandDraft>& drafts, AppConfig& previous) {
+    constexpr std::uint32_t explicitMinInterval = fieldBit(kCommandFields, L"minIntervalSeconds");
+    constexpr std::uint32_t explicitTimeout = fieldBit(kCommandFields, L"timeoutSeconds");
+    for (CommandDraft& c : drafts) {
+        if (c.reused == CommandSpan::npos) continue;
+        CommandConfig& back = previous.commands[c.reused];
+        std::swap(static_cast<CommandConfig&>(c), back);
+        if (!(c.present & explicitMinInterval)) back.minIntervalSeconds = previous.defaultMinIntervalSeconds;
+        if (!(c.present & explicitTimeout)) back.timeoutSeconds = previous.defaultTimeoutSeconds;
+        c.reused = CommandSpan::npos;
+    }
+}
+
+static bool readCommands(JsonReader& r, ConfigDraft& d, const wchar_t*) {
+    if (r.peekType() != JsonValue::Type::Array) {
+        throw JsonParseError("commands must be array", r.offset(), JsonErrorCode::Type);
+    }
+    d.hasCommands = true;
+
+    if (d.previous) {
+        JsonReader start = r;
+        std::vector<std::string_view> entries;
+        if (r.splitArray(entries) && readCommandsReusing(r.text(), entries, *d.previous, d.commands, d.strings)) return true;
+        r = start;
+        returnReused(d.commands, *d.previous);
+        d.commands.clear();
+    }
+    else if (r.text().size() >= kParallelMinBytes && std::thread::hardware_concurrency() > 1) {
+        JsonReader start = r;
+        std::vector<std::string_view> entries;
+        if (r.splitArray(entries) && readCommandsParallel(r.text(), entries, d.commands, d.strings)) return true;
+        r = start;
+        d.commands.clear();
+    }
+
+    r.beginArray();
+    while (r.nextElement()) {
+        readCommandEntry(r, d.commands.emplace_back(), d.strings);
+    }
+    return true;
+}
+
+static bool readIncludes(JsonReader& r, ConfigDraft& d, const wchar_t*) {
+    if (r.peekType() != JsonValue::Type::Array) {
+        throw JsonParseError("include must be array", r.offset(), JsonErrorCode::Type);
+    }
+    r.beginArray();
+    while (r.nextElement()) {
+        r.peekType();
+        size_t at = r.offset();
+        std::wstring& path = d.includes.emplace_back();
+        r.readString(path, L"include[]");
+        if (path.empty()) throw JsonParseError("include[] must not be empty", at, JsonErrorCode::Invalid);
+    }
+    return true;
+}
+
+static bool validNetworkOption(const ConfigDraft& d) {
+    return d.networkOption >= 0 && d.networkOption <= 2;
+}
+
+static bool validStateStore(const ConfigDraft& d) {
+    return d.stateStore.empty() || d.stateStore == L"config" || d.stateStore == L"journal";
+}
+
+static constexpr FieldBinding<ConfigDraft> kRootFields[] = {
+    { L"version", bindField<&ConfigDraft::version> },
+    // networkOption: 0=connected only, 1=metered ok, 2=always (default: 2)
+    { L"networkOption", bindField<&ConfigDraft::networkOption>, validNetworkOption, "networkOption must be 0, 1, or 2" },
+    { L"stateStore", bindField<&ConfigDraft::stateStore>, validStateStore, "stateStore must be \"config\" or \"journal\"" },
+    { L"defaults", readDefaults },
+    { L"include", readIncludes },
+    { L"commands", readCommands },
+};
+
+// A reused command keeps the state it had in memory; the file is what counts.
+static void rereadState(std::string_view text, CommandDraft& c) {
+    c.lastRunUtc.clear();
+    c.hasLastRunUtc = false;
+    if (c.span.runBegin != CommandSpan::npos) {
+        JsonReader r(text, c.span.runBegin);
+        readField(r, c.lastRunUtc, L"lastRunUtc");
+        c.hasLastRunUtc = !c.lastRunUtc.empty();
+    }
+    c.lastExitCode = 0;
+    c.hasLastExitCode = false;
+    if (c.span.exitBegin != CommandSpan::npos) {
+        JsonReader r(text, c.span.exitBegin);
+        c.hasLastExitCode = readField(r, c.lastExitCode, L"lastExitCode");
+    }
+}
+
+// Calls work(i) for every i below count on up to hardware_concurrency threads.
+// Items differ widely in cost, so each thread takes the next one as it finishes
+// one rather than a fixed share. work must not throw.
+template <class F>
+static void parallelFor(size_t count, F work) {
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) work(i);
+    };
+
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+    std::vector<std::jthread> pool;
+    if (threads > 1) pool.reserve(threads - 1);
+    try {
+        for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    }
+    catch (const std::system_error&) {
+        // out of threads: the ones already started and this one share the rest
+    }
+    worker();
+    pool.clear();
+}
+
+// What tryLoadAndValidateConfig reports for a file that could not be read.
+static JsonError ioError(const std::exception& e) {
+    JsonError error;
+    error.code = JsonErrorCode::Io;
+    error.message = e.what();
+    return error;
+}
+
+// "C:\x", "\\server\x" or "\x": not relative to the including config.
+static bool isRootedPath(const std::wstring& path) {
+    return (path.size() >= 2 && path[1] == L':') || (!path.empty() && (path[0] == L'\\' || path[0] == L'/'));
+}
+
+// The fragment files includes names, in order, each once. A directory stands
+// for every *.json file below it. The config itself is never its own fragment.
+static std::vector<std::wstring> resolveIncludes(const std::wstring& configPath, const std::vector<std::wstring>& includes) {
+    std::wstring dir = getDirectoryName(configPath);
+    std::vector<std::wstring> paths;
+    std::unordered_set<std::wstring> seen{ configPath };
+    for (const std::wstring& include : includes) {
+        std::wstring path = isRootedPath(include) ? include : joinPath(dir, include);
+        if (!directoryExists(path)) {
+            if (seen.insert(path).second) paths.push_back(std::move(path));
+            continue;
+        }
+        for (std::wstring& file : listFilesRecursive(path, L".json")) {
+            if (seen.insert(file).second) paths.push_back(std::move(file));
         }
+    }
+    return paths;
+}
 
-        cc.workingDirectory = getStringFieldOrEmpty(c, L"workingDirectory");
+static bool loadFileInto(const std::wstring& configPath, std::pmr::memory_resource* mr, AppConfig* previous,
+    AppConfig& cfg, JsonError* error, IncludeContext* includes);
 
-        cc.minIntervalSeconds = getIntFieldOrDefault(c, L"minIntervalSeconds", cfg.defaultMinIntervalSeconds);
-        if (cc.minIntervalSeconds < 0) throw JsonParseError("minIntervalSeconds must be >= 0");
+// Loads one fragment: restored from its snapshot when the file is unchanged,
+// otherwise parsed (reusing the commands the out-of-date snapshot still
+// matches) and its snapshot rewritten for the next load. A fragment may not
+// include others.
+static void loadFragment(ConfigFragment& frag, std::pmr::memory_resource* mr, JsonError& error) {
+    try {
+        AppConfig previous;
+        if (loadConfigSnapshot(frag.path, frag.config, mr, &previous)) return;
+        if (!loadFileInto(frag.path, mr, &previous, frag.config, &error, nullptr)) return;
+        if (!frag.config.includes.empty()) {
+            std::string_view text = frag.config.source ? std::string_view(*frag.config.source) : std::string_view();
+            size_t at = text.empty() ? JsonParseError::npos : memberOffset(text, 0, L"include");
+            error = describeJsonError(
+                JsonParseError("include is only allowed in the root config", at, JsonErrorCode::Invalid), text);
+            return;
+        }
+        writeConfigSnapshot(frag.path, frag.config);
+    }
+    catch (const std::exception& e) {
+        error = ioError(e);
+    }
+}
+
+// Whether a parse of the file would take readCommandsParallel. A file that
+// cannot be sized is left for its load to report.
+static bool readsInParallel(const std::wstring& path) {
+    if (std::thread::hardware_concurrency() <= 1) return false;
+    try {
+        return getFileSizeBytes(path) >= kParallelMinBytes;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+// Where the name of commands[k] of a fragment is, for a duplicate name error.
+static JsonError duplicateNameError(const ConfigFragment& frag, size_t k) {
+    const AppConfig& fc = frag.config;
+    // one restored from its snapshot keeps no text; a streamed one has no spans
+    std::string text;
+    try {
+        text = fc.source ? *fc.source : readUtf8File(frag.path);
+    }
+    catch (const std::exception&) {
+    }
+    size_t at = JsonParseError::npos;
+    if (!text.empty() && k < fc.commandSpans.size()) {
+        size_t begin = fc.commandSpans[k].objectBegin;
+        at = memberOffset(text, begin, L"name");
+        if (at == begin) at = memberOffset(text, begin, L"id");
+    }
+    return describeJsonError(JsonParseError("Duplicate command name", at, JsonErrorCode::Invalid), text);
+}
 
-        cc.timeoutSeconds = getIntFieldOrDefault(c, L"timeoutSeconds", cfg.defaultTimeoutSeconds);
-        if (cc.timeoutSeconds < 0) throw JsonParseError("timeoutSeconds must be >= 0");
+// Loads the fragments of the config d was read from, in parallel. Their
+// commands take d's defaults where they set none, and their names must not
+// repeat any before them (d's own are in names). Throws FragmentError for the
+// first fragment, in include order, that fails.
+static std::vector<ConfigFragment> loadFragments(const IncludeContext& context, const ConfigDraft& d,
+    std::unordered_set<std::wstring_view>& names) {
+    std::vector<std::wstring> paths = resolveIncludes(*context.configPath, d.includes);
+    std::vector<ConfigFragment> fragments(paths.size());
+    std::vector<JsonError> errors(paths.size());
+    // A fragment that readCommands would read on threads of its own is loaded
+    // after the others, one at a time, so that no more threads run at once
+    // than the machine has.
+    std::vector<size_t> shared;
+    std::vector<size_t> alone;
+    for (size_t i = 0; i < paths.size(); i++) {
+        fragments[i].path = std::move(paths[i]);
+        (readsInParallel(fragments[i].path) ? alone : shared).push_back(i);
+    }
+    parallelFor(shared.size(), [&](size_t k) {
+        loadFragment(fragments[shared[k]], context.mr, errors[shared[k]]);
+    });
+    for (size_t i : alone) loadFragment(fragments[i], context.mr, errors[i]);
+
+    constexpr std::uint32_t explicitMinInterval = fieldBit(kCommandFields, L"minIntervalSeconds");
+    constexpr std::uint32_t explicitTimeout = fieldBit(kCommandFields, L"timeoutSeconds");
+    for (size_t i = 0; i < fragments.size(); i++) {
+        ConfigFragment& frag = fragments[i];
+        if (errors[i].code != JsonErrorCode::None) throw FragmentError(frag.path, std::move(errors[i]));
+        AppConfig& fc = frag.config;
+        for (size_t k = 0; k < fc.commands.size(); k++) {
+            CommandConfig& c = fc.commands[k];
+            std::uint32_t present = fc.commandDigests[k].present;
+            if (!(present & explicitMinInterval)) c.minIntervalSeconds = d.defaultMinIntervalSeconds;
+            if (!(present & explicitTimeout)) c.timeoutSeconds = d.defaultTimeoutSeconds;
+            if (!names.insert(c.name).second) throw FragmentError(frag.path, duplicateNameError(frag, k));
+        }
+    }
+    return fragments;
+}
+
+// Moves the commands of cfg's fragments from the end of cfg.commands back into
+// each fragment's config, so that every config's commands line up with its own
+// spans and digests again.
+static void splitFragments(AppConfig& cfg) {
+    size_t own = cfg.commands.size();
+    for (const ConfigFragment& f : cfg.fragments) own -= f.commandCount;
+    auto next = cfg.commands.begin() + static_cast<std::ptrdiff_t>(own);
+    for (ConfigFragment& f : cfg.fragments) {
+        auto end = next + static_cast<std::ptrdiff_t>(f.commandCount);
+        f.config.commands.assign(std::make_move_iterator(next), std::make_move_iterator(end));
+        next = end;
+    }
+    cfg.commands.resize(own);
+}
+
+// The reverse of splitFragments.
+static void joinFragments(AppConfig& cfg) {
+    size_t total = cfg.commands.size();
+    for (const ConfigFragment& f : cfg.fragments) total += f.config.commands.size();
+    cfg.commands.reserve(total);
+    for (ConfigFragment& f : cfg.fragments) {
+        f.commandCount = f.config.commands.size();
+        cfg.commands.insert(cfg.commands.end(), std::make_move_iterator(f.config.commands.begin()),
+            std::make_move_iterator(f.config.commands.end()));
+        f.config.commands.clear();
+    }
+}
+
+// Interns the strings of the fragment commands joined into cfg in cfg.strings,
+// so that they share buffers with the config's and each other's and a reload
+// taking cfg as previous finds them all. The fragments' own pools are dropped.
+static void internFragmentStrings(AppConfig& cfg) {
+    size_t own = cfg.commands.size();
+    for (ConfigFragment& f : cfg.fragments) {
+        own -= f.commandCount;
+        f.config.strings = StringPool();
+    }
+    for (size_t idx = own; idx < cfg.commands.size(); idx++) {
+        CommandConfig& c = cfg.commands[idx];
+        c.exe = cfg.strings.intern(c.exe);
+        c.workingDirectory = cfg.strings.intern(c.workingDirectory);
+        for (SharedString& a : c.args) a = cfg.strings.intern(a);
+    }
+}
+
+// Reads a whole config file into cfg in one pass over its text, without
+// building a JsonValue. cfg.commandSpans gets each entry's byte ranges in text.
+// With previous, commands whose entry text is unchanged are taken from it (see
+// loadAndValidateConfig); if the load fails, previous is left as it was.
+// With includes, the fragments the file includes are loaded before anything is
+// committed to cfg, and their commands appended; without, include is only read.
+static void bindConfig(std::string_view text, AppConfig& cfg, AppConfig* previous, IncludeContext* includes) {
+    JsonReader r(text);
+    if (r.peekType() != JsonValue::Type::Object) {
+        throw JsonParseError("Config root must be object", r.offset(), JsonErrorCode::Type);
+    }
+    size_t rootBegin = r.offset();
+    ConfigDraft d;
+    if (previous && !previous->commands.empty() && previous->commandDigests.size() == previous->commands.size() &&
+        previous->commandSpans.size() == previous->commands.size()) {
+        d.previous = previous;
+        // new commands share strings with the reused ones
+        d.strings = std::move(previous->strings);
+    }
 
-        cc.lastRunUtc = getStringFieldOrEmpty(c, L"lastRunUtc");
-        cc.hasLastRunUtc = !cc.lastRunUtc.empty();
+    // defaults may follow the commands array, so they are applied afterwards
+    constexpr std::uint32_t explicitMinInterval = fieldBit(kCommandFields, L"minIntervalSeconds");
+    constexpr std::uint32_t explicitTimeout = fieldBit(kCommandFields, L"timeoutSeconds");
+    try {
+        bindObject(r, d, kRootFields);
+        r.finish();
 
-        const JsonValue* lec = c.tryGet(L"lastExitCode");
-        if (lec && !lec->isNull()) {
-            cc.hasLastExitCode = true;
-            cc.lastExitCode = lec->asInt(L"lastExitCode");
+        checkFields(d, kRootFields, text, rootBegin);
+        if (!d.hasCommands) throw JsonParseError("Missing field: commands at root", rootBegin, JsonErrorCode::Invalid);
+        // fragment commands take the defaults too, whether or not any command here does
+        if (!d.includes.empty()) checkFields(d, kDefaultsFields, text, memberOffset(text, rootBegin, L"defaults"));
+        // names identify commands for their recorded state, so they must be unique
+        std::unordered_set<std::wstring_view> names;
+        names.reserve(d.commands.size());
+        for (size_t idx = 0; idx < d.commands.size(); idx++) {
+            CommandDraft& c = d.commands[idx];
+            const wchar_t* nameKey = L"name";
+            if (c.name.empty() && !c.idText.empty()) {
+                JsonReader id(text, static_cast<size_t>(c.idText.data() - text.data()));
+                readField(id, c.name, L"id");
+                nameKey = L"id";
+            }
+            if (!(c.present & explicitMinInterval)) c.minIntervalSeconds = d.defaultMinIntervalSeconds;
+            if (!(c.present & explicitTimeout)) c.timeoutSeconds = d.defaultTimeoutSeconds;
+            checkFields(c, kCommandFields, text, c.span.objectBegin);
+            if (!names.insert(c.name).second) {
+                throw JsonParseError("Duplicate command name", memberOffset(text, c.span.objectBegin, nameKey),
+                    JsonErrorCode::Invalid);
+            }
         }
+        if (includes && !d.includes.empty()) includes->fragments = loadFragments(*includes, d, names);
+    }
+    catch (...) {
+        if (d.previous) {
+            returnReused(d.commands, *d.previous);
+            d.previous->strings = std::move(d.strings);
+        }
+        throw;
+    }
+
+    cfg.version = d.version;
+    cfg.networkOption = static_cast<NetworkOption>(d.networkOption);
+    cfg.stateStore = d.stateStore == L"journal" ? StateStore::Journal : StateStore::Config;
+    cfg.defaultMinIntervalSeconds = d.defaultMinIntervalSeconds;
+    cfg.defaultTimeoutSeconds = d.defaultTimeoutSeconds;
+    cfg.includes = std::move(d.includes);
+    cfg.commands.clear();
+    cfg.commands.reserve(d.commands.size());
+    cfg.commandSpans.clear();
+    cfg.commandSpans.reserve(d.commands.size());
+    cfg.commandDigests.clear();
+    cfg.commandDigests.reserve(d.commands.size());
+    for (CommandDraft& c : d.commands) {
+        std::string_view entry = text.substr(c.span.objectBegin, c.span.objectEnd - c.span.objectBegin);
+        if (c.reused != CommandSpan::npos) rereadState(text, c);
+        else c.hash = contentHash(entry);
+
+        cfg.commandDigests.push_back({ c.hash, entry.size(), c.present });
+        cfg.commandSpans.push_back(c.span);
+        cfg.commands.push_back(std::move(static_cast<CommandConfig&>(c)));
+    }
+    cfg.strings = std::move(d.strings);
+    cfg.fragments.clear();
+    if (includes) {
+        cfg.fragments = std::move(includes->fragments);
+        joinFragments(cfg);
+        internFragmentStrings(cfg);
+    }
+    cfg.strings.pruneUnshared();
+}
+
+// bindConfig for both load flavours. With error set, a JsonParseError is
+// described there against text (line, column, JSON Pointer) and false returned;
+// otherwise it propagates.
+static bool bindConfigReporting(std::string_view text, AppConfig& cfg, AppConfig* previous, JsonError* error,
+    IncludeContext* includes) {
+    try {
+        bindConfig(text, cfg, previous, includes);
+        return true;
+    }
+    catch (const JsonParseError& e) {
+        if (!error) throw;
+        *error = describeJsonError(e, text);
+        return false;
+    }
+}
+
+static bool loadStreamingInto(const std::wstring& configPath, AppConfig& cfg, AppConfig* previous, JsonError* error,
+    IncludeContext* includes) {
+    cfg.streamed = true;
+
+    MappedFile file(configPath);
+    bool ok = bindConfigReporting(file.text, cfg, previous, error, includes);
+    cfg.textHash = contentHash(file.text);
+    // the offsets are into the mapping, which is closed on return
+    cfg.commandSpans.clear();
+    return ok;
+}
+
+// Records the stamp of configPath in cfg, taken before its text is read: a
+// write after it moves the stamp.
+static FileStamp stampFile(const std::wstring& configPath, AppConfig& cfg) {
+    cfg.stampTakenAt = currentFileTime();
+    FileStamp stamp = getFileStamp(configPath);
+    cfg.fileSize = stamp.size;
+    cfg.fileWriteTime = stamp.lastWriteTime;
+    return stamp;
+}
+
+// Loads one config file; includes, if given, has its fragments loaded too.
+static bool loadFileInto(const std::wstring& configPath, std::pmr::memory_resource* mr, AppConfig* previous,
+    AppConfig& cfg, JsonError* error, IncludeContext* includes) {
+    if (stampFile(configPath, cfg).size > kMaxReadFileBytes) {
+        return loadStreamingInto(configPath, cfg, previous, error, includes);
+    }
+
+    cfg.rootResource = mr;
+    cfg.source = std::make_shared<const std::string>(readUtf8File(configPath));
+    return bindConfigReporting(*cfg.source, cfg, previous, error, includes);
+}
 
-        cfg.commands.push_back(std::move(cc));
+// The throwing entry points have no file to report a fragment's error in, so
+// its message names the fragment and the location there.
+static JsonParseError fragmentParseError(const FragmentError& e) {
+    std::string message = wStringToUtf8(e.path);
+    if (e.error.line != 0) {
+        message += "(" + std::to_string(e.error.line) + "," + std::to_string(e.error.column) + ")";
     }
+    message += ": " + e.error.message;
+    return JsonParseError(message, JsonParseError::npos, e.error.code);
+}
 
+// loadFileInto with fragments, for both load flavours; errorFile (if given)
+// gets the file a reported error is in.
+static bool loadInto(const std::wstring& configPath, std::pmr::memory_resource* mr, AppConfig* previous,
+    AppConfig& cfg, JsonError* error, std::wstring* errorFile) {
+    IncludeContext includes;
+    includes.configPath = &configPath;
+    includes.mr = mr;
+    // only the config's own commands are reused; its fragments come from their snapshots
+    bool split = previous && !previous->fragments.empty();
+    if (split) splitFragments(*previous);
+    try {
+        bool ok = loadFileInto(configPath, mr, previous, cfg, error, &includes);
+        if (split) joinFragments(*previous);
+        if (!ok && errorFile) *errorFile = configPath;
+        return ok;
+    }
+    catch (const FragmentError& e) {
+        if (split) joinFragments(*previous);
+        if (!error) throw fragmentParseError(e);
+        *error = e.error;
+        if (errorFile) *errorFile = e.path;
+        return false;
+    }
+    catch (...) {
+        if (split) joinFragments(*previous);
+        throw;
+    }
+}
+
+AppConfig loadConfigStreaming(const std::wstring& configPath) {
+    AppConfig cfg;
+    loadStreamingInto(configPath, cfg, nullptr, nullptr, nullptr);
     return cfg;
 }
 
+AppConfig loadAndValidateConfig(const std::wstring& configPath, std::pmr::memory_resource* mr, AppConfig* previous) {
+    AppConfig cfg;
+    loadInto(configPath, mr, previous, cfg, nullptr, nullptr);
+    return cfg;
+}
+
+ConfigLoadResult tryLoadAndValidateConfig(const std::wstring& configPath, std::pmr::memory_resource* mr,
+    AppConfig* previous) {
+    ConfigLoadResult result;
+    try {
+        if (loadInto(configPath, mr, previous, result.config, &result.error, &result.errorFile)) return result;
+    }
+    catch (const std::exception& e) {
+        // the file could not be read at all
+        result.error = ioError(e);
+        result.errorFile = configPath;
+    }
+    result.config = AppConfig{};
+    return result;
+}
+
+std::vector<JsonError> lintConfigFiles(std::span<const std::wstring> paths) {
+    std::vector<JsonError> errors(paths.size());
+    auto lint = [&](size_t i) {
+        std::pmr::monotonic_buffer_resource arena;
+        AppConfig cfg;
+        try {
+            loadFileInto(paths[i], &arena, nullptr, cfg, &errors[i], nullptr);
+        }
+        catch (const std::exception& e) {
+            errors[i] = ioError(e);
+        }
+    };
+    // as in loadFragments: files read on threads of their own go one at a time
+    std::vector<size_t> shared;
+    std::vector<size_t> alone;
+    for (size_t i = 0; i < paths.size(); i++) (readsInParallel(paths[i]) ? alone : shared).push_back(i);
+    parallelFor(shared.size(), [&](size_t k) { lint(shared[k]); });
+    for (size_t i : alone) lint(i);
+    return errors;
+}
+
+CommandIndex::CommandIndex(const std::vector<CommandConfig>& commands) {
+    byName.reserve(commands.size());
+    for (size_t idx = 0; idx < commands.size(); idx++) byName.try_emplace(commands[idx].name, idx);
+}
+
+size_t CommandIndex::find(std::wstring_view name) const {
+    auto it = byName.find(name);
+    return it == byName.end() ? npos : it->second;
+}
+
 void applyCommandsToJson(AppConfig& cfg) {
+    if (cfg.root.isNull() && cfg.source) {
+        // Only commands are decoded; every other value stays a raw span over
+        // source and is written back byte-for-byte.
+        JsonParseOptions options;
+        options.eagerKeys = kRewriteKeys;
+        cfg.root = parseJsonUtf8(*cfg.source, cfg.rootResource, options);
+    }
     if (!cfg.root.isObject()) return;
     JsonValue* cmds = cfg.root.tryGet(L"commands");
     if (!cmds || !cmds->isArray()) return;
 
-    for (size_t idx = 0; idx < cfg.commands.size() && idx < cmds->a.size(); idx++) {
-        JsonValue& c = cmds->a[idx];
+    JsonValue::Array& cmdItems = cmds->items();
+    for (size_t idx = 0; idx < cfg.commands.size() && idx < cmdItems.size(); idx++) {
+        JsonValue& c = cmdItems[idx];
         if (!c.isObject()) continue;
         const CommandConfig& cc = cfg.commands[idx];
 
         if (cc.hasLastRunUtc) {
-            upsertObjectField(c, L"lastRunUtc", JsonValue::makeString(cc.lastRunUtc));
+            // from the object's own resource (the arena of a parsed root), like the
+            // rest of it; const access keeps its key index
+            std::pmr::memory_resource* mr = std::as_const(c).members().get_allocator().resource();
+            c.set(L"lastRunUtc", JsonValue::makeString(cc.lastRunUtc, mr));
         }
         if (cc.hasLastExitCode) {
-            upsertObjectField(c, L"lastExitCode", JsonValue::makeInt(cc.lastExitCode));
+            c.set(L"lastExitCode", JsonValue::makeInt(cc.lastExitCode));
         }
     }
 }
 
+// Copies parse events of the original file to the writer, replacing the first
+// lastRunUtc/lastExitCode of each commands[] entry (or appending them), the
+// same edits applyCommandsToJson makes on the DOM.
+class StreamingStateWriter final : public JsonEventHandler {
+public:
+    StreamingStateWriter(const AppConfig& cfg, JsonStreamWriter& w) : cfg_(cfg), w_(w) {}
+
+    void onObjectStart() override {
+        if (skipStart()) return;
+        w_.beginObject();
+        depth_++;
+        if (depth_ == 3 && inCommands_) {
+            inCommand_ = true;
+            runSeen_ = false;
+            exitSeen_ = false;
+        }
+    }
+
+    void onObjectEnd() override {
+        if (skip_) { skip_--; return; }
+        if (inCommand_ && depth_ == 3) {
+            const CommandConfig* cc = current();
+            if (cc && cc->hasLastRunUtc && !runSeen_) {
+                w_.key(L"lastRunUtc");
+                w_.stringValue(cc->lastRunUtc);
+            }
+            if (cc && cc->hasLastExitCode && !exitSeen_) {
+                w_.key(L"lastExitCode");
+                w_.intValue(cc->lastExitCode);
+            }
+            inCommand_ = false;
+            cmdIndex_++;
+        }
+        w_.endObject();
+        depth_--;
+    }
+
+    void onArrayStart() override {
+        if (skipStart()) return;
+        w_.beginArray();
+        depth_++;
+        if (depth_ == 2 && pendingCommands_) inCommands_ = true;
+    }
+
+    void onArrayEnd() override {
+        if (skip_) { skip_--; return; }
+        if (depth_ == 2) inCommands_ = false;
+        w_.endArray();
+        depth_--;
+    }
+
+    void onKey(std::wstring_view key) override {
+        if (skip_) return;
+        if (depth_ == 1) {
+            pendingCommands_ = key == L"commands" && !commandsSeen_;
+            if (pendingCommands_) commandsSeen_ = true;
+        }
+        else if (inCommand_ && depth_ == 3) {
+            const CommandConfig* cc = current();
+            if (key == L"lastRunUtc" && !runSeen_) {
+                runSeen_ = true;
+                if (cc && cc->hasLastRunUtc) {
+                    w_.key(key);
+                    w_.stringValue(cc->lastRunUtc);
+                    skipNext_ = true;
+                    return;
+                }
+            }
+            else if (key == L"lastExitCode" && !exitSeen_) {
+                exitSeen_ = true;
+                if (cc && cc->hasLastExitCode) {
+                    w_.key(key);
+                    w_.intValue(cc->lastExitCode);
+                    skipNext_ = true;
+                    return;
+                }
+            }
+        }
+        w_.key(key);
+    }
+
+    void onString(std::wstring_view v) override { if (!skipScalar()) w_.stringValue(v); }
+    void onInt(std::int64_t v) override { if (!skipScalar()) w_.intValue(v); }
+    void onDouble(double v) override { if (!skipScalar()) w_.doubleValue(v); }
+    void onBool(bool v) override { if (!skipScalar()) w_.boolValue(v); }
+    void onNull() override { if (!skipScalar()) w_.nullValue(); }
+
+private:
+    const CommandConfig* current() const {
+        return cmdIndex_ < cfg_.commands.size() ? &cfg_.commands[cmdIndex_] : nullptr;
+    }
+
+    bool skipStart() {
+        if (skip_) { skip_++; return true; }
+        if (skipNext_) { skipNext_ = false; skip_ = 1; return true; }
+        return false;
+    }
+
+    bool skipScalar() {
+        if (skip_) return true;
+        if (skipNext_) { skipNext_ = false; return true; }
+        return false;
+    }
+
+    const AppConfig& cfg_;
+    JsonStreamWriter& w_;
+    int depth_ = 0;
+    int skip_ = 0;
+    bool skipNext_ = false;
+    bool pendingCommands_ = false;
+    bool commandsSeen_ = false;
+    bool inCommands_ = false;
+    bool inCommand_ = false;
+    bool runSeen_ = false;
+    bool exitSeen_ = false;
+    size_t cmdIndex_ = 0;
+};
+
+void writeConfigStreaming(const std::wstring& configPath, const AppConfig& cfg) {
+    AtomicFileWriter out(configPath);
+    {
+        // the mapping must be closed before the temp file replaces the original
+        MappedFile file(configPath);
+        JsonStreamWriter w([&](std::string_view bytes) { out.write(bytes); });
+        StreamingStateWriter rewriter(cfg, w);
+        parseJsonUtf8Events(file.text, rewriter);
+        w.finish();
+    }
+    out.commit();
+}
+
+static bool isJsonSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+namespace {
+
+// One replacement of text[begin, end). Value ranges created by the splice are
+// given relative to its start (npos when it does not create that value).
+struct Splice {
+    size_t begin = 0;
+    size_t end = 0;
+    std::string text;
+    size_t cmd = 0;
+    size_t runAt = std::string::npos;
+    size_t runLen = 0;
+    size_t exitAt = std::string::npos;
+    size_t exitLen = 0;
+};
+
+// State a command changed since its file was loaded, carried over by name when
+// the file was edited meanwhile.
+struct ChangedState {
+    std::wstring name;
+    std::wstring lastRunUtc;
+    std::int64_t lastExitCode = 0;
+    bool hasLastRunUtc = false;
+    bool hasLastExitCode = false;
+};
+
+} // namespace
+
+static std::string jsonToken(const JsonValue& v) {
+    std::string token;
+    writeJsonUtf8(v, token, -1);
+    return token;
+}
+
+// How a command entry lays out its members: the text between its first two
+// members (",\n    " or ", ") and between its first key and value (": ").
+// Validated entries always have at least name and exe.
+static void entryLayout(std::string_view text, const CommandSpan& span, std::string& sep, std::string& colon) {
+    size_t i = span.objectBegin + 1;
+    while (isJsonSpace(text[i])) i++;
+
+    // first key; stop at its closing quote
+    i++;
+    while (text[i] != '\"') i += text[i] == '\\' ? 2 : 1;
+    size_t keyEnd = ++i;
+    while (isJsonSpace(text[i]) || text[i] == ':') i++;
+    colon.assign(text.substr(keyEnd, i - keyEnd));
+
+    // the first member separator at this level
+    int depth = 0;
+    for (; i < span.objectEnd; i++) {
+        char c = text[i];
+        if (c == '\"') {
+            i++;
+            while (text[i] != '\"') i += text[i] == '\\' ? 2 : 1;
+        }
+        else if (c == '[' || c == '{') depth++;
+        else if (c == ']' || c == '}') depth--;
+        else if (c == ',' && depth == 0) break;
+    }
+    size_t next = i + 1;
+    while (next < span.objectEnd && isJsonSpace(text[next])) next++;
+    sep.assign(text.substr(i, next - i));
+}
+
+// Builds the splices that bring one command's state in the text up to date.
+// Existing values are replaced in place; missing ones are appended after the
+// last member using the entry's own layout, so one-line entries stay one line.
+static void planCommandSplices(std::string_view text, size_t cmd, const CommandConfig& cc,
+    const CommandSpan& span, std::vector<Splice>& out) {
+    std::string runToken = cc.hasLastRunUtc ? jsonToken(JsonValue::makeString(cc.lastRunUtc)) : std::string();
+    std::string exitToken = cc.hasLastExitCode ? jsonToken(JsonValue::makeInt(cc.lastExitCode)) : std::string();
+
+    auto replace = [&](size_t begin, size_t end, const std::string& token, bool run) {
+        if (text.substr(begin, end - begin) == token) return;
+        Splice sp;
+        sp.begin = begin;
+        sp.end = end;
+        sp.cmd = cmd;
+        sp.text = token;
+        (run ? sp.runAt : sp.exitAt) = 0;
+        (run ? sp.runLen : sp.exitLen) = token.size();
+        out.push_back(std::move(sp));
+    };
+    if (cc.hasLastRunUtc && span.runBegin != CommandSpan::npos) replace(span.runBegin, span.runEnd, runToken, true);
+    if (cc.hasLastExitCode && span.exitBegin != CommandSpan::npos) replace(span.exitBegin, span.exitEnd, exitToken, false);
+
+    bool addRun = cc.hasLastRunUtc && span.runBegin == CommandSpan::npos;
+    bool addExit = cc.hasLastExitCode && span.exitBegin == CommandSpan::npos;
+    if (!addRun && !addExit) return;
+
+    size_t lastEnd = span.objectEnd - 1;
+    while (isJsonSpace(text[lastEnd - 1])) lastEnd--;
+    std::string sep;
+    std::string colon;
+    entryLayout(text, span, sep, colon);
+
+    Splice sp;
+    sp.begin = lastEnd;
+    sp.end = lastEnd;
+    sp.cmd = cmd;
+    auto append = [&](const char* key, const std::string& token, size_t& at, size_t& len) {
+        sp.text += sep;
+        sp.text += key;
+        sp.text += colon;
+        at = sp.text.size();
+        len = token.size();
+        sp.text += token;
+    };
+    if (addRun) append("\"lastRunUtc\"", runToken, sp.runAt, sp.runLen);
+    if (addExit) append("\"lastExitCode\"", exitToken, sp.exitAt, sp.exitLen);
+    out.push_back(std::move(sp));
+}
+
+// Writes the config by splicing changed state into the text it was read from,
+// keeping the user's formatting. Returns false when no byte ranges are known;
+// written tells whether there was anything to change.
+static bool saveConfigPatched(const std::wstring& configPath, AppConfig& cfg, bool& written) {
+    written = false;
+    if (!cfg.source || cfg.commandSpans.size() != cfg.commands.size()) return false;
+    std::string_view text = cfg.patched.empty() ? std::string_view(*cfg.source) : std::string_view(cfg.patched);
+
+    std::vector<Splice> splices;
+    for (size_t idx = 0; idx < cfg.commands.size(); idx++) {
+        planCommandSplices(text, idx, cfg.commands[idx], cfg.commandSpans[idx], splices);
+    }
+    if (splices.empty()) return true;
+    std::sort(splices.begin(), splices.end(), [](const Splice& a, const Splice& b) { return a.begin < b.begin; });
+
+    std::string next;
+    size_t grow = 0;
+    for (const Splice& sp : splices) grow += sp.text.size();
+    next.reserve(text.size() + grow);
+
+    // cumulative size change after each splice
+    std::vector<std::ptrdiff_t> shifts;
+    shifts.reserve(splices.size());
+    std::ptrdiff_t delta = 0;
+    size_t copied = 0;
+    for (const Splice& sp : splices) {
+        next.append(text.substr(copied, sp.begin - copied));
+        next += sp.text;
+        copied = sp.end;
+        delta += static_cast<std::ptrdiff_t>(sp.text.size()) - static_cast<std::ptrdiff_t>(sp.end - sp.begin);
+        shifts.push_back(delta);
+    }
+    next.append(text.substr(copied));
+
+    writeUtf8FileAtomic(configPath, next);
+    written = true;
+
+    // A start offset moves by the splices that end at or before it, an end
+    // offset by those that begin before it (an insertion right after a value
+    // must not move that value's end). Replaced values map correctly either way.
+    auto cumulativeBefore = [&](auto it) {
+        return it == splices.begin() ? std::ptrdiff_t(0) : shifts[static_cast<size_t>(it - splices.begin()) - 1];
+    };
+    auto remapStart = [&](size_t& pos) {
+        if (pos == CommandSpan::npos) return;
+        auto it = std::upper_bound(splices.begin(), splices.end(), pos,
+            [](size_t v, const Splice& sp) { return v < sp.end; });
+        pos = static_cast<size_t>(static_cast<std::ptrdiff_t>(pos) + cumulativeBefore(it));
+    };
+    auto remapEnd = [&](size_t& pos) {
+        if (pos == CommandSpan::npos) return;
+        auto it = std::lower_bound(splices.begin(), splices.end(), pos,
+            [](const Splice& sp, size_t v) { return sp.begin < v; });
+        pos = static_cast<size_t>(static_cast<std::ptrdiff_t>(pos) + cumulativeBefore(it));
+    };
+    for (CommandSpan& span : cfg.commandSpans) {
+        remapStart(span.objectBegin);
+        remapEnd(span.objectEnd);
+        remapStart(span.runBegin);
+        remapEnd(span.runEnd);
+        remapStart(span.exitBegin);
+        remapEnd(span.exitEnd);
+    }
+    // values appended by an insertion
+    for (size_t k = 0; k < splices.size(); k++) {
+        const Splice& sp = splices[k];
+        if (sp.begin != sp.end) continue;
+        size_t start = static_cast<size_t>(static_cast<std::ptrdiff_t>(sp.begin) + (k > 0 ? shifts[k - 1] : 0));
+        CommandSpan& span = cfg.commandSpans[sp.cmd];
+        if (sp.runAt != std::string::npos) {
+            span.runBegin = start + sp.runAt;
+            span.runEnd = span.runBegin + sp.runLen;
+        }
+        if (sp.exitAt != std::string::npos) {
+            span.exitBegin = start + sp.exitAt;
+            span.exitEnd = span.exitBegin + sp.exitLen;
+        }
+    }
+    // a spliced entry now reads differently; its digest must describe the text
+    // its span indexes, or a reload could reuse it for the entry as it was
+    // (a command's splices are adjacent once sorted)
+    if (cfg.commandDigests.size() == cfg.commands.size()) {
+        constexpr std::uint32_t runBit = fieldBit(kCommandFields, L"lastRunUtc");
+        constexpr std::uint32_t exitBit = fieldBit(kCommandFields, L"lastExitCode");
+        for (size_t k = 0; k < splices.size(); k++) {
+            size_t cmd = splices[k].cmd;
+            if (k > 0 && splices[k - 1].cmd == cmd) continue;
+            const CommandSpan& span = cfg.commandSpans[cmd];
+            const CommandConfig& cc = cfg.commands[cmd];
+            std::string_view entry = std::string_view(next).substr(span.objectBegin, span.objectEnd - span.objectBegin);
+            CommandDigest& digest = cfg.commandDigests[cmd];
+            digest.hash = contentHash(entry);
+            digest.length = entry.size();
+            if (cc.hasLastRunUtc) digest.present |= runBit;
+            if (cc.hasLastExitCode) digest.present |= exitBit;
+        }
+    }
+
+    cfg.patched = std::move(next);
+    return true;
+}
+
+// The text cfg's spans index: as loaded, or as last saved.
+static std::string_view loadedText(const AppConfig& cfg) {
+    return cfg.patched.empty() ? std::string_view(*cfg.source) : std::string_view(cfg.patched);
+}
+
+// Whether configPath still has the stamp cfg was loaded with, taken late
+// enough after its last write to vouch for the text (see kRacyStampTicks).
+static bool stampUnchanged(const std::wstring& configPath, const AppConfig& cfg) {
+    if (cfg.stampTakenAt < cfg.fileWriteTime + kRacyStampTicks) return false;
+    FileStamp stamp = getFileStamp(configPath);
+    return stamp.size == cfg.fileSize && stamp.lastWriteTime == cfg.fileWriteTime;
+}
+
+// Whether configPath no longer holds the text cfg was loaded from (or last
+// saved). The text is only read when the stamp cannot tell; a config restored
+// from a snapshot gets it read back here, as the save needs it.
+static bool editedSinceLoad(const std::wstring& configPath, AppConfig& cfg) {
+    if ((cfg.streamed || cfg.source) && stampUnchanged(configPath, cfg)) return false;
+    if (cfg.streamed) {
+        MappedFile file(configPath);
+        return contentHash(file.text) != cfg.textHash;
+    }
+    if (cfg.source) return readUtf8File(configPath) != loadedText(cfg);
+    // a config put together in memory
+    if (!cfg.root.isNull()) return false;
+
+    auto text = std::make_shared<const std::string>(readUtf8File(configPath));
+    if (contentHash(*text) != cfg.textHash) return true;
+    cfg.source = std::move(text);
+    return false;
+}
+
+// editedSinceLoad for the config and each of its fragments (a fragment that
+// is gone counts as edited). All of them are checked, so that every one restored
+// from a snapshot gets its text for the save.
+static bool anyEditedSinceLoad(const std::wstring& configPath, AppConfig& cfg) {
+    bool edited = editedSinceLoad(configPath, cfg);
+    for (ConfigFragment& f : cfg.fragments) {
+        edited = !fileExists(f.path) || editedSinceLoad(f.path, f.config) || edited;
+    }
+    return edited;
+}
+
+// Collects the state that the commands of from changed (or all they have,
+// without the loaded text to tell).
+static void collectChangedState(const AppConfig& from, std::vector<ChangedState>& out) {
+    bool haveText = from.source && from.commandSpans.size() == from.commands.size();
+    std::vector<Splice> changes;
+    for (size_t idx = 0; idx < from.commands.size(); idx++) {
+        const CommandConfig& c = from.commands[idx];
+        if (!c.hasLastRunUtc && !c.hasLastExitCode) continue;
+        if (haveText) {
+            changes.clear();
+            planCommandSplices(loadedText(from), idx, c, from.commandSpans[idx], changes);
+            if (changes.empty()) continue;
+        }
+        out.push_back({ c.name, c.lastRunUtc, c.lastExitCode, c.hasLastRunUtc, c.hasLastExitCode });
+    }
+}
+
+// The file was edited while cfg was in use (commands moved, added, renamed or
+// removed): load it again and carry the state cfg changed over to the commands
+// of the same name, so no run is lost or credited to another command. Each file
+// of cfg is compared with the text it was loaded from on its own. The reload
+// takes cfg as previous, so only the entries that were edited are read again;
+// the changed state is collected first, as that moves the others out of cfg.
+static void rebaseOnCurrentFile(const std::wstring& configPath, AppConfig& cfg) {
+    std::vector<ChangedState> changed;
+    splitFragments(cfg);
+    collectChangedState(cfg, changed);
+    for (const ConfigFragment& f : cfg.fragments) collectChangedState(f.config, changed);
+    joinFragments(cfg);
+
+    AppConfig current = loadAndValidateConfig(configPath, cfg.rootResource, &cfg);
+    CommandIndex index(current.commands);
+    for (ChangedState& s : changed) {
+        size_t at = index.find(s.name);
+        if (at == CommandIndex::npos) continue;
+        CommandConfig& target = current.commands[at];
+        if (s.hasLastRunUtc) {
+            target.hasLastRunUtc = true;
+            target.lastRunUtc = std::move(s.lastRunUtc);
+        }
+        if (s.hasLastExitCode) {
+            target.hasLastExitCode = true;
+            target.lastExitCode = s.lastExitCode;
+        }
+    }
+    cfg = std::move(current);
+}
+
+// Writes the state of cfg.commands into configPath, the file cfg was loaded from.
+// Returns whether the file was written.
+static bool writeState(const std::wstring& configPath, AppConfig& cfg) {
+    if (cfg.streamed) {
+        // the stamp taken at load no longer describes the file
+        cfg.stampTakenAt = 0;
+        writeConfigStreaming(configPath, cfg);
+        return true;
+    }
+    // a fragment that the reload in rebaseOnCurrentFile restored from its snapshot
+    if (!cfg.source && cfg.root.isNull() && editedSinceLoad(configPath, cfg)) {
+        throw std::runtime_error("Config file changed while saving");
+    }
+    bool written = false;
+    if (saveConfigPatched(configPath, cfg, written)) {
+        // taken just after the write, the stamp is racy: it lets a snapshot be
+        // written without reading the file back, not a later save skip the check
+        if (written) stampFile(configPath, cfg);
+        return written;
+    }
+    // root is written, which the spans do not index
+    cfg.stampTakenAt = 0;
+
+    applyCommandsToJson(cfg);
+
+    // the rewritten file is about the size of the one we read
+    std::string bytes;
+    bytes.reserve(cfg.source ? cfg.source->size() + cfg.source->size() / 4 + 4096 : 4096);
+    writeJsonUtf8(cfg.root, bytes);
+    writeUtf8FileAtomic(configPath, bytes);
+    return true;
+}
+
+void saveConfig(const std::wstring& configPath, AppConfig& cfg) {
+    if (anyEditedSinceLoad(configPath, cfg)) rebaseOnCurrentFile(configPath, cfg);
+    if (cfg.fragments.empty()) {
+        writeState(configPath, cfg);
+        return;
+    }
+
+    // every file gets the state of its own commands; a rewritten fragment gets
+    // a fresh snapshot, so the next load does not parse it again
+    splitFragments(cfg);
+    try {
+        writeState(configPath, cfg);
+        for (ConfigFragment& f : cfg.fragments) {
+            if (writeState(f.path, f.config)) writeConfigSnapshot(f.path, f.config);
+        }
+    }
+    catch (...) {
+        joinFragments(cfg);
+        throw;
+    }
+    joinFragments(cfg);
+}
+
 } // namespace ler
@@ -1,11 +1,17 @@
 ﻿#pragma once
 
 #include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "Json.h"
 #include "NetworkUtil.h"
+#include "StringPool.h"
 
 namespace ler {
 
@@ -13,9 +19,10 @@ struct CommandConfig {
     std::wstring name;
     bool enabled = true;
 
-    std::wstring exe;
-    std::vector<std::wstring> args;
-    std::wstring workingDirectory;
+    // interned in AppConfig::strings: configs repeat these across many commands
+    SharedString exe;
+    std::vector<SharedString> args;
+    SharedString workingDirectory;
 
     std::int64_t minIntervalSeconds = 0;
     std::int64_t timeoutSeconds = 0;
@@ -27,6 +34,36 @@ struct CommandConfig {
     std::int64_t lastExitCode = 0;
 };
 
+// Byte ranges of one commands[] entry in the config text: the object itself
+// and the values of its first lastRunUtc/lastExitCode members (npos if absent).
+struct CommandSpan {
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    size_t objectBegin = 0;
+    size_t objectEnd = 0;
+    size_t runBegin = npos;
+    size_t runEnd = npos;
+    size_t exitBegin = npos;
+    size_t exitEnd = npos;
+};
+
+// What a later load needs to recognize a commands[] entry as unchanged: the
+// contentHash and length of its text, and which fields it set itself (the rest
+// take the defaults of each load).
+struct CommandDigest {
+    std::uint64_t hash = 0;
+    size_t length = 0;
+    std::uint32_t present = 0;
+};
+
+// Where the run state of commands (lastRunUtc/lastExitCode) is persisted.
+enum class StateStore : std::int32_t {
+    Config = 0,     // written back into the config file (default)
+    Journal = 1,    // appended to a journal beside it (StateJournal.h); the config is only read
+};
+
+struct ConfigFragment;
+
 struct AppConfig {
     std::int64_t version = 1;
 
@@ -35,15 +72,127 @@ struct AppConfig {
 
     // Network option: 0=connected only, 1=metered ok, 2=always (default: 2)
     NetworkOption networkOption = NetworkOption::AlwaysExecute;
+    // stateStore: "config" (default) or "journal"
+    StateStore stateStore = StateStore::Config;
 
     std::vector<CommandConfig> commands;
-
-    // original JSON for rewrite (with modifications)
+    // include as written: fragment files, or directories whose *.json files (at
+    // any depth) are fragments, relative to the config's directory
+    std::vector<std::wstring> includes;
+    // The fragments include resolved to, in order. Their commands follow the
+    // config's own in commands, so commandSpans and commandDigests only cover
+    // the first commands.size() - (sum of commandCount) entries.
+    std::vector<ConfigFragment> fragments;
+    // Index of the exe, args and workingDirectory strings shared by more than
+    // one command, fragment commands included (fragments keep no pool of their
+    // own); a reload interns the strings of new commands through it.
+    StringPool strings;
+
+    // original JSON for a full rewrite (with modifications). Loading does not
+    // build it: applyCommandsToJson parses it from source on first use,
+    // allocating from rootResource (the resource passed to loadAndValidateConfig).
     JsonValue root;
+    std::pmr::memory_resource* rootResource = std::pmr::get_default_resource();
+    // UTF-8 text of the config file; unparsed (Raw) values in root point into it
+    std::shared_ptr<const std::string> source;
+    // Where each command sits in the file text, so saveConfig can splice state
+    // changes into it instead of re-serializing root. The text is *source until
+    // the first such save, and patched afterwards.
+    std::vector<CommandSpan> commandSpans;
+    std::string patched;
+    // One per command, for the text its span indexes (as loaded or last saved)
+    std::vector<CommandDigest> commandDigests;
+    // contentHash of the file as loaded when no copy of its text is kept (a
+    // streamed config, or one restored by loadConfigSnapshot), so saveConfig can
+    // tell whether it was edited since.
+    std::uint64_t textHash = 0;
+    // Size and last write time of the file as loaded or last saved (see
+    // FileStamp), and when they were taken (FILETIME ticks; 0 after a rewrite
+    // the spans do not index). While they are unchanged and were taken long
+    // enough after the write (kRacyStampTicks), saveConfig trusts them instead
+    // of reading the file back to compare; writeConfigSnapshot never reads it.
+    std::uint64_t fileSize = 0;
+    std::uint64_t fileWriteTime = 0;
+    std::uint64_t stampTakenAt = 0;
+    // Loaded with the streaming reader: root and source are empty and state is
+    // written back with writeConfigStreaming.
+    bool streamed = false;
     bool dirty = false;
 };
 
-AppConfig loadAndValidateConfig(const std::wstring& configPath);
+// A file of commands named by include: a config of its own (only its commands
+// are used) loaded into config, except that its commands were moved to the end
+// of the including AppConfig::commands, commandCount of them.
+struct ConfigFragment {
+    std::wstring path;
+    AppConfig config;
+    size_t commandCount = 0;
+};
+
+// Reads the file in a single pass straight into AppConfig/CommandConfig through
+// a field table; no JSON DOM is built. If a full rewrite later needs
+// AppConfig::root, it is allocated from mr, which must outlive the returned
+// config. Files larger than kMaxReadFileBytes are loaded with loadConfigStreaming.
+// Command names (or ids) must be unique: they identify commands for their run
+// state, whatever their position in the file.
+//
+// The commands of the fragments named by include are appended, and take the
+// config's defaults unless they set the value. Fragments are loaded in parallel,
+// each from its own snapshot (ConfigSnapshot.h) when its file is unchanged and
+// otherwise parsed and its snapshot rewritten, so a load parses only the
+// fragments edited since the last one. Names must be unique across them all.
+//
+// previous, if given, is an earlier load of the same file that the caller is
+// replacing (or a snapshot of an earlier version, see loadConfigSnapshot).
+// Each command whose entry text is unchanged (same contentHash and length) is
+// moved out of it instead of being read and checked again, so a reload costs a
+// hash of the text plus the work for what was edited. Its state fields are
+// still re-read from the file. previous is left untouched if the load fails.
+// Fragment commands are never taken from previous: a fragment is seeded from
+// its own snapshot instead.
+AppConfig loadAndValidateConfig(const std::wstring& configPath,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource(), AppConfig* previous = nullptr);
+// Same validation as loadAndValidateConfig, reading a memory-mapped file instead
+// of a copy of its text. Memory is bounded by the command list itself.
+AppConfig loadConfigStreaming(const std::wstring& configPath);
+
+struct ConfigLoadResult {
+    AppConfig config;
+    // code is JsonErrorCode::None on success; Io if the file could not be read
+    JsonError error;
+    // the file error was found in: the config, or one of its fragments
+    std::wstring errorFile;
+
+    bool ok() const { return error.code == JsonErrorCode::None; }
+};
+
+// loadAndValidateConfig without exceptions at the call site: a malformed or
+// invalid file yields an error with its line, column and the JSON Pointer of
+// the offending value (e.g. /commands/3/minIntervalSeconds), and an empty config.
+ConfigLoadResult tryLoadAndValidateConfig(const std::wstring& configPath,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource(), AppConfig* previous = nullptr);
+
+// Validates every file in paths on up to hardware_concurrency threads; files
+// large enough to be read on several threads each are validated one at a
+// time, after the others. Result i belongs to paths[i]; its code is None if
+// that file is valid. Each file is checked by itself: include is not followed
+// (fragments are linted as files of their own), so names repeated across
+// fragments are only reported by a load.
+std::vector<JsonError> lintConfigFiles(std::span<const std::wstring> paths);
+
+// Hash index of commands by name, for joining state to commands whatever their
+// order. It refers to the names in commands, which must stay unchanged while
+// it is used.
+struct CommandIndex {
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    std::unordered_map<std::wstring_view, size_t> byName;
+
+    explicit CommandIndex(const std::vector<CommandConfig>& commands);
+    // Index of the command named name, or npos
+    size_t find(std::wstring_view name) const;
+};
+
 std::wstring defaultConfigPath();
 
 // Creates a minimal, safe sample configuration file if missing.
@@ -51,7 +200,22 @@ std::wstring defaultConfigPath();
 // - Creates parent directory as needed.
 void ensureSampleConfigExists(const std::wstring& configPath);
 
-// Update root JSON based on commands[].lastRunUtc/lastExitCode changes
+// Update root JSON based on commands[].lastRunUtc/lastExitCode changes (root is
+// parsed from source first if loading did not build it)
 void applyCommandsToJson(AppConfig& cfg);
 
+// Rewrites configPath from its own parse events with the state of cfg.commands
+// applied, using bounded memory. The file must be the one cfg was loaded from.
+void writeConfigStreaming(const std::wstring& configPath, const AppConfig& cfg);
+
+// Persists commands[].lastRunUtc/lastExitCode. Changed values are spliced into
+// the original text when its byte ranges are known (formatting is preserved);
+// otherwise root is re-serialized, or writeConfigStreaming is used for a
+// streamed config. Fragment commands are written back into their own fragment.
+// If the file or a fragment was edited since cfg was loaded (commands reordered,
+// inserted, renamed, moved between files), it is loaded again first and the
+// state cfg changed is carried over by command name; cfg is replaced by that load.
+// A file is only read back for that check when its stamp has changed or is racy.
+void saveConfig(const std::wstring& configPath, AppConfig& cfg);
+
 } // namespace ler
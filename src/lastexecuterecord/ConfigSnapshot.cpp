@@ -0,0 +1,376 @@
+#include "ConfigSnapshot.h"
+#include "FileUtil.h"
+#include "Json.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ler {
+
+static constexpr char kSnapshotMagic[8] = { 'L', 'E', 'R', 'S', 'N', 'A', 'P', '1' };
+// bumped whenever the layout below or the meaning of a field changes (3: a
+// config with include has none, since it has no place for the include list)
+static constexpr std::uint32_t kSnapshotFormat = 3;
+
+// SnapshotCommand::flags
+static constexpr std::uint32_t kEnabled = 1;
+static constexpr std::uint32_t kHasLastRunUtc = 2;
+static constexpr std::uint32_t kHasLastExitCode = 4;
+
+namespace {
+
+// The file is the header followed by these sections, each padded to 8 bytes:
+//   SnapshotCommand[commandCount]
+//   uint32 argIds[argCount]           string ids of all args, command by command
+//   uint32 stringEnds[stringCount]    end of string i in chars; string 0 is ""
+//   uint16 chars[charCount]           UTF-16 code units of every distinct string
+// Native byte order: the snapshot is a cache for this machine, not an
+// interchange format.
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t format;
+    std::uint32_t stateStore;
+    // the config file it was compiled from
+    std::uint64_t jsonSize;
+    std::uint64_t jsonWriteTime;
+    std::uint64_t jsonHash;
+    // FILETIME when the jsonSize and jsonWriteTime were taken (a restore that
+    // verified the jsonHash moves it forward)
+    std::uint64_t writtenAt;
+    std::int64_t version;
+    std::int64_t defaultMinIntervalSeconds;
+    std::int64_t defaultTimeoutSeconds;
+    std::int64_t networkOption;
+    std::uint64_t commandCount;
+    std::uint64_t argCount;
+    std::uint64_t stringCount;
+    std::uint64_t charCount;
+    // contentHash of everything after the header
+    std::uint64_t bodyHash;
+};
+
+struct SnapshotCommand {
+    std::uint32_t name;
+    std::uint32_t exe;
+    std::uint32_t workingDirectory;
+    std::uint32_t lastRunUtc;
+    // argIds[firstArg, firstArg + argCount)
+    std::uint32_t firstArg;
+    std::uint32_t argCount;
+    std::uint32_t flags;
+    std::uint32_t present;
+    std::int64_t minIntervalSeconds;
+    std::int64_t timeoutSeconds;
+    std::int64_t lastExitCode;
+    std::uint64_t digestHash;
+    std::uint64_t digestLength;
+    // objectBegin, objectEnd, runBegin, runEnd, exitBegin, exitEnd
+    std::uint64_t span[6];
+};
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0 && sizeof(SnapshotCommand) % 8 == 0);
+
+// Distinct strings in first-seen order; most configs repeat a handful of
+// executables, directories and arguments across many commands.
+struct StringTable {
+    std::unordered_map<std::wstring_view, std::uint32_t> ids;
+    std::vector<std::uint32_t> ends;
+    std::vector<std::uint16_t> chars;
+
+    StringTable() { intern(L""); }
+
+    std::uint32_t intern(std::wstring_view s) {
+        auto [it, added] = ids.try_emplace(s, static_cast<std::uint32_t>(ends.size()));
+        if (added) {
+            for (wchar_t c : s) chars.push_back(static_cast<std::uint16_t>(c));
+            ends.push_back(static_cast<std::uint32_t>(chars.size()));
+        }
+        return it->second;
+    }
+};
+
+} // namespace
+
+std::wstring configSnapshotPath(const std::wstring& configPath) {
+    return configPath + L".snapshot";
+}
+
+template <class T>
+static void appendSection(std::string& out, const std::vector<T>& items) {
+    out.append(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+static bool encodeSnapshot(const AppConfig& cfg, const FileStamp& stamp, std::uint64_t jsonHash, std::string& out) {
+    StringTable strings;
+    std::vector<SnapshotCommand> commands(cfg.commands.size());
+    std::vector<std::uint32_t> argIds;
+    for (size_t i = 0; i < cfg.commands.size(); i++) {
+        const CommandConfig& c = cfg.commands[i];
+        const CommandSpan& span = cfg.commandSpans[i];
+        const CommandDigest& digest = cfg.commandDigests[i];
+        SnapshotCommand& s = commands[i];
+        s.name = strings.intern(c.name);
+        s.exe = strings.intern(c.exe);
+        s.workingDirectory = strings.intern(c.workingDirectory);
+        s.lastRunUtc = strings.intern(c.lastRunUtc);
+        s.firstArg = static_cast<std::uint32_t>(argIds.size());
+        s.argCount = static_cast<std::uint32_t>(c.args.size());
+        for (const SharedString& a : c.args) argIds.push_back(strings.intern(a));
+        s.flags = (c.enabled ? kEnabled : 0u) | (c.hasLastRunUtc ? kHasLastRunUtc : 0u) |
+            (c.hasLastExitCode ? kHasLastExitCode : 0u);
+        s.present = digest.present;
+        s.minIntervalSeconds = c.minIntervalSeconds;
+        s.timeoutSeconds = c.timeoutSeconds;
+        s.lastExitCode = c.lastExitCode;
+        s.digestHash = digest.hash;
+        s.digestLength = digest.length;
+        s.span[0] = span.objectBegin;
+        s.span[1] = span.objectEnd;
+        s.span[2] = span.runBegin;
+        s.span[3] = span.runEnd;
+        s.span[4] = span.exitBegin;
+        s.span[5] = span.exitEnd;
+    }
+    // ids and string ends are 32-bit
+    constexpr std::uint64_t kMax = std::numeric_limits<std::uint32_t>::max();
+    if (argIds.size() > kMax || strings.chars.size() > kMax) return false;
+
+    SnapshotHeader h{};
+    std::memcpy(h.magic, kSnapshotMagic, sizeof h.magic);
+    h.format = kSnapshotFormat;
+    h.jsonSize = stamp.size;
+    h.jsonWriteTime = stamp.lastWriteTime;
+    h.jsonHash = jsonHash;
+    h.writtenAt = cfg.stampTakenAt;
+    h.version = cfg.version;
+    h.defaultMinIntervalSeconds = cfg.defaultMinIntervalSeconds;
+    h.defaultTimeoutSeconds = cfg.defaultTimeoutSeconds;
+    h.networkOption = static_cast<std::int64_t>(cfg.networkOption);
+    h.stateStore = static_cast<std::uint32_t>(cfg.stateStore);
+    h.commandCount = commands.size();
+    h.argCount = argIds.size();
+    h.stringCount = strings.ends.size();
+    h.charCount = strings.chars.size();
+
+    out.assign(sizeof h, '\0');
+    appendSection(out, commands);
+    appendSection(out, argIds);
+    appendSection(out, strings.ends);
+    appendSection(out, strings.chars);
+    h.bodyHash = contentHash(std::string_view(out).substr(sizeof h));
+    std::memcpy(out.data(), &h, sizeof h);
+    return true;
+}
+
+// Points at count items of size bytes at pos and moves pos past them and their
+// padding; false if they do not fit in bytes.
+static bool takeSection(std::string_view bytes, size_t& pos, std::uint64_t count, size_t size, const char*& at) {
+    if (pos > bytes.size() || count > (bytes.size() - pos) / size) return false;
+    at = bytes.data() + pos;
+    pos += static_cast<size_t>(count) * size;
+    pos += (8 - pos % 8) % 8;
+    return true;
+}
+
+static bool decodeSnapshot(std::string_view bytes, const SnapshotHeader& h, AppConfig& cfg) {
+    if (contentHash(bytes.substr(sizeof h)) != h.bodyHash) return false;
+    size_t pos = sizeof h;
+    const char* commandsAt = nullptr;
+    const char* argIdsAt = nullptr;
+    const char* endsAt = nullptr;
+    const char* charsAt = nullptr;
+    if (!takeSection(bytes, pos, h.commandCount, sizeof(SnapshotCommand), commandsAt) ||
+        !takeSection(bytes, pos, h.argCount, sizeof(std::uint32_t), argIdsAt) ||
+        !takeSection(bytes, pos, h.stringCount, sizeof(std::uint32_t), endsAt) ||
+        !takeSection(bytes, pos, h.charCount, sizeof(std::uint16_t), charsAt) ||
+        pos != bytes.size()) {
+        return false;
+    }
+    if (h.networkOption < 0 || h.networkOption > 2 || h.stateStore > 1) return false;
+
+    // the sections are not necessarily aligned for their type in the mapping
+    std::vector<std::uint32_t> ends(static_cast<size_t>(h.stringCount));
+    if (!ends.empty()) std::memcpy(ends.data(), endsAt, ends.size() * sizeof(std::uint32_t));
+    std::uint32_t prev = 0;
+    for (std::uint32_t end : ends) {
+        if (end < prev) return false;
+        prev = end;
+    }
+    if (prev != h.charCount) return false;
+    std::vector<std::uint32_t> argIds(static_cast<size_t>(h.argCount));
+    if (!argIds.empty()) std::memcpy(argIds.data(), argIdsAt, argIds.size() * sizeof(std::uint32_t));
+
+    auto text = [&](std::uint32_t id, std::wstring& out) {
+        if (id >= ends.size()) return false;
+        size_t begin = id == 0 ? 0 : ends[id - 1];
+        size_t count = ends[id] - begin;
+        const char* src = charsAt + begin * sizeof(std::uint16_t);
+        out.resize(count);
+        if constexpr (sizeof(wchar_t) == sizeof(std::uint16_t)) {
+            std::memcpy(out.data(), src, count * sizeof(std::uint16_t));
+        }
+        else {
+            for (size_t k = 0; k < count; k++) {
+                std::uint16_t unit;
+                std::memcpy(&unit, src + k * sizeof unit, sizeof unit);
+                out[k] = unit;
+            }
+        }
+        return true;
+    };
+    // the strings commands share, each decoded once
+    std::vector<SharedString> shared(ends.size());
+    std::vector<bool> decoded(ends.size());
+    std::wstring scratch;
+    auto sharedText = [&](std::uint32_t id, SharedString& out) {
+        if (id >= ends.size()) return false;
+        if (!decoded[id]) {
+            if (!text(id, scratch)) return false;
+            shared[id] = cfg.strings.intern(scratch);
+            decoded[id] = true;
+        }
+        out = shared[id];
+        return true;
+    };
+
+    size_t n = static_cast<size_t>(h.commandCount);
+    cfg.version = h.version;
+    cfg.defaultMinIntervalSeconds = h.defaultMinIntervalSeconds;
+    cfg.defaultTimeoutSeconds = h.defaultTimeoutSeconds;
+    cfg.networkOption = static_cast<NetworkOption>(h.networkOption);
+    cfg.stateStore = static_cast<StateStore>(h.stateStore);
+    cfg.commands.resize(n);
+    cfg.commandSpans.resize(n);
+    cfg.commandDigests.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        SnapshotCommand s;
+        std::memcpy(&s, commandsAt + i * sizeof s, sizeof s);
+        CommandConfig& c = cfg.commands[i];
+        if (!text(s.name, c.name) || !sharedText(s.exe, c.exe) || !sharedText(s.workingDirectory, c.workingDirectory) ||
+            !text(s.lastRunUtc, c.lastRunUtc)) {
+            return false;
+        }
+        if (s.firstArg > argIds.size() || s.argCount > argIds.size() - s.firstArg) return false;
+        c.args.resize(s.argCount);
+        for (std::uint32_t k = 0; k < s.argCount; k++) {
+            if (!sharedText(argIds[s.firstArg + k], c.args[k])) return false;
+        }
+        c.enabled = (s.flags & kEnabled) != 0;
+        c.hasLastRunUtc = (s.flags & kHasLastRunUtc) != 0;
+        c.hasLastExitCode = (s.flags & kHasLastExitCode) != 0;
+        c.minIntervalSeconds = s.minIntervalSeconds;
+        c.timeoutSeconds = s.timeoutSeconds;
+        c.lastExitCode = s.lastExitCode;
+
+        CommandSpan& span = cfg.commandSpans[i];
+        span.objectBegin = static_cast<size_t>(s.span[0]);
+        span.objectEnd = static_cast<size_t>(s.span[1]);
+        span.runBegin = static_cast<size_t>(s.span[2]);
+        span.runEnd = static_cast<size_t>(s.span[3]);
+        span.exitBegin = static_cast<size_t>(s.span[4]);
+        span.exitEnd = static_cast<size_t>(s.span[5]);
+        cfg.commandDigests[i] = { s.digestHash, static_cast<size_t>(s.digestLength), s.present };
+    }
+    shared.clear();
+    cfg.strings.pruneUnshared();
+    return true;
+}
+
+bool loadConfigSnapshot(const std::wstring& configPath, AppConfig& cfg, std::pmr::memory_resource* mr,
+    AppConfig* stale) {
+    std::wstring path = configSnapshotPath(configPath);
+    // a racy snapshot that checked out, with its writtenAt moved forward
+    std::string settled;
+    try {
+        if (!fileExists(path)) return false;
+        MappedFile file(path);
+        std::string_view bytes = file.text;
+        SnapshotHeader h;
+        if (bytes.size() < sizeof h) return false;
+        std::memcpy(&h, bytes.data(), sizeof h);
+        if (std::memcmp(h.magic, kSnapshotMagic, sizeof h.magic) != 0 || h.format != kSnapshotFormat) return false;
+
+        std::uint64_t takenAt = currentFileTime();
+        FileStamp stamp = getFileStamp(configPath);
+        bool current = stamp.size == h.jsonSize && stamp.lastWriteTime == h.jsonWriteTime;
+        std::shared_ptr<const std::string> source;
+        // a racy stamp (see kRacyStampTicks): the contentHash decides
+        if (current && h.writtenAt < h.jsonWriteTime + kRacyStampTicks) {
+            source = std::make_shared<const std::string>(readUtf8File(configPath));
+            current = contentHash(*source) == h.jsonHash;
+        }
+        if (!current) {
+            AppConfig earlier;
+            if (stale && decodeSnapshot(bytes, h, earlier)) {
+                earlier.rootResource = mr;
+                earlier.textHash = h.jsonHash;
+                *stale = std::move(earlier);
+            }
+            return false;
+        }
+
+        AppConfig restored;
+        if (!decodeSnapshot(bytes, h, restored)) return false;
+        restored.rootResource = mr;
+        restored.source = std::move(source);
+        restored.textHash = h.jsonHash;
+        restored.fileSize = stamp.size;
+        restored.fileWriteTime = stamp.lastWriteTime;
+        restored.stampTakenAt = takenAt;
+        cfg = std::move(restored);
+
+        std::uint64_t now = currentFileTime();
+        if (cfg.source && now >= h.jsonWriteTime + kRacyStampTicks) {
+            // the file has now been stable long enough for its stamp alone to
+            // vouch for it, so later runs can skip reading it
+            h.writtenAt = now;
+            settled.assign(bytes);
+            std::memcpy(settled.data(), &h, sizeof h);
+        }
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    if (!settled.empty()) {
+        try {
+            writeUtf8FileAtomic(path, settled);
+        }
+        catch (const std::exception&) {
+            // the snapshot stays racy; the next run checks the hash again
+        }
+    }
+    return true;
+}
+
+bool writeConfigSnapshot(const std::wstring& configPath, const AppConfig& cfg) {
+    size_t n = cfg.commands.size();
+    if (cfg.streamed || !cfg.includes.empty() || cfg.commandSpans.size() != n || cfg.commandDigests.size() != n) {
+        return false;
+    }
+    try {
+        // the file is not read back: a stamp that moved since cfg was loaded or
+        // saved means it was edited (or fully rewritten, which the spans do not
+        // index). One that could not have moved is racy as of stampTakenAt, so
+        // the first restore compares the jsonHash of the text cfg describes.
+        FileStamp stamp = getFileStamp(configPath);
+        if (stamp.size != cfg.fileSize || stamp.lastWriteTime != cfg.fileWriteTime) return false;
+        std::uint64_t jsonHash = !cfg.patched.empty() ? contentHash(cfg.patched)
+            : cfg.source ? contentHash(*cfg.source) : cfg.textHash;
+
+        std::string bytes;
+        if (!encodeSnapshot(cfg, stamp, jsonHash, bytes)) return false;
+        writeUtf8FileAtomic(configSnapshotPath(configPath), bytes);
+        return true;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+} // namespace ler
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory_resource>
+#include <string>
+
+#include "Config.h"
+
+namespace ler {
+
+// A compiled image of a validated AppConfig kept beside the config file: the
+// resolved defaults, a flat command table and interned UTF-16 strings. It is
+// keyed by the JSON file's size, last write time and contentHash, so a run whose
+// config has not changed maps it instead of parsing and validating the JSON.
+std::wstring configSnapshotPath(const std::wstring& configPath);
+
+// Fills cfg from the snapshot of configPath and returns true, or returns false
+// (cfg untouched) if there is none or it does not match the file as it is now.
+// A missing, stale or damaged snapshot is never an error. Full rewrites of the
+// restored config allocate AppConfig::root from mr.
+// A snapshot that is intact but was compiled from an earlier version of the
+// file is decoded into *stale, if given: passed as previous to
+// loadAndValidateConfig, it spares reading the commands that were not edited.
+bool loadConfigSnapshot(const std::wstring& configPath, AppConfig& cfg,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource(), AppConfig* stale = nullptr);
+
+// Compiles cfg into the snapshot of configPath. cfg must describe the file as it
+// is now: nothing is written if the file's size or last write time moved since
+// cfg was loaded (or last saved); the file is not read. Best effort; returns
+// false instead of throwing. A config with include gets none: each of its
+// fragments has a snapshot of its own, written when the fragment is loaded or
+// saved.
+bool writeConfigSnapshot(const std::wstring& configPath, const AppConfig& cfg);
+
+} // namespace ler
@@ -1,5 +1,7 @@
 ﻿#include "FileUtil.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <stdexcept>
 #include <vector>
 
@@ -31,7 +33,7 @@ bool fileExists(const std::wstring& path) {
     return (a & FILE_ATTRIBUTE_DIRECTORY) == 0;
 }
 
-static bool directoryExists(const std::wstring& path) {
+bool directoryExists(const std::wstring& path) {
     DWORD a = GetFileAttributesW(path.c_str());
     if (a == INVALID_FILE_ATTRIBUTES) return false;
     return (a & FILE_ATTRIBUTE_DIRECTORY) != 0;
@@ -95,7 +97,7 @@ static std::wstring utf8ToWString(const std::string& s) {
     return w;
 }
 
-static std::string wStringToUtf8(const std::wstring& w) {
+std::string wStringToUtf8(const std::wstring& w) {
     if (w.empty()) return "";
     int n = WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, w.data(), static_cast<int>(w.size()), nullptr, 0, nullptr, nullptr);
     if (n <= 0) throw win32Error("WideCharToMultiByte failed");
@@ -106,7 +108,7 @@ static std::string wStringToUtf8(const std::wstring& w) {
     return s;
 }
 
-std::wstring readUtf8FileToWString(const std::wstring& path) {
+std::string readUtf8File(const std::wstring& path) {
     HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
         nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
     if (h == INVALID_HANDLE_VALUE) throw win32Error("CreateFileW(read) failed");
@@ -116,7 +118,7 @@ std::wstring readUtf8FileToWString(const std::wstring& path) {
         CloseHandle(h);
         throw win32Error("GetFileSizeEx failed");
     }
-    if (size.QuadPart > 64LL * 1024LL * 1024LL) {
+    if (static_cast<std::uint64_t>(size.QuadPart) > kMaxReadFileBytes) {
         CloseHandle(h);
         throw std::runtime_error("Config file too large");
     }
@@ -139,33 +141,192 @@ std::wstring readUtf8FileToWString(const std::wstring& path) {
         static_cast<unsigned char>(bytes[0]) == 0xEF &&
         static_cast<unsigned char>(bytes[1]) == 0xBB &&
         static_cast<unsigned char>(bytes[2]) == 0xBF) {
-        bytes = bytes.substr(3);
+        bytes.erase(0, 3);
     }
-    return utf8ToWString(bytes);
+    return bytes;
+}
+
+std::wstring readUtf8FileToWString(const std::wstring& path) {
+    return utf8ToWString(readUtf8File(path));
 }
 
 void writeWStringToUtf8FileAtomic(const std::wstring& path, const std::wstring& content) {
-    std::wstring dir = getDirectoryName(path);
-    std::wstring tmp = path + L".tmp";
+    writeUtf8FileAtomic(path, wStringToUtf8(content));
+}
 
-    std::string bytes = wStringToUtf8(content);
+void writeUtf8FileAtomic(const std::wstring& path, std::string_view bytes) {
+    AtomicFileWriter out(path);
+    out.write(bytes);
+    out.commit();
+}
 
-    HANDLE h = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (h == INVALID_HANDLE_VALUE) throw win32Error("CreateFileW(write tmp) failed");
+void appendToFile(const std::wstring& path, std::string_view bytes) {
+    HANDLE h = CreateFileW(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) throw win32Error("CreateFileW(append) failed");
 
     DWORD written = 0;
-    if (!bytes.empty()) {
-        if (!WriteFile(h, bytes.data(), static_cast<DWORD>(bytes.size()), &written, nullptr) || written != bytes.size()) {
-            CloseHandle(h);
-            DeleteFileW(tmp.c_str());
+    bool ok = WriteFile(h, bytes.data(), static_cast<DWORD>(bytes.size()), &written, nullptr) &&
+        written == bytes.size() && FlushFileBuffers(h);
+    DWORD e = GetLastError();
+    CloseHandle(h);
+    if (!ok) {
+        SetLastError(e);
+        throw win32Error("WriteFile(append) failed");
+    }
+}
+
+std::uint64_t getFileSizeBytes(const std::wstring& path) {
+    WIN32_FILE_ATTRIBUTE_DATA data{};
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+        throw win32Error("GetFileAttributesExW failed");
+    }
+    return (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+}
+
+static std::uint64_t fileTimeTicks(const FILETIME& ft) {
+    return (static_cast<std::uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+FileStamp getFileStamp(const std::wstring& path) {
+    WIN32_FILE_ATTRIBUTE_DATA data{};
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+        throw win32Error("GetFileAttributesExW failed");
+    }
+    FileStamp stamp;
+    stamp.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    stamp.lastWriteTime = fileTimeTicks(data.ftLastWriteTime);
+    return stamp;
+}
+
+std::uint64_t currentFileTime() {
+    FILETIME ft{};
+    GetSystemTimeAsFileTime(&ft);
+    return fileTimeTicks(ft);
+}
+
+static bool hasExtension(const std::wstring& name, const std::wstring& extWithDot) {
+    if (name.size() < extWithDot.size()) return false;
+    size_t at = name.size() - extWithDot.size();
+    for (size_t k = 0; k < extWithDot.size(); k++) {
+        wchar_t a = name[at + k];
+        wchar_t b = extWithDot[k];
+        if (a >= L'A' && a <= L'Z') a = static_cast<wchar_t>(a - L'A' + L'a');
+        if (b >= L'A' && b <= L'Z') b = static_cast<wchar_t>(b - L'A' + L'a');
+        if (a != b) return false;
+    }
+    return true;
+}
+
+std::vector<std::wstring> listFilesRecursive(const std::wstring& dir, const std::wstring& extWithDot) {
+    std::vector<std::wstring> files;
+    std::vector<std::wstring> pending{ dir };
+    while (!pending.empty()) {
+        std::wstring current = std::move(pending.back());
+        pending.pop_back();
+
+        WIN32_FIND_DATAW fd;
+        HANDLE h = FindFirstFileExW(joinPath(current, L"*").c_str(), FindExInfoBasic, &fd,
+            FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (h == INVALID_HANDLE_VALUE) {
+            if (GetLastError() == ERROR_FILE_NOT_FOUND) continue;
+            if (current == dir) throw win32Error("FindFirstFileExW failed");
+            continue;
+        }
+        do {
+            std::wstring name = fd.cFileName;
+            if (name == L"." || name == L"..") continue;
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) pending.push_back(joinPath(current, name));
+            }
+            else if (hasExtension(name, extWithDot)) {
+                files.push_back(joinPath(current, name));
+            }
+        } while (FindNextFileW(h, &fd));
+        FindClose(h);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+MappedFile::MappedFile(const std::wstring& path) {
+    file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw win32Error("CreateFileW(read) failed");
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw win32Error("GetFileSizeEx failed");
+    }
+    // an empty file cannot be mapped; text stays empty
+    if (size.QuadPart == 0) return;
+    if (static_cast<std::uint64_t>(size.QuadPart) > static_cast<std::uint64_t>(SIZE_MAX)) {
+        CloseHandle(file);
+        throw std::runtime_error("Config file too large to map");
+    }
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        throw win32Error("CreateFileMappingW failed");
+    }
+    view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw win32Error("MapViewOfFile failed");
+    }
+
+    text = std::string_view(view, static_cast<size_t>(size.QuadPart));
+    // strip UTF-8 BOM
+    if (text.size() >= 3 &&
+        static_cast<unsigned char>(text[0]) == 0xEF &&
+        static_cast<unsigned char>(text[1]) == 0xBB &&
+        static_cast<unsigned char>(text[2]) == 0xBF) {
+        text.remove_prefix(3);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (view) UnmapViewOfFile(view);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+AtomicFileWriter::AtomicFileWriter(const std::wstring& targetPath)
+    : path(targetPath), tmp(targetPath + L".tmp") {
+    h = CreateFileW(tmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) throw win32Error("CreateFileW(write tmp) failed");
+}
+
+AtomicFileWriter::~AtomicFileWriter() {
+    if (h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
+        DeleteFileW(tmp.c_str());
+    }
+}
+
+void AtomicFileWriter::write(std::string_view bytes) {
+    while (!bytes.empty()) {
+        DWORD chunk = static_cast<DWORD>(bytes.size() > 0x40000000u ? 0x40000000u : bytes.size());
+        DWORD written = 0;
+        if (!WriteFile(h, bytes.data(), chunk, &written, nullptr) || written != chunk) {
             throw win32Error("WriteFile failed");
         }
+        bytes.remove_prefix(chunk);
     }
+}
+
+void AtomicFileWriter::commit() {
     FlushFileBuffers(h);
     CloseHandle(h);
+    h = INVALID_HANDLE_VALUE;
 
     if (!MoveFileExW(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DWORD e = GetLastError();
         DeleteFileW(tmp.c_str());
+        SetLastError(e);
         throw win32Error("MoveFileExW failed");
     }
 }
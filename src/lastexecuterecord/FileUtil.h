@@ -1,6 +1,9 @@
 ﻿#pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <Windows.h>
 
 namespace ler {
@@ -13,11 +16,75 @@ std::wstring joinPath(const std::wstring& dir, const std::wstring& leaf);
 // Win32 helpers
 std::wstring getEnvVar(const wchar_t* name);
 bool fileExists(const std::wstring& path);
+bool directoryExists(const std::wstring& path);
 void ensureDirectoryExists(const std::wstring& path);
 
 // UTF-8 file IO (accepts UTF-8 with/without BOM)
+// readUtf8File returns the raw bytes with any BOM stripped (no transcoding).
+// Files larger than kMaxReadFileBytes are rejected; use MappedFile for those.
+constexpr std::uint64_t kMaxReadFileBytes = 64ull * 1024 * 1024;
+std::string readUtf8File(const std::wstring& path);
 std::wstring readUtf8FileToWString(const std::wstring& path);
 void writeWStringToUtf8FileAtomic(const std::wstring& path, const std::wstring& content);
+void writeUtf8FileAtomic(const std::wstring& path, std::string_view bytes);
+// Appends bytes to path (created if missing) with a single write and flushes
+// them to disk before returning.
+void appendToFile(const std::wstring& path, std::string_view bytes);
+// UTF-16 to UTF-8; throws on unpaired surrogates.
+std::string wStringToUtf8(const std::wstring& w);
+
+std::uint64_t getFileSizeBytes(const std::wstring& path);
+
+// Size and last write time (FILETIME ticks) of a file, from one attribute query.
+struct FileStamp {
+    std::uint64_t size = 0;
+    std::uint64_t lastWriteTime = 0;
+
+    bool operator==(const FileStamp&) const = default;
+};
+FileStamp getFileStamp(const std::wstring& path);
+// The current UTC time in FILETIME ticks, comparable with FileStamp::lastWriteTime.
+std::uint64_t currentFileTime();
+// A file written less than this long (2 s in FILETIME ticks) before its stamp
+// was taken could change again without its size or last write time moving
+// (timestamps are coarse on some file systems), so the stamp alone cannot vouch
+// for its contents.
+constexpr std::uint64_t kRacyStampTicks = 2ull * 10'000'000;
+
+// Files below dir, at any depth, whose name ends with extWithDot (ignoring
+// ASCII case), sorted. Reparse points (junctions, symlinks) are not followed and
+// unreadable subdirectories are skipped; an unreadable dir itself throws.
+std::vector<std::wstring> listFilesRecursive(const std::wstring& dir, const std::wstring& extWithDot);
+
+// Read-only memory mapping of a whole UTF-8 file. Keeps large files out of the
+// private heap; text excludes the BOM and is valid while the object lives.
+struct MappedFile {
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const char* view = nullptr;
+    std::string_view text;
+
+    explicit MappedFile(const std::wstring& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+};
+
+// Streams bytes to <path>.tmp and atomically replaces path on commit().
+// An uncommitted writer deletes its temp file on destruction.
+struct AtomicFileWriter {
+    std::wstring path;
+    std::wstring tmp;
+    HANDLE h = INVALID_HANDLE_VALUE;
+
+    explicit AtomicFileWriter(const std::wstring& targetPath);
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+    ~AtomicFileWriter();
+
+    void write(std::string_view bytes);
+    void commit();
+};
 
 // simple lock using exclusive open
 struct FileLock {
@@ -1,8 +1,19 @@
 #include "Json.h"
 
-#include <cwctype>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
 #include <limits>
-#include <sstream>
+#include <span>
+#include <string_view>
+
+// SSE2 is part of the x64 baseline (and of /arch:SSE2 x86 builds); other targets
+// such as ARM64 use the scalar loops below.
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define LER_JSON_SSE2 1
+#endif
 
 namespace ler {
 
@@ -12,98 +23,551 @@ static std::string narrowContext(const wchar_t* wctx) {
     return std::string(ws.begin(), ws.end());
 }
 
-const JsonValue* JsonValue::tryGet(const std::wstring& key) const {
-    if (type != Type::Object) return nullptr;
-    for (const auto& kv : o) {
-        if (kv.first == key) return &kv.second;
+// "Expected string at <ctx>" and the like
+static JsonParseError typeError(const char* what, const wchar_t* ctx, size_t offset = JsonParseError::npos) {
+    return JsonParseError(what + narrowContext(ctx), offset, JsonErrorCode::Type);
+}
+
+static bool fitsInt64(double d) {
+    return d >= static_cast<double>(std::numeric_limits<std::int64_t>::min()) &&
+        d <= static_cast<double>(std::numeric_limits<std::int64_t>::max());
+}
+
+const JsonValue::Array& JsonValue::items() const {
+    if (!isArray()) throw std::runtime_error("JsonValue is not an array");
+    return std::get<Array>(v_);
+}
+
+JsonValue::Array& JsonValue::items() {
+    if (!isArray()) throw std::runtime_error("JsonValue is not an array");
+    return std::get<Array>(v_);
+}
+
+// Open-addressing table of member positions (slot value = position + 1, 0 = empty).
+// Keys are compared against members[pos].first, so the table never owns strings.
+struct JsonValue::KeyIndex {
+    std::pmr::vector<std::uint32_t> slots;
+    size_t covered = 0;
+
+    explicit KeyIndex(std::pmr::memory_resource* mr) : slots(mr) {}
+
+    static size_t hashKey(std::wstring_view key) {
+        // FNV-1a over UTF-16 code units
+        std::uint64_t h = 14695981039346656037ULL;
+        for (wchar_t c : key) {
+            h ^= static_cast<std::uint16_t>(c);
+            h *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(h ^ (h >> 32));
     }
-    return nullptr;
+
+    void build(const Object& members) {
+        size_t cap = 16;
+        while (cap < members.size() * 2) cap <<= 1;
+        slots.assign(cap, 0);
+        covered = 0;
+        for (size_t i = 0; i < members.size(); i++) add(members, i);
+    }
+
+    // Indexes members[pos]; the first occurrence of a duplicate key wins, as with
+    // a linear scan.
+    void add(const Object& members, size_t pos) {
+        if ((covered + 1) * 2 > slots.size()) {
+            build(members);
+            return;
+        }
+        size_t mask = slots.size() - 1;
+        std::wstring_view key(members[pos].first);
+        for (size_t i = hashKey(key) & mask;; i = (i + 1) & mask) {
+            if (slots[i] == 0) {
+                slots[i] = static_cast<std::uint32_t>(pos + 1);
+                break;
+            }
+            if (std::wstring_view(members[slots[i] - 1].first) == key) break;
+        }
+        covered = pos + 1;
+    }
+
+    const JsonValue* find(const Object& members, std::wstring_view key, size_t hash) const {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+            const auto& kv = members[slots[i] - 1];
+            if (std::wstring_view(kv.first) == key) return &kv.second;
+        }
+        return nullptr;
+    }
+};
+
+JsonValue::ObjectStorage::ObjectStorage(Object m) : members(std::move(m)) {
+    indexIfWide();
+}
+
+JsonValue::ObjectStorage::ObjectStorage(const ObjectStorage& other) : members(other.members) {
+    indexIfWide();
+}
+
+JsonValue::ObjectStorage::ObjectStorage(ObjectStorage&& other) noexcept = default;
+JsonValue::ObjectStorage::~ObjectStorage() = default;
+
+JsonValue::ObjectStorage& JsonValue::ObjectStorage::operator=(const ObjectStorage& other) {
+    if (this != &other) {
+        members = other.members;
+        index.reset();
+        indexIfWide();
+    }
+    return *this;
 }
 
-JsonValue* JsonValue::tryGet(const std::wstring& key) {
-    if (type != Type::Object) return nullptr;
-    for (auto& kv : o) {
-        if (kv.first == key) return &kv.second;
+JsonValue::ObjectStorage& JsonValue::ObjectStorage::operator=(ObjectStorage&& other) noexcept {
+    if (this == &other) return *this;
+    // Assigning members across resources would copy them into this one, which
+    // allocates; the storage is taken over instead, resource and all, as it is
+    // when an object replaces a value of another type.
+    if (members.get_allocator() == other.members.get_allocator()) {
+        members = std::move(other.members);
+    }
+    else {
+        std::destroy_at(&members);
+        std::construct_at(&members, std::move(other.members));
+    }
+    index = std::move(other.index);
+    return *this;
+}
+
+void JsonValue::ObjectStorage::indexIfWide() {
+    if (members.size() < kIndexThreshold || (index && index->covered == members.size())) return;
+    if (!index) index = std::make_unique<KeyIndex>(members.get_allocator().resource());
+    index->build(members);
+}
+
+const JsonValue* JsonValue::ObjectStorage::find(std::wstring_view key) const {
+    return find(key, members.size() < kIndexThreshold ? 0 : KeyIndex::hashKey(key));
+}
+
+const JsonValue* JsonValue::ObjectStorage::find(std::wstring_view key, size_t hash) const {
+    if (index && index->covered == members.size()) return index->find(members, key, hash);
+    // narrow, or members() was handed out since the index was dropped
+    for (const auto& kv : members) {
+        if (std::wstring_view(kv.first) == key) return &kv.second;
     }
     return nullptr;
 }
 
-const std::wstring& JsonValue::asString(const wchar_t* ctx) const {
-    if (type != Type::String) {
-        throw JsonParseError("Expected string at " + narrowContext(ctx));
+const JsonValue::Object& JsonValue::members() const {
+    if (!isObject()) throw std::runtime_error("JsonValue is not an object");
+    return std::get<ObjectStorage>(v_).members;
+}
+
+JsonValue::Object& JsonValue::members() {
+    if (!isObject()) throw std::runtime_error("JsonValue is not an object");
+    ObjectStorage& o = std::get<ObjectStorage>(v_);
+    // the caller may reorder or rename keys, so the index cannot be trusted
+    // afterwards; the next non-const lookup builds it again
+    o.index.reset();
+    return o.members;
+}
+
+const JsonValue* JsonValue::tryGet(std::wstring_view key) const {
+    const ObjectStorage* o = std::get_if<ObjectStorage>(&v_);
+    if (!o) return nullptr;
+    return o->find(key);
+}
+
+JsonValue* JsonValue::tryGet(std::wstring_view key) {
+    ObjectStorage* o = std::get_if<ObjectStorage>(&v_);
+    if (!o) return nullptr;
+    o->indexIfWide();
+    return const_cast<JsonValue*>(o->find(key));
+}
+
+JsonValue& JsonValue::set(std::wstring_view key, JsonValue value) {
+    ObjectStorage* o = std::get_if<ObjectStorage>(&v_);
+    if (!o) throw std::runtime_error("JsonValue is not an object");
+    o->indexIfWide();
+    if (JsonValue* existing = const_cast<JsonValue*>(o->find(key))) {
+        *existing = std::move(value);
+        return *existing;
+    }
+    // the key is allocated from the object's own resource
+    o->members.emplace_back(key, std::move(value));
+    if (o->index) o->index->add(o->members, o->members.size() - 1);
+    else o->indexIfWide();
+    return o->members.back().second;
+}
+
+const JsonValue::String& JsonValue::asString(const wchar_t* ctx) const {
+    const String* s = std::get_if<String>(&v_);
+    if (!s) {
+        throw typeError("Expected string at ", ctx);
     }
-    return s;
+    return *s;
 }
 
 std::int64_t JsonValue::asInt(const wchar_t* ctx) const {
-    if (type == Type::Int) return i;
-    if (type == Type::Double) {
-        if (d < static_cast<double>(std::numeric_limits<std::int64_t>::min()) ||
-            d > static_cast<double>(std::numeric_limits<std::int64_t>::max())) {
-            throw JsonParseError("Number out of int64 range at " + narrowContext(ctx));
-        }
-        return static_cast<std::int64_t>(d);
+    if (const std::int64_t* i = std::get_if<std::int64_t>(&v_)) return *i;
+    if (const double* d = std::get_if<double>(&v_)) {
+        if (!fitsInt64(*d)) throw typeError("Number out of int64 range at ", ctx);
+        return static_cast<std::int64_t>(*d);
     }
-    throw JsonParseError("Expected number at " + narrowContext(ctx));
+    throw typeError("Expected number at ", ctx);
+}
+
+double JsonValue::asDouble(const wchar_t* ctx) const {
+    if (const double* d = std::get_if<double>(&v_)) return *d;
+    if (const std::int64_t* i = std::get_if<std::int64_t>(&v_)) return static_cast<double>(*i);
+    throw typeError("Expected number at ", ctx);
 }
 
 bool JsonValue::asBool(const wchar_t* ctx) const {
-    if (type != Type::Bool) {
-        throw JsonParseError("Expected bool at " + narrowContext(ctx));
+    const bool* b = std::get_if<bool>(&v_);
+    if (!b) {
+        throw typeError("Expected bool at ", ctx);
+    }
+    return *b;
+}
+
+JsonPointer::JsonPointer(std::wstring_view pointer) : text_(pointer) {
+    if (pointer.empty()) return;
+    if (pointer[0] != L'/') throw JsonParseError("JSON Pointer must start with /", 0);
+    size_t pos = 1;
+    while (true) {
+        size_t end = std::min(pointer.find(L'/', pos), pointer.size());
+        Step st;
+        for (size_t i = pos; i < end; i++) {
+            wchar_t c = pointer[i];
+            if (c == L'~') {
+                wchar_t e = i + 1 < end ? pointer[++i] : L'\0';
+                if (e == L'0') c = L'~';
+                else if (e == L'1') c = L'/';
+                else throw JsonParseError("Invalid ~ escape in JSON Pointer", i);
+            }
+            st.key.push_back(c);
+        }
+        st.hash = JsonValue::KeyIndex::hashKey(st.key);
+        // "0" or a digit string without leading zeros; one past size_t (which
+        // differs between Win32 and x64) is no index at all
+        st.index = std::wstring_view::npos;
+        if (!st.key.empty() && (st.key[0] != L'0' || st.key.size() == 1) &&
+            std::all_of(st.key.begin(), st.key.end(), [](wchar_t c) { return c >= L'0' && c <= L'9'; })) {
+            std::string digits(st.key.begin(), st.key.end());
+            size_t index = 0;
+            auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), index);
+            if (ec == std::errc()) st.index = index;
+        }
+        steps_.push_back(std::move(st));
+        if (end == pointer.size()) break;
+        pos = end + 1;
+    }
+}
+
+const JsonValue* JsonPointer::step(const JsonValue& v, const Step& s) {
+    if (const auto* o = std::get_if<JsonValue::ObjectStorage>(&v.v_)) return o->find(s.key, s.hash);
+    if (const auto* a = std::get_if<JsonValue::Array>(&v.v_)) {
+        return s.index < a->size() ? &(*a)[s.index] : nullptr;
+    }
+    return nullptr;
+}
+
+const JsonValue* JsonPointer::find(const JsonValue& root) const {
+    const JsonValue* v = &root;
+    for (const Step& s : steps_) {
+        v = step(*v, s);
+        if (!v) return nullptr;
+    }
+    return v;
+}
+
+JsonValue* JsonPointer::find(JsonValue& root) const {
+    return const_cast<JsonValue*>(find(static_cast<const JsonValue&>(root)));
+}
+
+JsonPointerSet::JsonPointerSet(std::span<const JsonPointer> pointers) : count_(pointers.size()) {
+    // build the tree, then lay it out in preorder
+    struct TreeNode {
+        const JsonPointer::Step* step = nullptr;
+        std::vector<size_t> children;
+        std::vector<size_t> targets;
+    };
+    std::vector<TreeNode> tree(1);
+    for (size_t i = 0; i < pointers.size(); i++) {
+        size_t at = 0;
+        for (const JsonPointer::Step& s : pointers[i].steps_) {
+            size_t next = 0;
+            for (size_t c : tree[at].children) {
+                if (tree[c].step->key == s.key) {
+                    next = c;
+                    break;
+                }
+            }
+            if (next == 0) {
+                next = tree.size();
+                tree[at].children.push_back(next);
+                tree.push_back(TreeNode{ &s, {}, {} });
+            }
+            at = next;
+        }
+        tree[at].targets.push_back(i);
+    }
+
+    std::vector<std::pair<size_t, size_t>> stack{ { 0, 0 } };
+    std::vector<size_t> open;
+    while (!stack.empty()) {
+        auto [t, depth] = stack.back();
+        stack.pop_back();
+        while (!open.empty() && nodes_[open.back()].depth >= depth) {
+            nodes_[open.back()].subtreeEnd = nodes_.size();
+            open.pop_back();
+        }
+        Node n;
+        if (tree[t].step) n.step = *tree[t].step;
+        n.depth = depth;
+        n.firstTarget = targets_.size();
+        targets_.insert(targets_.end(), tree[t].targets.begin(), tree[t].targets.end());
+        n.lastTarget = targets_.size();
+        maxDepth_ = std::max(maxDepth_, depth);
+        open.push_back(nodes_.size());
+        nodes_.push_back(std::move(n));
+        for (size_t k = tree[t].children.size(); k-- > 0;) stack.emplace_back(tree[t].children[k], depth + 1);
+    }
+    for (size_t i : open) nodes_[i].subtreeEnd = nodes_.size();
+}
+
+void JsonPointerSet::findAll(const JsonValue& root, std::span<const JsonValue*> results) const {
+    if (results.size() < count_) throw std::runtime_error("JsonPointerSet::findAll: results too small");
+    std::fill(results.begin(), results.begin() + static_cast<std::ptrdiff_t>(count_), nullptr);
+
+    // path[d] is the value reached at depth d
+    const JsonValue* fixed[16];
+    std::vector<const JsonValue*> grown;
+    const JsonValue** path = fixed;
+    if (maxDepth_ >= std::size(fixed)) {
+        grown.resize(maxDepth_ + 1);
+        path = grown.data();
+    }
+    path[0] = &root;
+    for (size_t t = nodes_[0].firstTarget; t < nodes_[0].lastTarget; t++) results[targets_[t]] = &root;
+    // the previous node's value, which is the parent whenever we go one deeper
+    const JsonValue* last = &root;
+    size_t lastDepth = 0;
+    size_t i = 1;
+    while (i < nodes_.size()) {
+        const Node& n = nodes_[i];
+        const JsonValue* parent = n.depth == lastDepth + 1 ? last : path[n.depth - 1];
+        const JsonValue* v = JsonPointer::step(*parent, n.step);
+        if (!v) {
+            i = n.subtreeEnd;
+            last = parent;
+            lastDepth = n.depth - 1;
+            continue;
+        }
+        path[n.depth] = v;
+        last = v;
+        lastDepth = n.depth;
+        for (size_t t = n.firstTarget; t < n.lastTarget; t++) results[targets_[t]] = v;
+        i++;
+    }
+}
+
+std::uint64_t contentHash(std::string_view bytes) {
+    // the XXH64 short-input rounds, applied to the whole input
+    constexpr std::uint64_t p1 = 0x9E3779B185EBCA87ULL;
+    constexpr std::uint64_t p2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr std::uint64_t p3 = 0x165667B19E3779F9ULL;
+    constexpr std::uint64_t p4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr std::uint64_t p5 = 0x27D4EB2F165667C5ULL;
+
+    const char* s = bytes.data();
+    size_t n = bytes.size();
+    std::uint64_t h = p5 + n;
+    size_t i = 0;
+    for (; n - i >= 8; i += 8) {
+        std::uint64_t k;
+        std::memcpy(&k, s + i, 8);
+        h ^= std::rotl(k * p2, 31) * p1;
+        h = std::rotl(h, 27) * p1 + p4;
     }
-    return b;
+    if (n - i >= 4) {
+        std::uint32_t k;
+        std::memcpy(&k, s + i, 4);
+        h ^= k * p1;
+        h = std::rotl(h, 23) * p2 + p3;
+        i += 4;
+    }
+    for (; i < n; i++) {
+        h ^= static_cast<unsigned char>(s[i]) * p5;
+        h = std::rotl(h, 11) * p1;
+    }
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p3;
+    h ^= h >> 32;
+    return h;
+}
+
+static bool isJsonWs(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Returns the offset of the first non-whitespace byte at or after pos (or n).
+// Indented configs spend most of their bytes in whitespace runs, so these are
+// skipped 16 bytes at a time.
+static size_t scanWhitespace(const char* s, size_t pos, size_t n) {
+    if (pos < n && !isJsonWs(s[pos])) return pos;
+#if LER_JSON_SSE2
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    while (n - pos >= 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(b, sp), _mm_cmpeq_epi8(b, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(b, lf), _mm_cmpeq_epi8(b, cr)));
+        unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(ws)) & 0xFFFFu;
+        if (other != 0) return pos + static_cast<size_t>(std::countr_zero(other));
+        pos += 16;
+    }
+#endif
+    while (pos < n && isJsonWs(s[pos])) pos++;
+    return pos;
+}
+
+// Returns the offset of the first byte at or after pos that ends a plain ASCII run
+// inside a string: '"', '\\' or a UTF-8 lead/continuation byte (or n).
+static size_t scanStringRun(const char* s, size_t pos, size_t n) {
+#if LER_JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    while (n - pos >= 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(b, quote), _mm_cmpeq_epi8(b, bslash));
+        // movemask of the raw bytes yields their high bits, i.e. the non-ASCII bytes
+        unsigned stop = static_cast<unsigned>(_mm_movemask_epi8(special) | _mm_movemask_epi8(b));
+        if (stop != 0) return pos + static_cast<size_t>(std::countr_zero(stop));
+        pos += 16;
+    }
+#endif
+    while (pos < n) {
+        unsigned char c = static_cast<unsigned char>(s[pos]);
+        if (c == '\"' || c == '\\' || c >= 0x80) break;
+        pos++;
+    }
+    return pos;
 }
 
+// Kinds of the containers open in a skip or event scan (true for an object),
+// innermost last. Only nesting beyond the inline capacity allocates.
+class ContainerKinds {
+public:
+    void push(bool object) {
+        if (n_ < std::size(fixed_)) fixed_[n_] = object;
+        else more_.push_back(object);
+        n_++;
+    }
+    void pop() {
+        if (n_ > std::size(fixed_)) more_.pop_back();
+        n_--;
+    }
+    bool top() const { return n_ > std::size(fixed_) ? more_.back() : fixed_[n_ - 1]; }
+    bool empty() const { return n_ == 0; }
+    size_t size() const { return n_; }
+
+private:
+    bool fixed_[64] = {};
+    std::vector<bool> more_;
+    size_t n_ = 0;
+};
+
+// Parser shared by the UTF-16 (wchar_t) and UTF-8 (char) entry points.
+// Structural tokens are matched directly on the source code units; only string contents
+// are decoded into the std::wstring values kept in the DOM.
+template <typename CharT>
 struct Parser {
-    const std::wstring& t;
+    std::basic_string_view<CharT> t;
     size_t p = 0;
+    std::pmr::memory_resource* mr;
+    // on-demand mode (UTF-8 only): member values under other keys are kept raw
+    std::span<const std::wstring_view> eagerKeys;
+    size_t maxDepth = kJsonMaxDepth;
+
+    // A container opened by parseValue and not yet closed; an object's frame also
+    // holds the key of the member whose value is being read.
+    struct Frame {
+        bool object;
+        JsonValue::Array items;
+        JsonValue::Object members;
+        JsonValue::String key;
+    };
+    // parseValue's open containers, innermost last
+    std::vector<Frame> frames;
+    // frames reserved on the first container: typical documents never regrow
+    static constexpr size_t kFrameReserve = 16;
+
+    Parser(std::basic_string_view<CharT> text, std::pmr::memory_resource* resource)
+        : t(text), mr(resource) {}
+
+    // JSON whitespace (RFC 8259): space, tab, LF, CR
+    static bool isWs(CharT c) {
+        return c == CharT(' ') || c == CharT('\t') || c == CharT('\n') || c == CharT('\r');
+    }
+
+    static bool isDigit(CharT c) {
+        return c >= CharT('0') && c <= CharT('9');
+    }
 
-    explicit Parser(const std::wstring& text) : t(text) {}
+    [[noreturn]] void fail(const char* msg) const {
+        throw JsonParseError(msg, p);
+    }
 
     void skipWs() {
-        while (p < t.size() && iswspace(t[p])) p++;
+        if constexpr (sizeof(CharT) == 1) {
+            p = scanWhitespace(t.data(), p, t.size());
+        }
+        else {
+            while (p < t.size() && isWs(t[p])) p++;
+        }
     }
 
-    wchar_t peek() {
-        return p < t.size() ? t[p] : L'\0';
+    CharT peek() {
+        return p < t.size() ? t[p] : CharT(0);
     }
 
-    bool consume(wchar_t c) {
+    bool consume(char c) {
         skipWs();
-        if (peek() == c) { p++; return true; }
+        if (peek() == CharT(c)) { p++; return true; }
         return false;
     }
 
-    void expect(wchar_t c, const char* msg) {
+    void expect(char c, const char* msg) {
         skipWs();
-        if (peek() != c) throw JsonParseError(msg);
+        if (peek() != CharT(c)) fail(msg);
         p++;
     }
 
-    bool matchLiteral(const wchar_t* lit) {
+    bool matchLiteral(const char* lit) {
         skipWs();
-        size_t start = p;
-        for (size_t i = 0; lit[i] != 0; i++) {
-            if (p + i >= t.size() || t[p + i] != lit[i]) {
-                p = start;
-                return false;
-            }
+        size_t n = std::char_traits<char>::length(lit);
+        if (t.size() - p < n) return false;
+        for (size_t i = 0; i < n; i++) {
+            if (t[p + i] != CharT(lit[i])) return false;
         }
-        p += wcslen(lit);
+        p += n;
         return true;
     }
 
-    static int hexVal(wchar_t c) {
-        if (c >= L'0' && c <= L'9') return c - L'0';
-        if (c >= L'a' && c <= L'f') return 10 + (c - L'a');
-        if (c >= L'A' && c <= L'F') return 10 + (c - L'A');
+    static int hexVal(CharT c) {
+        if (c >= CharT('0') && c <= CharT('9')) return static_cast<int>(c - CharT('0'));
+        if (c >= CharT('a') && c <= CharT('f')) return 10 + static_cast<int>(c - CharT('a'));
+        if (c >= CharT('A') && c <= CharT('F')) return 10 + static_cast<int>(c - CharT('A'));
         return -1;
     }
 
     static bool isHighSurrogate(uint16_t u) { return u >= 0xD800 && u <= 0xDBFF; }
     static bool isLowSurrogate(uint16_t u) { return u >= 0xDC00 && u <= 0xDFFF; }
 
-    static void appendCodepoint(std::wstring& out, uint32_t cp) {
+    template <typename Str>
+    static void appendCodepoint(Str& out, uint32_t cp) {
         if (cp <= 0xFFFF) {
             out.push_back(static_cast<wchar_t>(cp));
             return;
@@ -115,261 +579,1059 @@ struct Parser {
         out.push_back(low);
     }
 
-    std::wstring parseString() {
-        expect(L'\"', "Expected string");
-        std::wstring out;
-        while (p < t.size()) {
-            wchar_t c = t[p++];
-            if (c == L'\"') break;
-            if (c == L'\\') {
-                if (p >= t.size()) throw JsonParseError("Invalid escape");
-                wchar_t e = t[p++];
-                switch (e) {
-                case L'\"': out.push_back(L'\"'); break;
-                case L'\\': out.push_back(L'\\'); break;
-                case L'/': out.push_back(L'/'); break;
-                case L'b': out.push_back(L'\b'); break;
-                case L'f': out.push_back(L'\f'); break;
-                case L'n': out.push_back(L'\n'); break;
-                case L'r': out.push_back(L'\r'); break;
-                case L't': out.push_back(L'\t'); break;
-                case L'u': {
-                    if (p + 4 > t.size()) throw JsonParseError("Invalid unicode escape");
-                    uint16_t u = 0;
-                    for (int k = 0; k < 4; k++) {
-                        int hv = hexVal(t[p++]);
-                        if (hv < 0) throw JsonParseError("Invalid unicode escape");
-                        u = static_cast<uint16_t>((u << 4) | hv);
+    // Decodes one UTF-8 sequence starting at p. Rejects the same inputs as
+    // MultiByteToWideChar(MB_ERR_INVALID_CHARS): truncated or overlong sequences,
+    // encoded surrogates and code points above U+10FFFF.
+    uint32_t decodeUtf8() {
+        unsigned char c0 = static_cast<unsigned char>(t[p]);
+        size_t n = 0;
+        uint32_t cp = 0;
+        uint32_t minCp = 0;
+        if ((c0 & 0xE0) == 0xC0) { n = 1; cp = c0 & 0x1F; minCp = 0x80; }
+        else if ((c0 & 0xF0) == 0xE0) { n = 2; cp = c0 & 0x0F; minCp = 0x800; }
+        else if ((c0 & 0xF8) == 0xF0) { n = 3; cp = c0 & 0x07; minCp = 0x10000; }
+        else fail("Invalid UTF-8");
+
+        if (t.size() - p <= n) fail("Invalid UTF-8");
+        for (size_t k = 1; k <= n; k++) {
+            unsigned char c = static_cast<unsigned char>(t[p + k]);
+            if ((c & 0xC0) != 0x80) fail("Invalid UTF-8");
+            cp = (cp << 6) | (c & 0x3F);
+        }
+        if (cp < minCp || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            fail("Invalid UTF-8");
+        }
+        p += n + 1;
+        return cp;
+    }
+
+    uint16_t parseHex4() {
+        if (t.size() - p < 4) fail("Invalid unicode escape");
+        uint16_t u = 0;
+        for (int k = 0; k < 4; k++) {
+            int hv = hexVal(t[p++]);
+            if (hv < 0) fail("Invalid unicode escape");
+            u = static_cast<uint16_t>((u << 4) | hv);
+        }
+        return u;
+    }
+
+    JsonValue::String parseString() {
+        JsonValue::String out(mr);
+        scanString(&out);
+        return out;
+    }
+
+    void scanString(JsonValue::String* out) { scanStringTo(out); }
+
+    // Widens in place: append(first, last) from a char range would first build a
+    // temporary wide string of the run.
+    template <typename Str>
+    static void appendAscii(Str& out, const char* first, const char* last) {
+        size_t at = out.size();
+        out.resize(at + static_cast<size_t>(last - first));
+        std::copy(first, last, out.begin() + static_cast<std::ptrdiff_t>(at));
+    }
+
+    // Code units from p to the closing quote of the current string, an upper
+    // bound of their decoded UTF-16 length (escapes and multi-byte sequences only
+    // shrink); 0 if the string is unterminated.
+    size_t remainingStringLength() const {
+        size_t q = p;
+        while (q < t.size()) {
+            if constexpr (sizeof(CharT) == 1) {
+                q = scanStringRun(t.data(), q, t.size());
+                if (q >= t.size()) break;
+            }
+            CharT c = t[q];
+            if (c == CharT('\"')) return q - p;
+            q += c == CharT('\\') ? 2 : 1;
+        }
+        return 0;
+    }
+
+    // Validates a string token; its decoded contents are appended to out unless
+    // out is null (skip mode). Str is JsonValue::String or std::wstring.
+    template <typename Str>
+    void scanStringTo(Str* out) {
+        expect('\"', "Expected string");
+        // Strings are sized once: a UTF-8 string that is not a single ASCII run
+        // reserves room for all of it before the first append, a UTF-16 one
+        // always does.
+        [[maybe_unused]] bool sized = false;
+        if constexpr (sizeof(CharT) != 1) {
+            if (out) out->reserve(out->size() + remainingStringLength());
+        }
+        while (true) {
+            if constexpr (sizeof(CharT) == 1) {
+                // copy the plain ASCII run in one go
+                size_t end = scanStringRun(t.data(), p, t.size());
+                if (out) {
+                    if (!sized && end < t.size() && t[end] != '\"') {
+                        out->reserve(out->size() + remainingStringLength());
+                        sized = true;
                     }
+                    appendAscii(*out, t.data() + p, t.data() + end);
+                }
+                p = end;
+            }
+            if (p >= t.size()) fail("Unterminated string");
+            CharT c = t[p];
+            if (c == CharT('\"')) { p++; break; }
+            if (c == CharT('\\')) {
+                p++;
+                if (p >= t.size()) fail("Invalid escape");
+                CharT e = t[p++];
+                switch (e) {
+                case CharT('\"'): if (out) out->push_back(L'\"'); break;
+                case CharT('\\'): if (out) out->push_back(L'\\'); break;
+                case CharT('/'): if (out) out->push_back(L'/'); break;
+                case CharT('b'): if (out) out->push_back(L'\b'); break;
+                case CharT('f'): if (out) out->push_back(L'\f'); break;
+                case CharT('n'): if (out) out->push_back(L'\n'); break;
+                case CharT('r'): if (out) out->push_back(L'\r'); break;
+                case CharT('t'): if (out) out->push_back(L'\t'); break;
+                case CharT('u'): {
+                    uint16_t u = parseHex4();
                     if (isHighSurrogate(u)) {
                         // try surrogate pair
                         size_t save = p;
-                        if (p + 6 <= t.size() && t[p] == L'\\' && t[p + 1] == L'u') {
+                        if (t.size() - p >= 6 && t[p] == CharT('\\') && t[p + 1] == CharT('u')) {
                             p += 2;
-                            uint16_t u2 = 0;
-                            for (int k = 0; k < 4; k++) {
-                                int hv = hexVal(t[p++]);
-                                if (hv < 0) throw JsonParseError("Invalid unicode escape");
-                                u2 = static_cast<uint16_t>((u2 << 4) | hv);
-                            }
+                            uint16_t u2 = parseHex4();
                             if (isLowSurrogate(u2)) {
                                 uint32_t cp = 0x10000 + (((u - 0xD800) << 10) | (u2 - 0xDC00));
-                                appendCodepoint(out, cp);
+                                if (out) appendCodepoint(*out, cp);
                                 break;
                             }
                         }
                         p = save;
-                        out.push_back(static_cast<wchar_t>(u));
+                        if (out) out->push_back(static_cast<wchar_t>(u));
                     }
                     else {
-                        out.push_back(static_cast<wchar_t>(u));
+                        if (out) out->push_back(static_cast<wchar_t>(u));
                     }
                     break;
                 }
                 default:
-                    throw JsonParseError("Invalid escape");
+                    fail("Invalid escape");
                 }
             }
+            else if constexpr (sizeof(CharT) == 1) {
+                // scanStringRun only stops here on a non-ASCII byte
+                uint32_t cp = decodeUtf8();
+                if (out) appendCodepoint(*out, cp);
+            }
             else {
-                out.push_back(c);
+                if (out) out->push_back(c);
+                p++;
             }
         }
-        return out;
     }
 
     JsonValue parseNumber() {
         skipWs();
         size_t start = p;
-        if (peek() == L'-') p++;
-        if (peek() == L'0') {
+        if (peek() == CharT('-')) p++;
+        if (peek() == CharT('0')) {
             p++;
         }
         else {
-            if (!iswdigit(peek())) throw JsonParseError("Invalid number");
-            while (iswdigit(peek())) p++;
+            if (!isDigit(peek())) fail("Invalid number");
+            while (isDigit(peek())) p++;
         }
         bool isFloat = false;
-        if (peek() == L'.') {
+        if (peek() == CharT('.')) {
             isFloat = true;
             p++;
-            if (!iswdigit(peek())) throw JsonParseError("Invalid number");
-            while (iswdigit(peek())) p++;
+            if (!isDigit(peek())) fail("Invalid number");
+            while (isDigit(peek())) p++;
         }
-        if (peek() == L'e' || peek() == L'E') {
+        if (peek() == CharT('e') || peek() == CharT('E')) {
             isFloat = true;
             p++;
-            if (peek() == L'+' || peek() == L'-') p++;
-            if (!iswdigit(peek())) throw JsonParseError("Invalid number");
-            while (iswdigit(peek())) p++;
+            if (peek() == CharT('+') || peek() == CharT('-')) p++;
+            if (!isDigit(peek())) fail("Invalid number");
+            while (isDigit(peek())) p++;
         }
 
-        std::wstring num = t.substr(start, p - start);
-        if (!isFloat) {
-            // parse int64
-            try {
-                size_t idx = 0;
-                long long v = std::stoll(num, &idx, 10);
-                if (idx != num.size()) throw JsonParseError("Invalid number");
-                return JsonValue::makeInt(static_cast<std::int64_t>(v));
-            }
-            catch (...) {
-                // fallback to double
+        // The token is pure ASCII at this point. UTF-8 input is converted in
+        // place; wide input is narrowed into a stack buffer (only absurdly long
+        // tokens need the heap).
+        const char* first = nullptr;
+        const char* last = nullptr;
+        char small[64];
+        std::string large;
+        if constexpr (sizeof(CharT) == 1) {
+            first = t.data() + start;
+            last = t.data() + p;
+        }
+        else {
+            char* dst = small;
+            if (p - start > sizeof(small)) {
+                large.resize(p - start);
+                dst = large.data();
             }
+            for (size_t k = start; k < p; k++) dst[k - start] = static_cast<char>(t[k]);
+            first = dst;
+            last = dst + (p - start);
         }
 
-        try {
-            size_t idx = 0;
-            double dv = std::stod(num, &idx);
-            if (idx != num.size()) throw JsonParseError("Invalid number");
-            return JsonValue::makeDouble(dv);
+        if (!isFloat) {
+            std::int64_t v = 0;
+            auto r = std::from_chars(first, last, v);
+            if (r.ec == std::errc() && r.ptr == last) return JsonValue::makeInt(v);
+            // out of int64 range: fall back to double
         }
-        catch (...) {
-            throw JsonParseError("Invalid number");
+
+        double dv = 0;
+        auto r = std::from_chars(first, last, dv);
+        if (r.ec != std::errc() || r.ptr != last) fail("Invalid number");
+        return JsonValue::makeDouble(dv);
+    }
+
+    // Called before opening a container that would be the depth-th open one.
+    void enter(size_t depth) {
+        if (depth > maxDepth) fail("Nesting too deep");
+    }
+
+    JsonValue parseScalar() {
+        skipWs();
+        CharT c = peek();
+        if (c == CharT('\"')) return JsonValue(parseString());
+        if (c == CharT('-') || isDigit(c)) return parseNumber();
+        if (matchLiteral("true")) return JsonValue::makeBool(true);
+        if (matchLiteral("false")) return JsonValue::makeBool(false);
+        if (matchLiteral("null")) return JsonValue::makeNull();
+        fail("Unexpected token");
+    }
+
+    // Reads the key of the next member of f and its ':'. Returns true if the
+    // value is kept raw (on-demand mode); it is then already in v.
+    bool beginMember(Frame& f, JsonValue& v) {
+        skipWs();
+        f.key.clear();
+        scanString(&f.key);
+        expect(':', "Expected :");
+        if constexpr (sizeof(CharT) == 1) {
+            if (keepRaw(f.key)) {
+                v = JsonValue::makeRaw(skipValue());
+                return true;
+            }
         }
+        return false;
     }
 
-    JsonValue parseArray() {
-        expect(L'[', "Expected [");
-        std::vector<JsonValue> arr;
+    // Starts the value at p. Returns true if it is complete in v (a scalar or an
+    // empty container); false if it opened a frame whose first value follows.
+    bool beginValue(JsonValue& v) {
         skipWs();
-        if (consume(L']')) return JsonValue::makeArray(std::move(arr));
+        CharT c = peek();
+        if (c != CharT('{') && c != CharT('[')) {
+            v = parseScalar();
+            return true;
+        }
+        bool object = c == CharT('{');
+        enter(frames.size() + 1);
+        p++;
+        if (consume(object ? '}' : ']')) {
+            v = object ? JsonValue::makeObject(JsonValue::Object(mr)) : JsonValue::makeArray(JsonValue::Array(mr));
+            return true;
+        }
+        if (frames.capacity() == 0) frames.reserve(std::min<size_t>(maxDepth, kFrameReserve));
+        frames.push_back(Frame{ object, JsonValue::Array(mr), JsonValue::Object(mr), JsonValue::String(mr) });
+        return object && beginMember(frames.back(), v);
+    }
+
+    JsonValue endFrame() {
+        Frame& f = frames.back();
+        JsonValue v = f.object ? JsonValue::makeObject(std::move(f.members)) : JsonValue::makeArray(std::move(f.items));
+        frames.pop_back();
+        return v;
+    }
+
+    // Iterative: open containers live on frames rather than the call stack, so
+    // input nesting costs heap, bounded by maxDepth, and never native stack.
+    JsonValue parseValue() {
+        const size_t base = frames.size();
+        JsonValue v;
         while (true) {
-            arr.push_back(parseValue());
-            skipWs();
-            if (consume(L',')) continue;
-            expect(L']', "Expected ]");
-            break;
+            if (!beginValue(v)) continue;
+            // v is complete: store it in its container and close every container
+            // that ends with it
+            while (true) {
+                if (frames.size() == base) return v;
+                Frame& f = frames.back();
+                if (f.object) f.members.emplace_back(std::move(f.key), std::move(v));
+                else f.items.push_back(std::move(v));
+                if (consume(',')) {
+                    if (f.object && beginMember(f, v)) continue;
+                    break;
+                }
+                expect(f.object ? '}' : ']', f.object ? "Expected }" : "Expected ]");
+                v = endFrame();
+            }
         }
-        return JsonValue::makeArray(std::move(arr));
     }
 
-    JsonValue parseObject() {
-        expect(L'{', "Expected {");
-        std::vector<std::pair<std::wstring, JsonValue>> obj;
+    bool keepRaw(std::wstring_view key) const {
+        if (eagerKeys.empty()) return false;
+        for (std::wstring_view k : eagerKeys) {
+            if (k == key) return false;
+        }
+        return true;
+    }
+
+    // Validates one value with the same rules as parseValue but builds nothing;
+    // returns its exact source span.
+    std::basic_string_view<CharT> skipValue() {
         skipWs();
-        if (consume(L'}')) return JsonValue::makeObject(std::move(obj));
+        size_t start = p;
+        ContainerKinds open;
+        auto skipKey = [this] {
+            skipWs();
+            scanString(nullptr);
+            expect(':', "Expected :");
+        };
         while (true) {
             skipWs();
-            std::wstring key = parseString();
+            CharT c = peek();
+            if (c == CharT('\"')) {
+                scanString(nullptr);
+            }
+            else if (c == CharT('{') || c == CharT('[')) {
+                bool object = c == CharT('{');
+                enter(frames.size() + open.size() + 1);
+                p++;
+                if (!consume(object ? '}' : ']')) {
+                    open.push(object);
+                    if (object) skipKey();
+                    continue;
+                }
+            }
+            else {
+                // scalars are cheap and carry the range checks
+                parseScalar();
+            }
+            while (true) {
+                if (open.empty()) return t.substr(start, p - start);
+                bool object = open.top();
+                if (consume(',')) {
+                    if (object) skipKey();
+                    break;
+                }
+                expect(object ? '}' : ']', object ? "Expected }" : "Expected ]");
+                open.pop();
+            }
+        }
+    }
+
+    // Event mode: reports the value to h instead of building it. Decoded strings
+    // share one scratch buffer, so nothing grows with the document size.
+    void parseEvents(JsonEventHandler& h, JsonValue::String& scratch) {
+        ContainerKinds open;
+        auto key = [&] {
+            skipWs();
+            scratch.clear();
+            scanString(&scratch);
             skipWs();
-            expect(L':', "Expected :");
-            JsonValue value = parseValue();
-            obj.push_back(std::make_pair(std::move(key), std::move(value)));
+            expect(':', "Expected :");
+            h.onKey(scratch);
+        };
+        while (true) {
             skipWs();
-            if (consume(L',')) continue;
-            expect(L'}', "Expected }");
-            break;
+            CharT c = peek();
+            if (c == CharT('\"')) {
+                scratch.clear();
+                scanString(&scratch);
+                h.onString(scratch);
+            }
+            else if (c == CharT('{') || c == CharT('[')) {
+                bool object = c == CharT('{');
+                enter(open.size() + 1);
+                p++;
+                if (object) h.onObjectStart();
+                else h.onArrayStart();
+                if (!consume(object ? '}' : ']')) {
+                    open.push(object);
+                    if (object) key();
+                    continue;
+                }
+                if (object) h.onObjectEnd();
+                else h.onArrayEnd();
+            }
+            else {
+                JsonValue v = parseScalar();
+                switch (v.type()) {
+                case JsonValue::Type::Bool: h.onBool(v.asBool(L"")); break;
+                case JsonValue::Type::Int: h.onInt(v.asInt(L"")); break;
+                case JsonValue::Type::Double: h.onDouble(v.asDouble(L"")); break;
+                default: h.onNull(); break;
+                }
+            }
+            while (true) {
+                if (open.empty()) return;
+                bool object = open.top();
+                if (consume(',')) {
+                    if (object) key();
+                    break;
+                }
+                expect(object ? '}' : ']', object ? "Expected }" : "Expected ]");
+                open.pop();
+                if (object) h.onObjectEnd();
+                else h.onArrayEnd();
+            }
         }
-        return JsonValue::makeObject(std::move(obj));
     }
 
-    JsonValue parseValue() {
+    JsonValue parseDocument() {
+        JsonValue v = parseValue();
         skipWs();
-        wchar_t c = peek();
-        if (c == L'\"') return JsonValue::makeString(parseString());
-        if (c == L'{') return parseObject();
-        if (c == L'[') return parseArray();
-        if (c == L'-' || iswdigit(c)) return parseNumber();
-        if (matchLiteral(L"true")) return JsonValue::makeBool(true);
-        if (matchLiteral(L"false")) return JsonValue::makeBool(false);
-        if (matchLiteral(L"null")) return JsonValue::makeNull();
-        throw JsonParseError("Unexpected token");
+        if (p != t.size()) fail("Trailing characters");
+        return v;
     }
 };
 
-JsonValue parseJson(const std::wstring& text) {
-    Parser p(text);
-    JsonValue v = p.parseValue();
+JsonValue parseJson(const std::wstring& text, std::pmr::memory_resource* mr) {
+    Parser<wchar_t> p(text, mr);
+    return p.parseDocument();
+}
+
+JsonValue parseJsonUtf8(std::string_view text, std::pmr::memory_resource* mr) {
+    Parser<char> p(text, mr);
+    return p.parseDocument();
+}
+
+JsonValue parseJsonUtf8(std::string_view text, std::pmr::memory_resource* mr, const JsonParseOptions& options) {
+    Parser<char> p(text, mr);
+    p.eagerKeys = options.eagerKeys;
+    p.maxDepth = options.maxDepth;
+    return p.parseDocument();
+}
+
+void parseJsonUtf8Events(std::string_view text, JsonEventHandler& handler) {
+    Parser<char> p(text, std::pmr::get_default_resource());
+    JsonValue::String scratch;
+    p.parseEvents(handler, scratch);
     p.skipWs();
-    if (p.p != text.size()) throw JsonParseError("Trailing characters");
-    return v;
+    if (p.p != text.size()) p.fail("Trailing characters");
 }
 
-static void writeEscapedString(std::wstringstream& ss, const std::wstring& s) {
-    ss << L'\"';
-    for (wchar_t c : s) {
-        switch (c) {
-        case L'\"': ss << L"\\\""; break;
-        case L'\\': ss << L"\\\\"; break;
-        case L'\b': ss << L"\\b"; break;
-        case L'\f': ss << L"\\f"; break;
-        case L'\n': ss << L"\\n"; break;
-        case L'\r': ss << L"\\r"; break;
-        case L'\t': ss << L"\\t"; break;
-        default:
-            if (c < 0x20) {
-                ss << L"\\u";
-                ss << std::hex;
-                ss.width(4);
-                ss.fill(L'0');
-                ss << static_cast<int>(c);
-                ss << std::dec;
+JsonParseResult tryParseJsonUtf8(std::string_view text, std::pmr::memory_resource* mr) {
+    JsonParseResult r;
+    try {
+        r.value = parseJsonUtf8(text, mr);
+    }
+    catch (const JsonParseError& e) {
+        r.error = describeJsonError(e, text);
+    }
+    return r;
+}
+
+// Tracks the open containers while scanning well-formed text, for error paths.
+std::wstring jsonPointerAt(std::string_view text, size_t offset) {
+    struct Frame {
+        bool array = false;
+        size_t index = 0;
+        bool hasKey = false;
+        std::wstring key;
+    };
+    std::vector<Frame> frames;
+    size_t end = std::min(offset, text.size());
+    for (size_t i = 0; i < end;) {
+        char c = text[i];
+        if (c == '\"') {
+            Parser<char> q(text, std::pmr::get_default_resource());
+            q.p = i;
+            Frame* f = frames.empty() || frames.back().array || frames.back().hasKey ? nullptr : &frames.back();
+            try {
+                if (f) f->key.clear();
+                q.scanStringTo(f ? &f->key : nullptr);
+            }
+            catch (const JsonParseError&) {
+                // the offset lies in this string
+                break;
+            }
+            if (q.p > end) break;
+            if (f) f->hasKey = true;
+            i = q.p;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            frames.emplace_back().array = c == '[';
+        }
+        else if ((c == '}' || c == ']') && !frames.empty()) {
+            frames.pop_back();
+        }
+        else if (c == ',' && !frames.empty()) {
+            if (frames.back().array) frames.back().index++;
+            else frames.back().hasKey = false;
+        }
+        i++;
+    }
+
+    std::wstring path;
+    for (const Frame& f : frames) {
+        if (f.array) {
+            path += L'/';
+            path += std::to_wstring(f.index);
+            continue;
+        }
+        if (!f.hasKey) break;
+        path += L'/';
+        for (wchar_t ch : f.key) {
+            if (ch == L'~') path += L"~0";
+            else if (ch == L'/') path += L"~1";
+            else path += ch;
+        }
+    }
+    return path;
+}
+
+JsonError describeJsonError(const JsonParseError& e, std::string_view text) {
+    JsonError err;
+    err.code = e.code;
+    err.message = e.what();
+    if (e.offset == JsonParseError::npos || e.offset > text.size()) return err;
+    err.offset = e.offset;
+    std::string_view before = text.substr(0, e.offset);
+    size_t lineStart = before.rfind('\n');
+    err.line = 1 + static_cast<size_t>(std::count(before.begin(), before.end(), '\n'));
+    err.column = e.offset - (lineStart == std::string_view::npos ? 0 : lineStart + 1) + 1;
+    err.path = jsonPointerAt(text, e.offset);
+    return err;
+}
+
+// JsonReader only keeps its position; every call resumes a parser there.
+static Parser<char> resumeParser(std::string_view text, size_t pos) {
+    Parser<char> p(text, std::pmr::get_default_resource());
+    p.p = pos;
+    p.skipWs();
+    return p;
+}
+
+JsonValue::Type JsonReader::peekType() {
+    Parser<char> p = resumeParser(text_, pos_);
+    pos_ = p.p;
+    char c = p.peek();
+    if (c == '\"') return JsonValue::Type::String;
+    if (c == '{') return JsonValue::Type::Object;
+    if (c == '[') return JsonValue::Type::Array;
+    if (c == '-' || Parser<char>::isDigit(c)) return JsonValue::Type::Int;
+    if (p.matchLiteral("true") || p.matchLiteral("false")) return JsonValue::Type::Bool;
+    if (p.matchLiteral("null")) return JsonValue::Type::Null;
+    p.fail("Unexpected token");
+}
+
+void JsonReader::beginObject() {
+    Parser<char> p = resumeParser(text_, pos_);
+    p.expect('{', "Expected {");
+    pos_ = p.p;
+    afterOpen_ = true;
+}
+
+void JsonReader::beginArray() {
+    Parser<char> p = resumeParser(text_, pos_);
+    p.expect('[', "Expected [");
+    pos_ = p.p;
+    afterOpen_ = true;
+}
+
+// Plain UTF-8 encoding of decoded key text; unpaired surrogates become U+FFFD.
+static void appendUtf8(std::string& out, std::wstring_view s) {
+    for (size_t i = 0; i < s.size(); i++) {
+        uint32_t c = static_cast<uint32_t>(s[i]);
+        if (c >= 0xD800 && c <= 0xDFFF) {
+            uint32_t low = i + 1 < s.size() ? static_cast<uint32_t>(s[i + 1]) : 0;
+            if (c <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i++;
             }
             else {
-                ss << c;
+                c = 0xFFFD;
+            }
+        }
+        if (c < 0x80) {
+            out.push_back(static_cast<char>(c));
+            continue;
+        }
+        if (c < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+        }
+        else {
+            if (c < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+            }
+            else {
+                out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+            }
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+        }
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+}
+
+bool JsonReader::nextMember(std::string_view& key) {
+    Parser<char> p = resumeParser(text_, pos_);
+    bool first = afterOpen_;
+    afterOpen_ = false;
+    if (p.consume('}')) {
+        pos_ = p.p;
+        return false;
+    }
+    if (!first && !p.consume(',')) p.fail("Expected }");
+    p.skipWs();
+    size_t start = p.p + 1;
+    p.scanStringTo<std::wstring>(nullptr);
+    key = text_.substr(start, p.p - 1 - start);
+    if (key.find('\\') != std::string_view::npos) {
+        Parser<char> q(text_, std::pmr::get_default_resource());
+        q.p = start - 1;
+        key_.clear();
+        q.scanStringTo(&key_);
+        keyUtf8_.clear();
+        appendUtf8(keyUtf8_, key_);
+        key = keyUtf8_;
+    }
+    p.expect(':', "Expected :");
+    pos_ = p.p;
+    return true;
+}
+
+bool JsonReader::nextElement() {
+    Parser<char> p = resumeParser(text_, pos_);
+    bool first = afterOpen_;
+    afterOpen_ = false;
+    if (p.consume(']')) {
+        pos_ = p.p;
+        return false;
+    }
+    if (!first && !p.consume(',')) p.fail("Expected ]");
+    pos_ = p.p;
+    return true;
+}
+
+bool JsonReader::readNull() {
+    Parser<char> p = resumeParser(text_, pos_);
+    if (!p.matchLiteral("null")) return false;
+    pos_ = p.p;
+    return true;
+}
+
+void JsonReader::readString(std::wstring& out, const wchar_t* ctx) {
+    Parser<char> p = resumeParser(text_, pos_);
+    if (p.peek() != '\"') throw typeError("Expected string at ", ctx, p.p);
+    out.clear();
+    p.scanStringTo(&out);
+    pos_ = p.p;
+}
+
+std::int64_t JsonReader::readInt(const wchar_t* ctx) {
+    Parser<char> p = resumeParser(text_, pos_);
+    char c = p.peek();
+    if (c != '-' && !Parser<char>::isDigit(c)) throw typeError("Expected number at ", ctx, p.p);
+    size_t at = p.p;
+    JsonValue v = p.parseNumber();
+    if (v.isDouble() && !fitsInt64(v.asDouble(ctx))) throw typeError("Number out of int64 range at ", ctx, at);
+    pos_ = p.p;
+    return v.asInt(ctx);
+}
+
+bool JsonReader::readBool(const wchar_t* ctx) {
+    Parser<char> p = resumeParser(text_, pos_);
+    bool v = false;
+    if (p.matchLiteral("true")) v = true;
+    else if (!p.matchLiteral("false")) throw typeError("Expected bool at ", ctx, p.p);
+    pos_ = p.p;
+    return v;
+}
+
+std::string_view JsonReader::skipValue() {
+    Parser<char> p = resumeParser(text_, pos_);
+    std::string_view span = p.skipValue();
+    pos_ = p.p;
+    return span;
+}
+
+void JsonReader::finish() {
+    Parser<char> p = resumeParser(text_, pos_);
+    if (p.p != text_.size()) p.fail("Trailing characters");
+    pos_ = p.p;
+}
+
+void JsonValue::materialize(std::pmr::memory_resource* mr) {
+    if (const Raw* r = std::get_if<Raw>(&v_)) {
+        *this = parseJsonUtf8(r->text, mr);
+    }
+}
+
+std::string_view JsonValue::rawText() const {
+    const Raw* r = std::get_if<Raw>(&v_);
+    if (!r) throw std::runtime_error("JsonValue is not raw");
+    return r->text;
+}
+
+// Splits the array starting at s[pos] == '[' into its element spans, looking
+// only at quotes, escapes and brackets: the elements are not validated. Returns
+// the offset just past the closing bracket, or npos if the scan runs off the end
+// or meets a stray closing brace.
+static size_t splitArrayElements(const char* s, size_t pos, size_t n, std::vector<std::string_view>& elements) {
+    constexpr size_t npos = static_cast<size_t>(-1);
+    pos = scanWhitespace(s, pos + 1, n);
+    if (pos < n && s[pos] == ']') return pos + 1;
+
+    size_t start = pos;
+    size_t end = pos;  // one past the last non-whitespace byte of the element
+    int depth = 0;
+    while (pos < n) {
+        char c = s[pos];
+        if (c == '\"') {
+            pos++;
+            while (true) {
+                pos = scanStringRun(s, pos, n);
+                if (pos >= n) return npos;
+                if (s[pos] == '\"') break;
+                pos += s[pos] == '\\' ? 2 : 1;
+                if (pos > n) return npos;
+            }
+            end = ++pos;
+            continue;
+        }
+        if (isJsonWs(c)) {
+            pos = scanWhitespace(s, pos, n);
+            continue;
+        }
+        if (depth == 0 && (c == ',' || c == ']')) {
+            elements.emplace_back(s + start, end - start);
+            if (c == ']') return pos + 1;
+            start = end = pos = scanWhitespace(s, pos + 1, n);
+            continue;
+        }
+        if (c == '[' || c == '{') depth++;
+        else if (c == ']' || c == '}') {
+            if (depth == 0) return npos;
+            depth--;
+        }
+        end = ++pos;
+    }
+    return npos;
+}
+
+std::vector<std::string_view> JsonValue::rawArrayElements() const {
+    std::string_view t = rawText();
+    if (t.front() != '[') throw std::runtime_error("JsonValue is not a raw array");
+
+    // raw values were validated when they were skipped, so the scan cannot fail
+    std::vector<std::string_view> elements;
+    splitArrayElements(t.data(), 0, t.size(), elements);
+    return elements;
+}
+
+bool JsonReader::splitArray(std::vector<std::string_view>& elements) {
+    size_t end = splitArrayElements(text_.data(), pos_, text_.size(), elements);
+    if (end == static_cast<size_t>(-1)) {
+        elements.clear();
+        return false;
+    }
+    pos_ = end;
+    return true;
+}
+
+// Appends the leading run of s[pos, n) that is copied unchanged (printable ASCII
+// other than '"' and '\\') as single bytes; returns the offset where it stops.
+static size_t copyPlainAscii(std::string& out, const wchar_t* s, size_t pos, size_t n) {
+#if LER_JSON_SSE2
+    if constexpr (sizeof(wchar_t) == 2) {
+        // 8 UTF-16 units per block, narrowed to 8 bytes with one pack
+        const __m128i lo = _mm_set1_epi16(0x20);
+        const __m128i hi = _mm_set1_epi16(0x7F);
+        const __m128i quote = _mm_set1_epi16('\"');
+        const __m128i bslash = _mm_set1_epi16('\\');
+        const __m128i zero = _mm_setzero_si128();
+        char block[16];
+        while (n - pos >= 8) {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+            // unsigned range check 0x20 <= c <= 0x7F via saturating subtraction
+            __m128i inRange = _mm_and_si128(
+                _mm_cmpeq_epi16(_mm_subs_epu16(lo, c), zero),
+                _mm_cmpeq_epi16(_mm_subs_epu16(c, hi), zero));
+            __m128i special = _mm_or_si128(_mm_cmpeq_epi16(c, quote), _mm_cmpeq_epi16(c, bslash));
+            unsigned plain = static_cast<unsigned>(_mm_movemask_epi8(_mm_andnot_si128(special, inRange)));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(block), _mm_packus_epi16(c, c));
+            if (plain != 0xFFFFu) {
+                size_t k = static_cast<size_t>(std::countr_one(plain)) / 2;
+                out.append(block, k);
+                return pos + k;
             }
-            break;
+            out.append(block, 8);
+            pos += 8;
         }
     }
-    ss << L'\"';
+#endif
+    size_t end = pos;
+    while (end < n) {
+        wchar_t c = s[end];
+        if (c < 0x20 || c > 0x7F || c == L'\"' || c == L'\\') break;
+        end++;
+    }
+    size_t o = out.size();
+    out.resize(o + (end - pos));
+    for (size_t k = pos; k < end; k++) out[o + (k - pos)] = static_cast<char>(s[k]);
+    return end;
 }
 
-static void writeValue(std::wstringstream& ss, const JsonValue& v, int indentSpaces, int depth) {
-    auto indent = [&]() {
-        for (int i = 0; i < depth * indentSpaces; i++) ss << L' ';
+// Appends s as a quoted JSON string in UTF-8. Only '"', '\\' and control
+// characters are escaped; unpaired surrogates are written as \u escapes so the
+// output stays valid UTF-8.
+static void appendEscapedUtf8(std::string& out, std::wstring_view s) {
+    static const char hex[] = "0123456789abcdef";
+    auto appendU = [&](uint32_t u) {
+        out += "\\u";
+        for (int shift = 12; shift >= 0; shift -= 4) out.push_back(hex[(u >> shift) & 0xF]);
     };
 
-    switch (v.type) {
-    case JsonValue::Type::Null: ss << L"null"; break;
-    case JsonValue::Type::Bool: ss << (v.b ? L"true" : L"false"); break;
-    case JsonValue::Type::Int: ss << v.i; break;
-    case JsonValue::Type::Double: {
-        ss << v.d;
-        break;
+    out.push_back('\"');
+    size_t i = 0;
+    while (true) {
+        i = copyPlainAscii(out, s.data(), i, s.size());
+        if (i == s.size()) break;
+
+        uint32_t c = static_cast<uint32_t>(s[i++]);
+        switch (c) {
+        case '\"': out += "\\\""; continue;
+        case '\\': out += "\\\\"; continue;
+        case '\b': out += "\\b"; continue;
+        case '\f': out += "\\f"; continue;
+        case '\n': out += "\\n"; continue;
+        case '\r': out += "\\r"; continue;
+        case '\t': out += "\\t"; continue;
+        default: break;
+        }
+        if (c < 0x20) {
+            appendU(c);
+        }
+        else if (c < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        }
+        else {
+            if (c >= 0xD800 && c <= 0xDFFF) {
+                uint32_t low = i < s.size() ? static_cast<uint32_t>(s[i]) : 0;
+                if (c > 0xDBFF || low < 0xDC00 || low > 0xDFFF) {
+                    appendU(c);
+                    continue;
+                }
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+            if (c < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+            }
+            else {
+                out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+            }
+            out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+        }
     }
+    out.push_back('\"');
+}
+
+static void appendInt(std::string& out, std::int64_t v) {
+    char tmp[24];
+    auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    out.append(tmp, r.ptr);
+}
+
+static void appendDouble(std::string& out, double v) {
+    // shortest text that reads back as the same double
+    char tmp[32];
+    auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    out.append(tmp, r.ptr);
+}
+
+// Starts a new line at the given depth; nothing in compact mode.
+static void appendNewlineIndent(std::string& out, int indentSpaces, size_t depth) {
+    if (indentSpaces < 0) return;
+    out.push_back('\n');
+    out.append(depth * static_cast<size_t>(indentSpaces), ' ');
+}
+
+static void writeValue(std::string& out, const JsonValue& v, int indentSpaces, size_t depth) {
+    switch (v.type()) {
+    case JsonValue::Type::Null: out += "null"; break;
+    case JsonValue::Type::Bool: out += v.asBool(L"") ? "true" : "false"; break;
+    case JsonValue::Type::Int: appendInt(out, v.asInt(L"")); break;
+    case JsonValue::Type::Double: appendDouble(out, v.asDouble(L"")); break;
     case JsonValue::Type::String:
-        writeEscapedString(ss, v.s);
+        appendEscapedUtf8(out, v.asString(L""));
+        break;
+    case JsonValue::Type::Raw:
+        // validated UTF-8 from the source; copied as is
+        out += v.rawText();
         break;
     case JsonValue::Type::Array: {
-        ss << L'[';
-        if (!v.a.empty()) {
-            ss << L'\n';
-            for (size_t idx = 0; idx < v.a.size(); idx++) {
-                for (int i = 0; i < (depth + 1) * indentSpaces; i++) ss << L' ';
-                writeValue(ss, v.a[idx], indentSpaces, depth + 1);
-                if (idx + 1 < v.a.size()) ss << L',';
-                ss << L'\n';
-            }
-            indent();
-        }
-        ss << L']';
+        const JsonValue::Array& a = v.items();
+        out.push_back('[');
+        if (!a.empty()) {
+            for (size_t idx = 0; idx < a.size(); idx++) {
+                if (idx > 0) out.push_back(',');
+                appendNewlineIndent(out, indentSpaces, depth + 1);
+                writeValue(out, a[idx], indentSpaces, depth + 1);
+            }
+            appendNewlineIndent(out, indentSpaces, depth);
+        }
+        out.push_back(']');
         break;
     }
     case JsonValue::Type::Object: {
-        ss << L'{';
-        if (!v.o.empty()) {
-            ss << L'\n';
-            for (size_t idx = 0; idx < v.o.size(); idx++) {
-                for (int i = 0; i < (depth + 1) * indentSpaces; i++) ss << L' ';
-                writeEscapedString(ss, v.o[idx].first);
-                ss << L": ";
-                writeValue(ss, v.o[idx].second, indentSpaces, depth + 1);
-                if (idx + 1 < v.o.size()) ss << L',';
-                ss << L'\n';
-            }
-            indent();
-        }
-        ss << L'}';
+        const JsonValue::Object& o = v.members();
+        out.push_back('{');
+        if (!o.empty()) {
+            for (size_t idx = 0; idx < o.size(); idx++) {
+                if (idx > 0) out.push_back(',');
+                appendNewlineIndent(out, indentSpaces, depth + 1);
+                appendEscapedUtf8(out, o[idx].first);
+                out += indentSpaces < 0 ? ":" : ": ";
+                writeValue(out, o[idx].second, indentSpaces, depth + 1);
+            }
+            appendNewlineIndent(out, indentSpaces, depth);
+        }
+        out.push_back('}');
         break;
     }
     }
 }
 
+void writeJsonUtf8(const JsonValue& v, std::string& out, int indentSpaces) {
+    writeValue(out, v, indentSpaces, 0);
+    if (indentSpaces >= 0) out.push_back('\n');
+}
+
+std::string writeJsonUtf8(const JsonValue& v, int indentSpaces) {
+    std::string out;
+    writeJsonUtf8(v, out, indentSpaces);
+    return out;
+}
+
 std::wstring writeJson(const JsonValue& v, int indentSpaces) {
-    std::wstringstream ss;
-    writeValue(ss, v, indentSpaces, 0);
-    ss << L'\n';
-    return ss.str();
+    std::string bytes = writeJsonUtf8(v, indentSpaces);
+
+    // the writer only produces well-formed UTF-8
+    Parser<char> rp(bytes, std::pmr::get_default_resource());
+    JsonValue::String wide;
+    wide.reserve(bytes.size());
+    while (rp.p < bytes.size()) {
+        unsigned char c = static_cast<unsigned char>(bytes[rp.p]);
+        if (c < 0x80) {
+            wide.push_back(static_cast<wchar_t>(c));
+            rp.p++;
+        }
+        else {
+            Parser<char>::appendCodepoint(wide, rp.decodeUtf8());
+        }
+    }
+    return std::wstring(wide);
+}
+
+JsonStreamWriter::JsonStreamWriter(Sink sink, int indentSpaces, size_t flushBytes)
+    : sink_(std::move(sink)), indentSpaces_(indentSpaces), flushBytes_(flushBytes) {
+    buf_.reserve(flushBytes_ + 256);
+}
+
+void JsonStreamWriter::newlineIndent() {
+    appendNewlineIndent(buf_, indentSpaces_, counts_.size());
+}
+
+void JsonStreamWriter::beforeValue() {
+    if (afterKey_) {
+        afterKey_ = false;
+        return;
+    }
+    if (counts_.empty()) return;
+    if (counts_.back()++ > 0) buf_.push_back(',');
+    newlineIndent();
+}
+
+void JsonStreamWriter::maybeFlush() {
+    if (buf_.size() >= flushBytes_) {
+        sink_(buf_);
+        buf_.clear();
+    }
+}
+
+void JsonStreamWriter::beginObject() {
+    beforeValue();
+    buf_.push_back('{');
+    counts_.push_back(0);
+}
+
+void JsonStreamWriter::endObject() {
+    size_t n = counts_.back();
+    counts_.pop_back();
+    if (n > 0) newlineIndent();
+    buf_.push_back('}');
+    maybeFlush();
+}
+
+void JsonStreamWriter::beginArray() {
+    beforeValue();
+    buf_.push_back('[');
+    counts_.push_back(0);
+}
+
+void JsonStreamWriter::endArray() {
+    size_t n = counts_.back();
+    counts_.pop_back();
+    if (n > 0) newlineIndent();
+    buf_.push_back(']');
+    maybeFlush();
+}
+
+void JsonStreamWriter::key(std::wstring_view k) {
+    if (counts_.back()++ > 0) buf_.push_back(',');
+    newlineIndent();
+    appendEscapedUtf8(buf_, k);
+    buf_ += indentSpaces_ < 0 ? ":" : ": ";
+    afterKey_ = true;
+}
+
+void JsonStreamWriter::stringValue(std::wstring_view v) {
+    beforeValue();
+    appendEscapedUtf8(buf_, v);
+    maybeFlush();
+}
+
+void JsonStreamWriter::intValue(std::int64_t v) {
+    beforeValue();
+    appendInt(buf_, v);
+    maybeFlush();
+}
+
+void JsonStreamWriter::doubleValue(double v) {
+    beforeValue();
+    appendDouble(buf_, v);
+    maybeFlush();
+}
+
+void JsonStreamWriter::boolValue(bool v) {
+    beforeValue();
+    buf_ += v ? "true" : "false";
+    maybeFlush();
+}
+
+void JsonStreamWriter::nullValue() {
+    beforeValue();
+    buf_ += "null";
+    maybeFlush();
+}
+
+void JsonStreamWriter::finish() {
+    if (indentSpaces_ >= 0) buf_.push_back('\n');
+    sink_(buf_);
+    buf_.clear();
 }
 
 } // namespace ler
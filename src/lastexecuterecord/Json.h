@@ -1,13 +1,23 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <variant>
 #include <vector>
 
 namespace ler {
 
+// A JSON node stored as a tagged union: only the active alternative occupies
+// storage, so scalars cost sizeof(JsonValue) and nothing more.
+// Strings and containers use polymorphic allocators, so a whole DOM can be
+// placed in a caller-provided arena (e.g. std::pmr::monotonic_buffer_resource).
 struct JsonValue {
     enum class Type {
         Null,
@@ -17,85 +27,401 @@ struct JsonValue {
         String,
         Array,
         Object,
+        // Unparsed value kept as its UTF-8 source span (on-demand parsing).
+        Raw,
     };
 
-    Type type = Type::Null;
-
-    bool b = false;
-    std::int64_t i = 0;
-    double d = 0.0;
-    std::wstring s;
-    std::vector<JsonValue> a;
+    using String = std::pmr::wstring;
+    using Array = std::pmr::vector<JsonValue>;
     // preserve insertion order
-    std::vector<std::pair<std::wstring, JsonValue>> o;
+    using Object = std::pmr::vector<std::pair<String, JsonValue>>;
 
     JsonValue() = default;
+    explicit JsonValue(String v) : v_(std::move(v)) {}
+    explicit JsonValue(Array v) : v_(std::move(v)) {}
+    explicit JsonValue(Object v) : v_(ObjectStorage(std::move(v))) {}
 
     static JsonValue makeNull() { return JsonValue(); }
     static JsonValue makeBool(bool v) {
-        JsonValue x; x.type = Type::Bool; x.b = v; return x;
+        JsonValue x; x.v_ = v; return x;
     }
     static JsonValue makeInt(std::int64_t v) {
-        JsonValue x; x.type = Type::Int; x.i = v; return x;
+        JsonValue x; x.v_ = v; return x;
     }
     static JsonValue makeDouble(double v) {
-        JsonValue x; x.type = Type::Double; x.d = v; return x;
+        JsonValue x; x.v_ = v; return x;
+    }
+    static JsonValue makeString(std::wstring_view v,
+        std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+        return JsonValue(String(v, mr));
     }
-    static JsonValue makeString(std::wstring v) {
-        JsonValue x; x.type = Type::String; x.s = std::move(v); return x;
+    static JsonValue makeArray(Array v = {}) {
+        return JsonValue(std::move(v));
     }
-    static JsonValue makeArray(std::vector<JsonValue> v = {}) {
-        JsonValue x; x.type = Type::Array; x.a = std::move(v); return x;
+    static JsonValue makeObject(Object v = {}) {
+        return JsonValue(std::move(v));
     }
-    static JsonValue makeObject(std::vector<std::pair<std::wstring, JsonValue>> v = {}) {
-        JsonValue x; x.type = Type::Object; x.o = std::move(v); return x;
+    // The span must stay valid for the lifetime of the value.
+    static JsonValue makeRaw(std::string_view utf8) {
+        JsonValue x; x.v_ = Raw{ utf8 }; return x;
     }
 
-    bool isNull() const { return type == Type::Null; }
-    bool isBool() const { return type == Type::Bool; }
-    bool isInt() const { return type == Type::Int; }
-    bool isDouble() const { return type == Type::Double; }
+    // Variant alternatives are declared in Type order.
+    Type type() const { return static_cast<Type>(v_.index()); }
+
+    bool isNull() const { return type() == Type::Null; }
+    bool isBool() const { return type() == Type::Bool; }
+    bool isInt() const { return type() == Type::Int; }
+    bool isDouble() const { return type() == Type::Double; }
     bool isNumber() const { return isInt() || isDouble(); }
-    bool isString() const { return type == Type::String; }
-    bool isArray() const { return type == Type::Array; }
-    bool isObject() const { return type == Type::Object; }
+    bool isString() const { return type() == Type::String; }
+    bool isArray() const { return type() == Type::Array; }
+    bool isObject() const { return type() == Type::Object; }
+    bool isRaw() const { return type() == Type::Raw; }
 
     // in-place builders for convenience
     // Note: These methods reset the entire JsonValue state, clearing all internal containers
-    void makeArray() {
-        type = Type::Array;
-        s.clear();
-        a.clear();
-        o.clear();
-    }
-
-    void makeObject() {
-        type = Type::Object;
-        s.clear();
-        a.clear();
-        o.clear();
-    }
+    void makeArray() { v_.emplace<Array>(); }
+    void makeObject() { v_.emplace<ObjectStorage>(Object()); }
 
     void addItem(const JsonValue& item) {
-        if (type != Type::Array)
+        if (!isArray())
             throw std::runtime_error("JsonValue is not an array");
-        a.push_back(item);
+        std::get<Array>(v_).push_back(item);
     }
 
-    const JsonValue* tryGet(const std::wstring& key) const;
-    JsonValue* tryGet(const std::wstring& key);
+    // container access; throws std::runtime_error on a type mismatch
+    // Note: mutable members() access drops the object's key index; prefer set()
+    const Array& items() const;
+    Array& items();
+    const Object& members() const;
+    Object& members();
+
+    // Objects with at least kIndexThreshold members keep a hash index over their
+    // keys, so tryGet/set stay O(1) for wide objects. It is built when the object
+    // is constructed or grows wide, never by a const lookup: const lookups on a
+    // shared value may run concurrently (mutation must not overlap them). After
+    // mutable members() access, const lookups scan until a non-const one
+    // rebuilds it.
+    static constexpr size_t kIndexThreshold = 16;
+
+    const JsonValue* tryGet(std::wstring_view key) const;
+    JsonValue* tryGet(std::wstring_view key);
+
+    // Replaces the value of an existing key or appends a new member (insertion
+    // order is preserved). Throws std::runtime_error if this is not an object.
+    JsonValue& set(std::wstring_view key, JsonValue value);
+
+    // Raw values: rawText() returns the source span; materialize() replaces the
+    // value with its parsed form (no-op for other types).
+    std::string_view rawText() const;
+    // Source spans of the elements of a Raw array, found by a bracket/quote scan
+    // (the text was validated when it was skipped). Lets a large array be parsed
+    // element by element with known offsets.
+    std::vector<std::string_view> rawArrayElements() const;
+    void materialize(std::pmr::memory_resource* mr = std::pmr::get_default_resource());
 
     // convenience getters with validation
-    const std::wstring& asString(const wchar_t* ctx) const;
+    const String& asString(const wchar_t* ctx) const;
     std::int64_t asInt(const wchar_t* ctx) const;
+    double asDouble(const wchar_t* ctx) const;
     bool asBool(const wchar_t* ctx) const;
+
+private:
+    friend class JsonPointer;
+    struct KeyIndex;
+
+    struct Raw {
+        std::string_view text;
+    };
+
+    struct ObjectStorage {
+        Object members;
+        // covers members when its covered count equals their size
+        std::unique_ptr<KeyIndex> index;
+
+        explicit ObjectStorage(Object m);
+        ObjectStorage(const ObjectStorage& other);
+        ObjectStorage(ObjectStorage&& other) noexcept;
+        ObjectStorage& operator=(const ObjectStorage& other);
+        ObjectStorage& operator=(ObjectStorage&& other) noexcept;
+        ~ObjectStorage();
+
+        // (Re)builds index if the object is wide and index does not cover it
+        void indexIfWide();
+        const JsonValue* find(std::wstring_view key) const;
+        // hash must be KeyIndex::hashKey(key)
+        const JsonValue* find(std::wstring_view key, size_t hash) const;
+    };
+
+    std::variant<std::monostate, bool, std::int64_t, double, String, Array, ObjectStorage, Raw> v_;
+};
+
+enum class JsonErrorCode {
+    None,
+    // not well-formed JSON
+    Syntax,
+    // a value of the wrong JSON type (or an integer out of range)
+    Type,
+    // well-formed and well-typed, but rejected by validation
+    Invalid,
+    // the file could not be read
+    Io,
 };
 
 struct JsonParseError : public std::runtime_error {
-    explicit JsonParseError(const std::string& msg) : std::runtime_error(msg) {}
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // offset is in code units of the parsed text (bytes for UTF-8), npos if unknown
+    explicit JsonParseError(const std::string& msg, size_t offset = npos, JsonErrorCode code = JsonErrorCode::Syntax)
+        : std::runtime_error(msg), offset(offset), code(code) {}
+
+    size_t offset;
+    JsonErrorCode code;
+};
+
+// Error report of the non-throwing entry points.
+struct JsonError {
+    JsonErrorCode code = JsonErrorCode::None;
+    std::string message;
+    // byte offset into the UTF-8 text (npos if unknown), and its 1-based line and
+    // byte column
+    size_t offset = JsonParseError::npos;
+    size_t line = 0;
+    size_t column = 0;
+    // JSON Pointer of the innermost value the offset lies in, e.g. /commands/3/exe
+    std::wstring path;
+};
+
+// Locates e in the UTF-8 text it was thrown for. Only called on failure: the
+// path is recovered by rescanning text up to the offset, so successful parses
+// pay nothing for it.
+JsonError describeJsonError(const JsonParseError& e, std::string_view text);
+// JSON Pointer of the innermost value containing text[offset]; text must be
+// well-formed up to offset.
+std::wstring jsonPointerAt(std::string_view text, size_t offset);
+
+// Deepest container nesting the parsers accept by default; deeper input throws
+// JsonParseError ("Nesting too deep"). The parsers keep open containers on an
+// explicit stack, so the limit bounds memory, not native stack use. Copying,
+// writing and destroying a DOM do recurse once per level, so with a raised
+// maxDepth deep values should be kept Raw (eagerKeys).
+constexpr size_t kJsonMaxDepth = 512;
+
+struct JsonParseOptions {
+    // On-demand mode: when non-empty, only object members whose key is listed are
+    // decoded. Other member values are fully validated but kept as Raw spans over
+    // the input text, which must outlive the DOM; writeJson emits them verbatim.
+    // Array elements are always decoded.
+    std::span<const std::wstring_view> eagerKeys;
+    size_t maxDepth = kJsonMaxDepth;
+};
+
+// All strings and containers of the returned DOM are allocated from mr, which
+// must outlive the result.
+JsonValue parseJson(const std::wstring& text,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+// Parses UTF-8 encoded JSON (without BOM) directly from the byte buffer.
+// Only string contents are decoded to UTF-16; invalid UTF-8 throws JsonParseError.
+JsonValue parseJsonUtf8(std::string_view text,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+JsonValue parseJsonUtf8(std::string_view text, std::pmr::memory_resource* mr, const JsonParseOptions& options);
+
+struct JsonParseResult {
+    JsonValue value;
+    JsonError error;
+
+    bool ok() const { return error.code == JsonErrorCode::None; }
 };
 
-JsonValue parseJson(const std::wstring& text);
+// parseJsonUtf8 that reports malformed input in the result instead of throwing.
+JsonParseResult tryParseJsonUtf8(std::string_view text,
+    std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+// 64-bit hash of bytes for change detection (not cryptographic). It takes eight
+// bytes per step, so hashing a value's source text costs far less than parsing it.
+std::uint64_t contentHash(std::string_view bytes);
+
+// indentSpaces < 0 selects compact output: no newlines or indentation at all.
 std::wstring writeJson(const JsonValue& v, int indentSpaces = 2);
 
+// Same text as writeJson, written as UTF-8 straight into a byte buffer (appended
+// to out; reserve it to avoid regrowth). Raw values are copied byte-for-byte.
+void writeJsonUtf8(const JsonValue& v, std::string& out, int indentSpaces = 2);
+std::string writeJsonUtf8(const JsonValue& v, int indentSpaces = 2);
+
+// RFC 6901 JSON Pointer ("/defaults/minIntervalSeconds", "/commands/0/exe"),
+// parsed once into steps whose keys are pre-hashed for the object key index.
+// A step that is an array index ("0", "12"; "-" never matches) also selects that
+// element. Raw values are not looked into; materialize them first.
+class JsonPointer {
+public:
+    // Throws JsonParseError unless pointer is "" or "/"-separated tokens with
+    // only the ~0 and ~1 escapes.
+    explicit JsonPointer(std::wstring_view pointer);
+
+    // The value the pointer refers to, or null if there is none.
+    const JsonValue* find(const JsonValue& root) const;
+    JsonValue* find(JsonValue& root) const;
+
+    const std::wstring& text() const { return text_; }
+
+private:
+    friend class JsonPointerSet;
+
+    struct Step {
+        std::wstring key;
+        size_t hash = 0;
+        // array index, or npos if the token is not one
+        size_t index = 0;
+    };
+
+    static const JsonValue* step(const JsonValue& v, const Step& s);
+
+    std::wstring text_;
+    std::vector<Step> steps_;
+};
+
+// Many pointers evaluated against one document in a single traversal: the
+// pointers are merged into a prefix tree, so a step shared by several of them
+// (e.g. "/defaults") is looked up once per document.
+class JsonPointerSet {
+public:
+    explicit JsonPointerSet(std::span<const JsonPointer> pointers);
+
+    size_t size() const { return count_; }
+    // results[i] receives the value at pointers[i], or null; results must hold
+    // size() entries.
+    void findAll(const JsonValue& root, std::span<const JsonValue*> results) const;
+
+private:
+    // The prefix tree in preorder; nodes [i + 1, subtreeEnd) are the subtree of
+    // node i, so a step that finds nothing skips its whole subtree.
+    struct Node {
+        JsonPointer::Step step;
+        size_t depth = 0;
+        size_t subtreeEnd = 0;
+        // pointer positions ending here are targets_[firstTarget, lastTarget)
+        size_t firstTarget = 0;
+        size_t lastTarget = 0;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<size_t> targets_;
+    size_t count_ = 0;
+    size_t maxDepth_ = 0;
+};
+
+// Callbacks for parseJsonUtf8Events. String views are only valid for the
+// duration of the call.
+struct JsonEventHandler {
+    virtual ~JsonEventHandler() = default;
+    virtual void onObjectStart() = 0;
+    virtual void onObjectEnd() = 0;
+    virtual void onArrayStart() = 0;
+    virtual void onArrayEnd() = 0;
+    virtual void onKey(std::wstring_view key) = 0;
+    virtual void onString(std::wstring_view v) = 0;
+    virtual void onInt(std::int64_t v) = 0;
+    virtual void onDouble(double v) = 0;
+    virtual void onBool(bool v) = 0;
+    virtual void onNull() = 0;
+};
+
+// Streaming counterpart of parseJsonUtf8: same grammar and errors, but no DOM is
+// built. Memory use is bounded by the longest string and the nesting depth, not
+// by the document size. Events already delivered stay delivered if a later part
+// of the input throws.
+void parseJsonUtf8Events(std::string_view text, JsonEventHandler& handler);
+
+// Pull reader over UTF-8 text for code that binds values straight into its own
+// structs instead of building a DOM. Grammar and errors are those of
+// parseJsonUtf8; the typed reads throw the same "Expected ... at <ctx>" errors
+// as the JsonValue accessors. Nothing is allocated except decoded strings;
+// keys without escapes are handed out as views into the text.
+class JsonReader {
+public:
+    // Starts reading at text[offset]; offsets reported stay relative to text.
+    explicit JsonReader(std::string_view text, size_t offset = 0) : text_(text), pos_(offset) {}
+
+    // Type of the next value, skipping whitespace before it. Any number reports
+    // Int; throws if no value starts here.
+    JsonValue::Type peekType();
+    // Offset of the next unread byte; after peekType, that of the value itself.
+    size_t offset() const { return pos_; }
+
+    // Consume the opening bracket; the caller checks peekType first.
+    void beginObject();
+    void beginArray();
+    // Advance to the next member or array element. Return false once the
+    // closing bracket has been consumed. The key is UTF-8, valid until the next
+    // call: a view into the text unless it contains escapes, which are decoded
+    // into a scratch buffer.
+    bool nextMember(std::string_view& key);
+    bool nextElement();
+
+    // Consumes null; returns false (consuming nothing) for any other value.
+    bool readNull();
+    void readString(std::wstring& out, const wchar_t* ctx);
+    std::int64_t readInt(const wchar_t* ctx);
+    bool readBool(const wchar_t* ctx);
+    // Validates the next value without decoding it; returns its source span.
+    std::string_view skipValue();
+    // Splits the array starting at the next value (peekType == Array) into its
+    // element spans with a scan of quotes and brackets only, and moves past it.
+    // Nothing is validated: each element must still be read, e.g. by another
+    // JsonReader started at its offset. Returns false, consuming nothing, if the
+    // scan cannot find the end of the array.
+    bool splitArray(std::vector<std::string_view>& elements);
+    std::string_view text() const { return text_; }
+    // Throws unless only whitespace is left.
+    void finish();
+
+private:
+    std::string_view text_;
+    size_t pos_ = 0;
+    // the last begin* has not been followed by its first next* call yet
+    bool afterOpen_ = false;
+    std::wstring key_;
+    std::string keyUtf8_;
+};
+
+// Incremental writer producing the same text as writeJsonUtf8 (including the
+// compact mode for indentSpaces < 0).
+// Output is buffered and handed to sink in chunks of about flushBytes, so a
+// document of any size can be written with bounded memory.
+class JsonStreamWriter {
+public:
+    using Sink = std::function<void(std::string_view utf8)>;
+
+    explicit JsonStreamWriter(Sink sink, int indentSpaces = 2, size_t flushBytes = 64 * 1024);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(std::wstring_view k);
+    void stringValue(std::wstring_view v);
+    void intValue(std::int64_t v);
+    void doubleValue(double v);
+    void boolValue(bool v);
+    void nullValue();
+
+    // Writes the trailing newline and hands the remaining output to the sink.
+    void finish();
+
+private:
+    void beforeValue();
+    void newlineIndent();
+    void maybeFlush();
+
+    Sink sink_;
+    int indentSpaces_;
+    size_t flushBytes_;
+    std::string buf_;
+    // number of children written so far, one entry per open container
+    std::vector<size_t> counts_;
+    bool afterKey_ = false;
+};
+
 } // namespace ler
@@ -0,0 +1,109 @@
+#include "NextDue.h"
+#include "Json.h"
+#include "TimeUtil.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+namespace ler {
+
+static constexpr char kNextDueMagic[8] = { 'L', 'E', 'R', 'D', 'U', 'E', '0', '1' };
+
+namespace {
+
+// The whole sidecar, in native byte order.
+struct NextDueRecord {
+    char magic[8];
+    // FileStamp of the config the window was computed from
+    std::uint64_t configSize;
+    std::uint64_t configWriteTime;
+    // Nothing is due at any now in [notBefore, nextDue) (epoch seconds). Before
+    // notBefore (the clock was set back past a recorded run) commands are due.
+    std::int64_t notBefore;
+    std::int64_t nextDue;
+    // contentHash of the fields above
+    std::uint64_t check;
+};
+
+static_assert(sizeof(NextDueRecord) == 48);
+
+} // namespace
+
+std::wstring nextDuePath(const std::wstring& configPath) {
+    return configPath + L".due";
+}
+
+ConfigStamp stampConfig(const std::wstring& configPath) {
+    ConfigStamp stamp;
+    stamp.file = getFileStamp(configPath);
+    stamp.takenAt = currentFileTime();
+    return stamp;
+}
+
+static std::uint64_t recordCheck(const NextDueRecord& r) {
+    return contentHash(std::string_view(reinterpret_cast<const char*>(&r), offsetof(NextDueRecord, check)));
+}
+
+// The same decision main makes per command: an enabled command is skipped only
+// while 0 <= now - lastRun < minIntervalSeconds. Returns false if one of them
+// has no such window.
+static bool dueWindow(const AppConfig& cfg, std::int64_t& notBefore, std::int64_t& nextDue) {
+    notBefore = std::numeric_limits<std::int64_t>::min();
+    nextDue = std::numeric_limits<std::int64_t>::max();
+    for (const CommandConfig& c : cfg.commands) {
+        if (!c.enabled) continue;
+        std::int64_t last = 0;
+        if (c.minIntervalSeconds <= 0 || !c.hasLastRunUtc || !tryParseIsoUtcToEpochSeconds(c.lastRunUtc, last)) {
+            return false;
+        }
+        notBefore = std::max(notBefore, last);
+        std::int64_t due = last > std::numeric_limits<std::int64_t>::max() - c.minIntervalSeconds
+            ? std::numeric_limits<std::int64_t>::max() : last + c.minIntervalSeconds;
+        nextDue = std::min(nextDue, due);
+    }
+    return notBefore < nextDue;
+}
+
+bool nothingDue(const std::wstring& configPath, std::int64_t now) {
+    try {
+        std::string bytes = readUtf8File(nextDuePath(configPath));
+        NextDueRecord r;
+        if (bytes.size() != sizeof r) return false;
+        std::memcpy(&r, bytes.data(), sizeof r);
+        if (std::memcmp(r.magic, kNextDueMagic, sizeof r.magic) != 0 || r.check != recordCheck(r)) return false;
+        if (now < r.notBefore || now >= r.nextDue) return false;
+
+        FileStamp stamp = getFileStamp(configPath);
+        return stamp.size == r.configSize && stamp.lastWriteTime == r.configWriteTime;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+bool writeNextDue(const std::wstring& configPath, const ConfigStamp& stamp, const AppConfig& cfg) {
+    std::wstring path = nextDuePath(configPath);
+    try {
+        NextDueRecord r{};
+        bool settled = stamp.takenAt >= stamp.file.lastWriteTime + kRacyStampTicks;
+        if (cfg.includes.empty() && settled && dueWindow(cfg, r.notBefore, r.nextDue) &&
+            getFileStamp(configPath) == stamp.file) {
+            std::memcpy(r.magic, kNextDueMagic, sizeof r.magic);
+            r.configSize = stamp.file.size;
+            r.configWriteTime = stamp.file.lastWriteTime;
+            r.check = recordCheck(r);
+            writeUtf8FileAtomic(path, std::string_view(reinterpret_cast<const char*>(&r), sizeof r));
+            return true;
+        }
+    }
+    catch (const std::exception&) {
+        // fall through: the window on record may no longer hold
+    }
+    DeleteFileW(path.c_str());
+    return false;
+}
+
+} // namespace ler
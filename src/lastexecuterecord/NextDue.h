@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Config.h"
+#include "FileUtil.h"
+
+namespace ler {
+
+// <config>.due: the window of time in which no command of a config can be due,
+// recorded by a run for the config file as it was then (its size and last write
+// time). While the file is unchanged and the clock is inside that window, a run
+// has nothing to do and can exit without locking or loading the config: one
+// attribute query and one small read.
+std::wstring nextDuePath(const std::wstring& configPath);
+
+// The config file as a run found it before loading it.
+struct ConfigStamp {
+    FileStamp file;
+    // when file was taken (FILETIME ticks)
+    std::uint64_t takenAt = 0;
+};
+ConfigStamp stampConfig(const std::wstring& configPath);
+
+// True if configPath is still the file the sidecar was written for and no
+// command can be due at now (epoch seconds). Any doubt (no sidecar, a damaged
+// one, a changed config) is false.
+bool nothingDue(const std::wstring& configPath, std::int64_t now);
+
+// Records the window of cfg, loaded from configPath when it had stamp. Nothing
+// is recorded, and an earlier sidecar is removed, if some enabled command is due
+// whenever it is checked (no minIntervalSeconds or no valid lastRunUtc), if the
+// config has include (fragment edits would go unnoticed), or if the file changed
+// since stamp or was written too shortly before it for the stamp to tell a later
+// edit apart. Best effort; returns whether a window is on record.
+bool writeNextDue(const std::wstring& configPath, const ConfigStamp& stamp, const AppConfig& cfg);
+
+} // namespace ler
@@ -0,0 +1,353 @@
+#include "RunHistory.h"
+#include "FileUtil.h"
+#include "Json.h"
+#include "StateJournal.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <map>
+
+namespace ler {
+
+static constexpr char kHistoryJournalMagic[8] = { 'L', 'E', 'R', 'H', 'J', 'R', 'N', '1' };
+static constexpr char kHistoryMagic[8] = { 'L', 'E', 'R', 'H', 'I', 'S', 'T', '1' };
+// bounds of the journal length (in records) that triggers a compaction
+static constexpr size_t kMinCompactRecords = 4096;
+static constexpr size_t kMaxCompactRecords = 65536;
+
+// HistoryRecord::flags
+static constexpr std::uint32_t kTimedOut = 1;
+// size of a journal record; the history file's size is measured in these to
+// decide when the journal is due for compaction
+static constexpr size_t kJournalRecordBytes = 40;
+
+namespace {
+
+// One run, in native byte order. The journal is its magic followed by these.
+struct HistoryRecord {
+    // stateKey of the command name
+    std::uint64_t key;
+    std::int64_t startEpochSeconds;
+    std::uint64_t durationMilliseconds;
+    std::uint32_t exitCode;
+    std::uint32_t flags;
+    // contentHash of the fields above
+    std::uint64_t check;
+};
+
+static_assert(sizeof(HistoryRecord) == kJournalRecordBytes);
+
+// The history file is this header, commandCount entries sorted by key, then
+// the columns of each entry.
+struct HistoryHeader {
+    char magic[8];
+    std::uint64_t commandCount;
+};
+
+// One command's runs. Its columns are stored back to back at offset: starts
+// (zigzag varint deltas, the first from 0), durations (varint milliseconds),
+// exit codes (varint), then a bitmap of timeouts ((runs + 7) / 8 bytes).
+struct HistoryEntry {
+    std::uint64_t key;
+    std::uint64_t runs;
+    std::int64_t lastStart;
+    // the latest start, so a range scan can pass over commands without runs in it
+    std::int64_t maxStart;
+    std::uint64_t offset;
+    std::uint32_t startsBytes;
+    std::uint32_t durationsBytes;
+    std::uint32_t exitCodesBytes;
+    // low half of contentHash(fields above) ^ contentHash(columns)
+    std::uint32_t check;
+};
+
+static_assert(sizeof(HistoryHeader) == 16);
+static_assert(sizeof(HistoryEntry) == 56);
+
+// Appends runs to the columns of one command, continuing its deltas and bitmap.
+struct ColumnWriter {
+    std::string starts;
+    std::string durations;
+    std::string exitCodes;
+    std::string timeouts;
+    std::uint64_t runs = 0;
+    std::int64_t lastStart = 0;
+    std::int64_t maxStart = std::numeric_limits<std::int64_t>::min();
+
+    void add(const RunRecord& run);
+};
+
+} // namespace
+
+std::wstring runHistoryPath(const std::wstring& configPath) {
+    return configPath + L".history";
+}
+
+std::wstring runHistoryJournalPath(const std::wstring& configPath) {
+    return configPath + L".history.journal";
+}
+
+void putVarint(std::string& out, std::uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+bool getVarint(std::string_view& in, std::uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+        auto b = static_cast<unsigned char>(in.front());
+        in.remove_prefix(1);
+        v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+// Start deltas are signed (the clock can be set back); zigzag keeps small
+// negative ones short. Computed modulo 2^64, so any pair of starts round-trips.
+static std::uint64_t startDelta(std::int64_t start, std::int64_t previous) {
+    auto d = static_cast<std::int64_t>(static_cast<std::uint64_t>(start) - static_cast<std::uint64_t>(previous));
+    return (static_cast<std::uint64_t>(d) << 1) ^ static_cast<std::uint64_t>(d >> 63);
+}
+
+static std::int64_t applyDelta(std::int64_t previous, std::uint64_t zigzag) {
+    std::uint64_t d = (zigzag >> 1) ^ (0 - (zigzag & 1));
+    return static_cast<std::int64_t>(static_cast<std::uint64_t>(previous) + d);
+}
+
+void ColumnWriter::add(const RunRecord& run) {
+    putVarint(starts, startDelta(run.startEpochSeconds, lastStart));
+    putVarint(durations, run.durationMilliseconds);
+    putVarint(exitCodes, run.exitCode);
+    if (runs % 8 == 0) timeouts.push_back(0);
+    if (run.timedOut) timeouts.back() = static_cast<char>(timeouts.back() | (1 << (runs % 8)));
+    runs++;
+    lastStart = run.startEpochSeconds;
+    maxStart = std::max(maxStart, run.startEpochSeconds);
+}
+
+static std::uint64_t recordCheck(const HistoryRecord& r) {
+    return contentHash(std::string_view(reinterpret_cast<const char*>(&r), offsetof(HistoryRecord, check)));
+}
+
+static size_t timeoutBytes(std::uint64_t runs) {
+    return static_cast<size_t>(runs / 8 + (runs % 8 != 0));
+}
+
+static std::uint32_t entryCheck(const HistoryEntry& e, std::string_view columns) {
+    std::uint64_t h = contentHash(std::string_view(reinterpret_cast<const char*>(&e), offsetof(HistoryEntry, check)));
+    return static_cast<std::uint32_t>(h ^ contentHash(columns));
+}
+
+// The columns of entry i of a history file, or an empty view if the file is not
+// one or the entry is damaged.
+static std::string_view entryColumns(std::string_view bytes, size_t i, HistoryEntry& e) {
+    std::memcpy(&e, bytes.data() + sizeof(HistoryHeader) + i * sizeof e, sizeof e);
+    // each run takes at least one byte in each of the first three columns
+    if (e.runs > bytes.size()) return {};
+    std::uint64_t length = std::uint64_t{ e.startsBytes } + e.durationsBytes + e.exitCodesBytes + timeoutBytes(e.runs);
+    if (e.offset > bytes.size() || length > bytes.size() - e.offset) return {};
+    std::string_view columns = bytes.substr(static_cast<size_t>(e.offset), static_cast<size_t>(length));
+    if (e.check != entryCheck(e, columns)) return {};
+    return columns;
+}
+
+// Number of entries in a history file, or 0 if it is not one.
+static size_t entryCount(std::string_view bytes) {
+    HistoryHeader h;
+    if (bytes.size() < sizeof h) return 0;
+    std::memcpy(&h, bytes.data(), sizeof h);
+    if (std::memcmp(h.magic, kHistoryMagic, sizeof h.magic) != 0) return 0;
+    if (h.commandCount > (bytes.size() - sizeof h) / sizeof(HistoryEntry)) return 0;
+    return static_cast<size_t>(h.commandCount);
+}
+
+// Decodes the runs of an intact entry into out. False if the columns do not
+// hold exactly e.runs runs.
+static bool decodeRuns(const HistoryEntry& e, std::string_view columns, std::vector<RunRecord>& out) {
+    std::string_view starts = columns.substr(0, e.startsBytes);
+    std::string_view durations = columns.substr(e.startsBytes, e.durationsBytes);
+    std::string_view exitCodes = columns.substr(size_t{ e.startsBytes } + e.durationsBytes, e.exitCodesBytes);
+    std::string_view timeouts = columns.substr(size_t{ e.startsBytes } + e.durationsBytes + e.exitCodesBytes);
+
+    std::int64_t start = 0;
+    for (std::uint64_t i = 0; i < e.runs; i++) {
+        std::uint64_t delta = 0;
+        std::uint64_t exitCode = 0;
+        RunRecord run;
+        if (!getVarint(starts, delta) || !getVarint(durations, run.durationMilliseconds) ||
+            !getVarint(exitCodes, exitCode) || exitCode > std::numeric_limits<std::uint32_t>::max()) {
+            return false;
+        }
+        start = applyDelta(start, delta);
+        run.startEpochSeconds = start;
+        run.exitCode = static_cast<std::uint32_t>(exitCode);
+        run.timedOut = (static_cast<unsigned char>(timeouts[static_cast<size_t>(i / 8)]) >> (i % 8)) & 1;
+        out.push_back(run);
+    }
+    return starts.empty() && durations.empty() && exitCodes.empty();
+}
+
+static RunRecord toRun(const HistoryRecord& r) {
+    RunRecord run;
+    run.startEpochSeconds = r.startEpochSeconds;
+    run.durationMilliseconds = r.durationMilliseconds;
+    run.exitCode = r.exitCode;
+    run.timedOut = (r.flags & kTimedOut) != 0;
+    return run;
+}
+
+// Calls f(record) for each intact record of a journal, in order.
+template <class F>
+static void forEachRecord(std::string_view bytes, F f) {
+    if (bytes.size() < sizeof kHistoryJournalMagic ||
+        std::memcmp(bytes.data(), kHistoryJournalMagic, sizeof kHistoryJournalMagic) != 0) {
+        return;
+    }
+    bytes.remove_prefix(sizeof kHistoryJournalMagic);
+    size_t count = bytes.size() / sizeof(HistoryRecord);
+    for (size_t i = 0; i < count; i++) {
+        HistoryRecord r;
+        std::memcpy(&r, bytes.data() + i * sizeof r, sizeof r);
+        if (r.check == recordCheck(r)) f(r);
+    }
+}
+
+RunHistory::RunHistory(const std::wstring& configPath)
+    : historyPath(runHistoryPath(configPath)), journalPath(runHistoryJournalPath(configPath)) {
+    journalExists = fileExists(journalPath);
+    if (!journalExists) return;
+    std::uint64_t size = getFileSizeBytes(journalPath);
+    if (size < sizeof kHistoryJournalMagic || (size - sizeof kHistoryJournalMagic) % sizeof(HistoryRecord) != 0) {
+        compact();
+        return;
+    }
+    journalRecords = static_cast<size_t>((size - sizeof kHistoryJournalMagic) / sizeof(HistoryRecord));
+}
+
+void RunHistory::append(std::wstring_view name, const RunRecord& run) {
+    HistoryRecord r{};
+    r.key = stateKey(name);
+    r.startEpochSeconds = run.startEpochSeconds;
+    r.durationMilliseconds = run.durationMilliseconds;
+    r.exitCode = run.exitCode;
+    r.flags = run.timedOut ? kTimedOut : 0;
+    r.check = recordCheck(r);
+
+    std::string bytes;
+    // a new journal gets its magic in the same write as its first record
+    if (!journalExists) bytes.assign(kHistoryJournalMagic, sizeof kHistoryJournalMagic);
+    bytes.append(reinterpret_cast<const char*>(&r), sizeof r);
+    appendToFile(journalPath, bytes);
+    journalExists = true;
+    journalRecords++;
+}
+
+bool RunHistory::compactIfDue() {
+    std::uint64_t historyRecords = fileExists(historyPath) ? getFileSizeBytes(historyPath) / kJournalRecordBytes : 0;
+    size_t due = static_cast<size_t>(std::clamp<std::uint64_t>(historyRecords, kMinCompactRecords, kMaxCompactRecords));
+    if (journalRecords < due) return false;
+    compact();
+    return true;
+}
+
+void RunHistory::compact() {
+    // sorted by key, as the entries are stored
+    std::map<std::uint64_t, ColumnWriter> commands;
+    if (fileExists(historyPath)) {
+        MappedFile file(historyPath);
+        size_t count = entryCount(file.text);
+        for (size_t i = 0; i < count; i++) {
+            HistoryEntry e;
+            std::string_view columns = entryColumns(file.text, i, e);
+            if (columns.empty()) continue;
+            ColumnWriter& w = commands[e.key];
+            w.starts.assign(columns.substr(0, e.startsBytes));
+            w.durations.assign(columns.substr(e.startsBytes, e.durationsBytes));
+            w.exitCodes.assign(columns.substr(size_t{ e.startsBytes } + e.durationsBytes, e.exitCodesBytes));
+            w.timeouts.assign(columns.substr(size_t{ e.startsBytes } + e.durationsBytes + e.exitCodesBytes));
+            w.runs = e.runs;
+            w.lastStart = e.lastStart;
+            w.maxStart = e.maxStart;
+        }
+    }
+    if (fileExists(journalPath)) {
+        MappedFile file(journalPath);
+        forEachRecord(file.text, [&](const HistoryRecord& r) { commands[r.key].add(toRun(r)); });
+    }
+
+    std::string bytes;
+    HistoryHeader h{};
+    std::memcpy(h.magic, kHistoryMagic, sizeof h.magic);
+    h.commandCount = commands.size();
+    bytes.append(reinterpret_cast<const char*>(&h), sizeof h);
+
+    std::uint64_t offset = sizeof h + commands.size() * sizeof(HistoryEntry);
+    std::string columns;
+    for (const auto& [key, w] : commands) {
+        HistoryEntry e{};
+        e.key = key;
+        e.runs = w.runs;
+        e.lastStart = w.lastStart;
+        e.maxStart = w.maxStart;
+        e.offset = offset;
+        e.startsBytes = static_cast<std::uint32_t>(w.starts.size());
+        e.durationsBytes = static_cast<std::uint32_t>(w.durations.size());
+        e.exitCodesBytes = static_cast<std::uint32_t>(w.exitCodes.size());
+        size_t begin = columns.size();
+        columns += w.starts;
+        columns += w.durations;
+        columns += w.exitCodes;
+        columns += w.timeouts;
+        e.check = entryCheck(e, std::string_view(columns).substr(begin));
+        offset += columns.size() - begin;
+        bytes.append(reinterpret_cast<const char*>(&e), sizeof e);
+    }
+    bytes += columns;
+
+    writeUtf8FileAtomic(historyPath, bytes);
+    writeUtf8FileAtomic(journalPath, std::string_view(kHistoryJournalMagic, sizeof kHistoryJournalMagic));
+    journalExists = true;
+    journalRecords = 0;
+}
+
+std::vector<RunRecord> readRunHistory(const std::wstring& configPath, std::wstring_view name, std::int64_t since) {
+    std::wstring historyPath = runHistoryPath(configPath);
+    std::wstring journalPath = runHistoryJournalPath(configPath);
+    std::uint64_t key = stateKey(name);
+    std::vector<RunRecord> runs;
+    if (fileExists(historyPath)) {
+        MappedFile file(historyPath);
+        size_t count = entryCount(file.text);
+        // entries are sorted by key: binary search, reading keys in place
+        size_t lo = 0;
+        size_t hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            std::uint64_t midKey;
+            std::memcpy(&midKey, file.text.data() + sizeof(HistoryHeader) + mid * sizeof(HistoryEntry), sizeof midKey);
+            if (midKey < key) lo = mid + 1;
+            else hi = mid;
+        }
+        HistoryEntry e;
+        std::string_view columns = lo < count ? entryColumns(file.text, lo, e) : std::string_view();
+        if (!columns.empty() && e.key == key && e.maxStart >= since && !decodeRuns(e, columns, runs)) {
+            runs.clear();
+        }
+    }
+    if (fileExists(journalPath)) {
+        MappedFile file(journalPath);
+        forEachRecord(file.text, [&](const HistoryRecord& r) {
+            if (r.key == key) runs.push_back(toRun(r));
+        });
+    }
+    std::erase_if(runs, [since](const RunRecord& run) { return run.startEpochSeconds < since; });
+    return runs;
+}
+
+} // namespace ler
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ler {
+
+// Every run of every command, kept beside the config. Each run appends one
+// fixed-size record to <config>.history.journal; once the journal has grown to
+// about the size of <config>.history, it is folded into it and started over.
+// <config>.history stores the runs of each command column by column: start
+// times as varint deltas, durations and exit codes as varints, and a bitmap of
+// timeouts, so a run costs a few bytes there. Commands are matched by name
+// (stateKey), so renaming a command starts its history over.
+std::wstring runHistoryPath(const std::wstring& configPath);
+std::wstring runHistoryJournalPath(const std::wstring& configPath);
+
+struct RunRecord {
+    std::int64_t startEpochSeconds = 0;
+    std::uint64_t durationMilliseconds = 0;
+    std::uint32_t exitCode = 0;
+    bool timedOut = false;
+
+    bool operator==(const RunRecord&) const = default;
+};
+
+// The writer; used under the config lock.
+struct RunHistory {
+    std::wstring historyPath;
+    std::wstring journalPath;
+    // records in the journal file since it was last compacted
+    size_t journalRecords = 0;
+    bool journalExists = false;
+
+    // A journal whose last append was torn by a crash is compacted here, so
+    // that appends stay aligned.
+    explicit RunHistory(const std::wstring& configPath);
+
+    // Appends a run of the command named name; it is on disk when this returns.
+    void append(std::wstring_view name, const RunRecord& run);
+
+    // Compacts once the journal is as large as the history file (but at least
+    // 4096 and at most 65536 records), so that each run is rewritten a bounded
+    // number of times on average. Returns true if it did.
+    bool compactIfDue();
+
+    // Appends the runs in the journal to the columns of their commands in the
+    // history file, then empties the journal. Damaged journal records and
+    // history blocks (checksum mismatch) are dropped.
+    void compact();
+};
+
+// The runs of the command named name that started at or after since (epoch
+// seconds), in the order they were recorded. Only reads, but under the config
+// lock: compaction rewrites the history file and then empties the journal, and
+// a read between the two would count the journal's runs twice (or, read in the
+// other order, miss them). A record being appended meanwhile is not seen.
+std::vector<RunRecord> readRunHistory(const std::wstring& configPath, std::wstring_view name, std::int64_t since);
+
+// The LEB128 varints the history columns are made of. getVarint consumes one
+// from in; false if in ends before its last byte or it is over 10 bytes long.
+void putVarint(std::string& out, std::uint64_t v);
+bool getVarint(std::string_view& in, std::uint64_t& v);
+
+} // namespace ler
@@ -0,0 +1,209 @@
+#include "RunStats.h"
+#include "FileUtil.h"
+#include "Json.h"
+#include "StateJournal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_set>
+
+namespace ler {
+
+static constexpr char kStatsMagic[8] = { 'L', 'E', 'R', 'S', 'K', 'C', 'H', '1' };
+
+// gamma of DurationSketch, and 1 / ln(gamma) to find a value's bin
+static const double kGamma = (1 + DurationSketch::kRelativeAccuracy) / (1 - DurationSketch::kRelativeAccuracy);
+static const double kInverseLogGamma = 1 / std::log(kGamma);
+
+static std::uint64_t zigzag(std::int64_t v) {
+    return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+}
+
+static std::int64_t unzigzag(std::uint64_t v) {
+    return static_cast<std::int64_t>((v >> 1) ^ (0 - (v & 1)));
+}
+
+void DurationSketch::add(std::uint64_t milliseconds) {
+    if (count_ == 0 || milliseconds < min_) min_ = milliseconds;
+    if (count_ == 0 || milliseconds > max_) max_ = milliseconds;
+    count_++;
+    if (milliseconds == 0) {
+        zeroCount_++;
+        return;
+    }
+    addToBin(static_cast<std::int32_t>(std::ceil(std::log(static_cast<double>(milliseconds)) * kInverseLogGamma)), 1);
+    collapse();
+}
+
+void DurationSketch::merge(const DurationSketch& other) {
+    if (other.count_ == 0) return;
+    if (count_ == 0 || other.min_ < min_) min_ = other.min_;
+    if (count_ == 0 || other.max_ > max_) max_ = other.max_;
+    count_ += other.count_;
+    zeroCount_ += other.zeroCount_;
+    for (const Bin& b : other.bins_) addToBin(b.index, b.count);
+    collapse();
+}
+
+void DurationSketch::addToBin(std::int32_t index, std::uint64_t count) {
+    auto it = std::lower_bound(bins_.begin(), bins_.end(), index,
+        [](const Bin& b, std::int32_t i) { return b.index < i; });
+    if (it != bins_.end() && it->index == index) it->count += count;
+    else bins_.insert(it, Bin{ index, count });
+}
+
+// Folds the lowest bins into the next one until kMaxBins remain.
+void DurationSketch::collapse() {
+    if (bins_.size() <= kMaxBins) return;
+    size_t excess = bins_.size() - kMaxBins;
+    for (size_t i = 0; i < excess; i++) bins_[excess].count += bins_[i].count;
+    bins_.erase(bins_.begin(), bins_.begin() + static_cast<std::ptrdiff_t>(excess));
+}
+
+std::uint64_t DurationSketch::quantile(double q) const {
+    if (count_ == 0) return 0;
+    double rank = std::clamp(q, 0.0, 1.0) * static_cast<double>(count_ - 1);
+    std::uint64_t seen = zeroCount_;
+    if (rank < static_cast<double>(seen)) return 0;
+    for (const Bin& b : bins_) {
+        seen += b.count;
+        if (rank >= static_cast<double>(seen)) continue;
+        // the value in the middle (relative to both ends) of (gamma^(i-1), gamma^i]
+        double value = 2 * std::pow(kGamma, b.index) / (kGamma + 1);
+        if (value <= static_cast<double>(min_)) return min_;
+        if (value >= static_cast<double>(max_)) return max_;
+        return static_cast<std::uint64_t>(value + 0.5);
+    }
+    return max_;
+}
+
+void DurationSketch::encode(std::string& out) const {
+    putVarint(out, count_);
+    putVarint(out, zeroCount_);
+    putVarint(out, min_);
+    putVarint(out, max_);
+    putVarint(out, bins_.size());
+    std::int64_t previous = 0;
+    for (const Bin& b : bins_) {
+        putVarint(out, zigzag(b.index - previous));
+        putVarint(out, b.count);
+        previous = b.index;
+    }
+}
+
+bool DurationSketch::decode(std::string_view& in) {
+    std::uint64_t binCount = 0;
+    if (!getVarint(in, count_) || !getVarint(in, zeroCount_) || !getVarint(in, min_) || !getVarint(in, max_) ||
+        !getVarint(in, binCount) || binCount > kMaxBins || min_ > max_) {
+        return false;
+    }
+    bins_.clear();
+    std::uint64_t total = zeroCount_;
+    std::int64_t index = 0;
+    for (std::uint64_t i = 0; i < binCount; i++) {
+        std::uint64_t delta = 0;
+        Bin b{};
+        if (!getVarint(in, delta) || !getVarint(in, b.count)) return false;
+        index += unzigzag(delta);
+        // bins are stored in increasing order, and have a count
+        if ((i != 0 && unzigzag(delta) <= 0) || index < std::numeric_limits<std::int32_t>::min() ||
+            index > std::numeric_limits<std::int32_t>::max() || b.count == 0) return false;
+        b.index = static_cast<std::int32_t>(index);
+        bins_.push_back(b);
+        total += b.count;
+    }
+    return total == count_;
+}
+
+void CommandStats::add(const RunRecord& run) {
+    runs++;
+    if (run.exitCode != 0 || run.timedOut) failures++;
+    if (run.timedOut) timeouts++;
+    durations.add(run.durationMilliseconds);
+}
+
+std::wstring runStatsPath(const std::wstring& configPath) {
+    return configPath + L".stats";
+}
+
+// The file is the magic, the contentHash of the rest, then the number of
+// commands and each command's stateKey (8 bytes), runs, failures, timeouts and
+// durations, as varints.
+static bool decodeStats(std::string_view bytes, std::unordered_map<std::uint64_t, CommandStats>& byKey) {
+    std::uint64_t check = 0;
+    if (bytes.size() < sizeof kStatsMagic + sizeof check ||
+        std::memcmp(bytes.data(), kStatsMagic, sizeof kStatsMagic) != 0) {
+        return false;
+    }
+    std::memcpy(&check, bytes.data() + sizeof kStatsMagic, sizeof check);
+    bytes.remove_prefix(sizeof kStatsMagic + sizeof check);
+    if (check != contentHash(bytes)) return false;
+
+    std::uint64_t count = 0;
+    if (!getVarint(bytes, count)) return false;
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::uint64_t key = 0;
+        if (bytes.size() < sizeof key) return false;
+        std::memcpy(&key, bytes.data(), sizeof key);
+        bytes.remove_prefix(sizeof key);
+        CommandStats s;
+        if (!getVarint(bytes, s.runs) || !getVarint(bytes, s.failures) || !getVarint(bytes, s.timeouts) ||
+            !s.durations.decode(bytes) || s.durations.count() != s.runs) {
+            return false;
+        }
+        byKey[key] = std::move(s);
+    }
+    return bytes.empty();
+}
+
+static std::unordered_map<std::uint64_t, CommandStats> loadStats(const std::wstring& path) {
+    std::unordered_map<std::uint64_t, CommandStats> byKey;
+    if (!fileExists(path)) return byKey;
+    MappedFile file(path);
+    if (!decodeStats(file.text, byKey)) byKey.clear();
+    return byKey;
+}
+
+std::unordered_map<std::uint64_t, CommandStats> readRunStats(const std::wstring& configPath) {
+    return loadStats(runStatsPath(configPath));
+}
+
+RunStats::RunStats(const std::wstring& configPath) : path(runStatsPath(configPath)) {
+}
+
+void RunStats::record(std::wstring_view name, const RunRecord& run) {
+    if (!loaded) {
+        byKey = loadStats(path);
+        loaded = true;
+    }
+    byKey[stateKey(name)].add(run);
+    dirty = true;
+}
+
+void RunStats::save(const std::vector<CommandConfig>& commands) {
+    if (!dirty) return;
+    std::unordered_set<std::uint64_t> current;
+    current.reserve(commands.size());
+    for (const CommandConfig& c : commands) current.insert(stateKey(c.name));
+    std::erase_if(byKey, [&](const auto& entry) { return !current.contains(entry.first); });
+
+    std::string body;
+    putVarint(body, byKey.size());
+    for (const auto& [key, s] : byKey) {
+        body.append(reinterpret_cast<const char*>(&key), sizeof key);
+        putVarint(body, s.runs);
+        putVarint(body, s.failures);
+        putVarint(body, s.timeouts);
+        s.durations.encode(body);
+    }
+    std::uint64_t check = contentHash(body);
+    std::string bytes(kStatsMagic, sizeof kStatsMagic);
+    bytes.append(reinterpret_cast<const char*>(&check), sizeof check);
+    bytes += body;
+    writeUtf8FileAtomic(path, bytes);
+    dirty = false;
+}
+
+} // namespace ler
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Config.h"
+#include "RunHistory.h"
+
+namespace ler {
+
+// Quantiles of durations (milliseconds) in constant memory, DDSketch style:
+// a value x >= 1 is counted in bin ceil(log_gamma(x)) with
+// gamma = (1 + kRelativeAccuracy) / (1 - kRelativeAccuracy), so any quantile is
+// reported within kRelativeAccuracy of a recorded value. At most kMaxBins bins
+// are kept; beyond that the lowest ones are collapsed, which only costs
+// accuracy at the low end. Sketches of the same kind merge exactly.
+class DurationSketch {
+public:
+    static constexpr double kRelativeAccuracy = 0.01;
+    static constexpr size_t kMaxBins = 256;
+
+    void add(std::uint64_t milliseconds);
+    void merge(const DurationSketch& other);
+
+    // The value at rank q * (count - 1), q in [0, 1]; 0 if empty
+    std::uint64_t quantile(double q) const;
+    std::uint64_t count() const { return count_; }
+    std::uint64_t min() const { return min_; }
+    std::uint64_t max() const { return max_; }
+    size_t binCount() const { return bins_.size(); }
+
+    // Appends / reads back the sketch as varints. decode returns false (and
+    // leaves the sketch unspecified) if in does not start with one.
+    void encode(std::string& out) const;
+    bool decode(std::string_view& in);
+
+private:
+    struct Bin {
+        std::int32_t index;
+        std::uint64_t count;
+    };
+
+    void addToBin(std::int32_t index, std::uint64_t count);
+    void collapse();
+
+    // sorted by index
+    std::vector<Bin> bins_;
+    // values below 1 ms, which have no bin
+    std::uint64_t zeroCount_ = 0;
+    std::uint64_t count_ = 0;
+    std::uint64_t min_ = 0;
+    std::uint64_t max_ = 0;
+};
+
+// What the runs of one command add up to.
+struct CommandStats {
+    std::uint64_t runs = 0;
+    // runs that exited with a nonzero code or timed out
+    std::uint64_t failures = 0;
+    std::uint64_t timeouts = 0;
+    DurationSketch durations;
+
+    void add(const RunRecord& run);
+};
+
+// <config>.stats: a CommandStats per command (matched by stateKey), rewritten
+// at the end of each run that ran something. Its size depends on the number of
+// commands of the config, not of runs: the stats of a command that was removed
+// or renamed are dropped by the next rewrite. Used under the config lock.
+std::wstring runStatsPath(const std::wstring& configPath);
+
+struct RunStats {
+    std::wstring path;
+    std::unordered_map<std::uint64_t, CommandStats> byKey;
+    bool loaded = false;
+    bool dirty = false;
+
+    // Reads nothing: the file is loaded by the first record.
+    explicit RunStats(const std::wstring& configPath);
+
+    void record(std::wstring_view name, const RunRecord& run);
+    // Writes the file if a run was recorded since it was loaded, keeping only
+    // the stats of commands (those of the config as it is now).
+    void save(const std::vector<CommandConfig>& commands);
+};
+
+// The stats of every command in <config>.stats by stateKey; empty if there is
+// none, or if it is damaged (it is then started over by the next run).
+std::unordered_map<std::uint64_t, CommandStats> readRunStats(const std::wstring& configPath);
+
+} // namespace ler
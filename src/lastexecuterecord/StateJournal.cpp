@@ -0,0 +1,151 @@
+#include "StateJournal.h"
+#include "FileUtil.h"
+#include "Json.h"
+#include "TimeUtil.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace ler {
+
+static constexpr char kJournalMagic[8] = { 'L', 'E', 'R', 'J', 'R', 'N', 'L', '1' };
+static constexpr char kStateMagic[8] = { 'L', 'E', 'R', 'S', 'T', 'A', 'T', '1' };
+// journals shorter than this are never worth compacting
+static constexpr size_t kMinCompactRecords = 256;
+
+// StateRecord::flags
+static constexpr std::uint32_t kHasLastRun = 1;
+static constexpr std::uint32_t kHasExitCode = 2;
+
+namespace {
+
+// One command's state, in native byte order. Both files are the magic followed
+// by these records.
+struct StateRecord {
+    // stateKey of the command name
+    std::uint64_t key;
+    std::int64_t lastRunEpochSeconds;
+    std::int64_t lastExitCode;
+    std::uint32_t flags;
+    // low half of the contentHash of the fields above
+    std::uint32_t check;
+};
+
+static_assert(sizeof(StateRecord) == 32);
+
+} // namespace
+
+std::wstring stateJournalPath(const std::wstring& configPath) {
+    return configPath + L".journal";
+}
+
+std::wstring stateFilePath(const std::wstring& configPath) {
+    return configPath + L".state";
+}
+
+std::uint64_t stateKey(std::wstring_view name) {
+    return contentHash(std::string_view(reinterpret_cast<const char*>(name.data()), name.size() * sizeof(wchar_t)));
+}
+
+static std::uint32_t recordCheck(const StateRecord& r) {
+    return static_cast<std::uint32_t>(contentHash(std::string_view(reinterpret_cast<const char*>(&r), offsetof(StateRecord, check))));
+}
+
+static StateRecord makeRecord(const CommandConfig& c) {
+    StateRecord r{};
+    r.key = stateKey(c.name);
+    if (c.hasLastRunUtc && tryParseIsoUtcToEpochSeconds(c.lastRunUtc, r.lastRunEpochSeconds)) r.flags |= kHasLastRun;
+    else r.lastRunEpochSeconds = 0;
+    if (c.hasLastExitCode) {
+        r.flags |= kHasExitCode;
+        r.lastExitCode = c.lastExitCode;
+    }
+    r.check = recordCheck(r);
+    return r;
+}
+
+// Reads the records of path into latest (later ones win). Returns how many the
+// file holds; damaged is set if any of it had to be skipped.
+static size_t readRecords(const std::wstring& path, const char (&magic)[8],
+    std::unordered_map<std::uint64_t, StateRecord>& latest, bool& damaged) {
+    MappedFile file(path);
+    std::string_view bytes = file.text;
+    if (bytes.size() < sizeof magic || std::memcmp(bytes.data(), magic, sizeof magic) != 0) {
+        damaged = true;
+        return 0;
+    }
+    bytes.remove_prefix(sizeof magic);
+    if (bytes.size() % sizeof(StateRecord) != 0) damaged = true;
+
+    size_t count = bytes.size() / sizeof(StateRecord);
+    for (size_t i = 0; i < count; i++) {
+        StateRecord r;
+        std::memcpy(&r, bytes.data() + i * sizeof r, sizeof r);
+        if (r.check != recordCheck(r)) {
+            damaged = true;
+            continue;
+        }
+        latest[r.key] = r;
+    }
+    return count;
+}
+
+StateJournal::StateJournal(const std::wstring& configPath)
+    : journalPath(stateJournalPath(configPath)), statePath(stateFilePath(configPath)) {
+}
+
+void StateJournal::apply(AppConfig& cfg) {
+    std::unordered_map<std::uint64_t, StateRecord> latest;
+    bool damaged = false;
+    if (fileExists(statePath)) readRecords(statePath, kStateMagic, latest, damaged);
+    journalExists = fileExists(journalPath);
+    journalRecords = journalExists ? readRecords(journalPath, kJournalMagic, latest, damaged) : 0;
+
+    if (!latest.empty()) {
+        for (CommandConfig& c : cfg.commands) {
+            auto it = latest.find(stateKey(c.name));
+            if (it == latest.end()) continue;
+            const StateRecord& r = it->second;
+            c.hasLastRunUtc = (r.flags & kHasLastRun) != 0;
+            c.lastRunUtc = c.hasLastRunUtc ? formatEpochSecondsAsIsoUtc(r.lastRunEpochSeconds) : std::wstring();
+            c.hasLastExitCode = (r.flags & kHasExitCode) != 0;
+            c.lastExitCode = c.hasLastExitCode ? r.lastExitCode : 0;
+        }
+    }
+    if (damaged) compact(cfg);
+}
+
+void StateJournal::append(const CommandConfig& c) {
+    StateRecord r = makeRecord(c);
+    std::string bytes;
+    // a new journal gets its magic in the same write as its first record
+    if (!journalExists) bytes.assign(kJournalMagic, sizeof kJournalMagic);
+    bytes.append(reinterpret_cast<const char*>(&r), sizeof r);
+    appendToFile(journalPath, bytes);
+    journalExists = true;
+    journalRecords++;
+}
+
+bool StateJournal::compactIfDue(const AppConfig& cfg) {
+    if (journalRecords < std::max(kMinCompactRecords, cfg.commands.size())) return false;
+    compact(cfg);
+    return true;
+}
+
+void StateJournal::compact(const AppConfig& cfg) {
+    std::string bytes(kStateMagic, sizeof kStateMagic);
+    bytes.reserve(bytes.size() + cfg.commands.size() * sizeof(StateRecord));
+    for (const CommandConfig& c : cfg.commands) {
+        StateRecord r = makeRecord(c);
+        bytes.append(reinterpret_cast<const char*>(&r), sizeof r);
+    }
+    writeUtf8FileAtomic(statePath, bytes);
+    writeUtf8FileAtomic(journalPath, std::string_view(kJournalMagic, sizeof kJournalMagic));
+    journalExists = true;
+    journalRecords = 0;
+}
+
+} // namespace ler
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Config.h"
+
+namespace ler {
+
+// Run state kept out of the config file (stateStore "journal"). Each completed
+// command appends one fixed-size record to <config>.journal; once the journal
+// holds about as many records as there are commands, it is folded into
+// <config>.state (one record per command) and started over. Recorded state
+// overrides the lastRunUtc/lastExitCode written in the config, which are then
+// only initial values. Commands are matched by name.
+std::wstring stateJournalPath(const std::wstring& configPath);
+std::wstring stateFilePath(const std::wstring& configPath);
+// What records identify a command by: the contentHash of its name (UTF-16).
+std::uint64_t stateKey(std::wstring_view name);
+
+struct StateJournal {
+    std::wstring journalPath;
+    std::wstring statePath;
+    // records in the journal file since it was last compacted
+    size_t journalRecords = 0;
+    bool journalExists = false;
+
+    explicit StateJournal(const std::wstring& configPath);
+
+    // Overlays the recorded state onto cfg.commands: the state file first, then
+    // the journal in order. Records that fail their checksum (a write torn by a
+    // crash) are dropped, and the files compacted so appends stay aligned.
+    void apply(AppConfig& cfg);
+
+    // Appends c's current state; it is on disk when this returns.
+    void append(const CommandConfig& c);
+
+    // Compacts once the journal has grown to the size of the command list, so
+    // that each append costs O(1) on average. Returns true if it did.
+    bool compactIfDue(const AppConfig& cfg);
+
+    // Writes the state of every command of cfg to the state file, then empties
+    // the journal. A crash in between is harmless: replaying the journal over
+    // the new state file gives the same result.
+    void compact(const AppConfig& cfg);
+};
+
+} // namespace ler
@@ -0,0 +1,32 @@
+#include "StringPool.h"
+
+namespace ler {
+
+SharedString::SharedString(std::wstring_view s) {
+    if (!s.empty()) text_ = std::make_shared<const std::wstring>(s);
+}
+
+const std::wstring& SharedString::str() const {
+    static const std::wstring empty;
+    return text_ ? *text_ : empty;
+}
+
+SharedString StringPool::intern(std::wstring_view s) {
+    if (s.empty()) return SharedString();
+    auto it = byText_.find(s);
+    if (it == byText_.end()) {
+        auto text = std::make_shared<const std::wstring>(s);
+        it = byText_.emplace(std::wstring_view(*text), std::move(text)).first;
+    }
+    return SharedString(it->second);
+}
+
+void StringPool::merge(StringPool& other) {
+    byText_.merge(other.byText_);
+}
+
+void StringPool::pruneUnshared() {
+    std::erase_if(byText_, [](const auto& entry) { return entry.second.use_count() <= 2; });
+}
+
+} // namespace ler
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace ler {
+
+// An immutable string whose buffer may be shared by every value with the same
+// text (see StringPool); copying one copies a pointer. It reads like a const
+// std::wstring. An empty one owns nothing.
+class SharedString {
+public:
+    SharedString() = default;
+    // A string of its own, not shared with any other
+    SharedString(std::wstring_view s);
+    SharedString(const wchar_t* s) : SharedString(std::wstring_view(s)) {}
+    SharedString(const std::wstring& s) : SharedString(std::wstring_view(s)) {}
+
+    const std::wstring& str() const;
+    operator const std::wstring&() const { return str(); }
+    operator std::wstring_view() const { return str(); }
+
+    bool empty() const { return !text_ || text_->empty(); }
+    size_t size() const { return text_ ? text_->size() : 0; }
+    const wchar_t* c_str() const { return str().c_str(); }
+
+    friend bool operator==(const SharedString& a, const SharedString& b) {
+        return a.text_ == b.text_ || a.str() == b.str();
+    }
+
+private:
+    friend class StringPool;
+    explicit SharedString(std::shared_ptr<const std::wstring> text) : text_(std::move(text)) {}
+
+    std::shared_ptr<const std::wstring> text_;
+};
+
+// Interns strings: every intern() of the same text returns a SharedString over
+// one buffer. The pool only indexes the buffers; each SharedString keeps its
+// own alive, so it may outlive the pool. Not thread-safe.
+class StringPool {
+public:
+    SharedString intern(std::wstring_view s);
+
+    // Moves in the entries of other whose text this pool does not hold yet.
+    void merge(StringPool& other);
+
+    // Drops the entries held by at most one SharedString: nothing was shared
+    // through them, and keeping every unique string indexed would cost more
+    // than the sharing saves. Call once the values are in place.
+    void pruneUnshared();
+
+    size_t size() const { return byText_.size(); }
+
+private:
+    // keys view the buffers they map to
+    std::unordered_map<std::wstring_view, std::shared_ptr<const std::wstring>> byText_;
+};
+
+} // namespace ler
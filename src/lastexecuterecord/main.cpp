@@ -1,13 +1,24 @@
 ﻿#include <Windows.h>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "CommandRunner.h"
 #include "Config.h"
+#include "ConfigSnapshot.h"
 #include "FileUtil.h"
 #include "Json.h"
 #include "NetworkUtil.h"
+#include "NextDue.h"
+#include "RunHistory.h"
+#include "RunStats.h"
+#include "StateJournal.h"
 #include "TimeUtil.h"
 
 static void printUsage(const wchar_t* exeName) {
@@ -15,16 +26,120 @@ static void printUsage(const wchar_t* exeName) {
 		<< L"LastExecuteRecord - run commands from JSON config once per invocation\n\n"
 		<< L"Copyright (c) 2026 Kazushi Kamegawa\n\n"
 		<< L"Usage:\n"
-		<< L"  " << exeName << L" [--config <path>] [--dry-run] [--verbose]\n\n"
+		<< L"  " << exeName << L" [--config <path>] [--dry-run] [--verbose]\n"
+		<< L"  " << exeName << L" [--config <path>] --history <name> [--since <time>]\n"
+		<< L"  " << exeName << L" [--config <path>] --stats\n"
+		<< L"  " << exeName << L" --lint <dir>\n\n"
 		<< L"Options:\n"
 		<< L"  --config <path>  Path to config JSON (default: %USERPROFILE%\\.lastexecrecord\\config.json)\n"
 		<< L"  --dry-run        Do not execute; only show decisions\n"
-		<< L"  --verbose        Print skip reasons and detailed output\n";
+		<< L"  --verbose        Print skip reasons and detailed output\n"
+		<< L"  --history <name> Print the recorded runs of the command named name; runs nothing\n"
+		<< L"  --since <time>   With --history, only runs started at or after time (YYYY-MM-DDTHH:MM:SSZ)\n"
+		<< L"  --stats          Print runs, failure rate and p50/p95/p99 duration of each command; runs nothing\n"
+		<< L"  --lint <dir>     Validate every *.json below dir and report each error; runs nothing\n";
+}
+
+// "path(line,col): error: message (at /json/pointer)", the location parts only
+// when known.
+static std::wstring formatError(const std::wstring& path, const ler::JsonError& e) {
+	std::wostringstream out;
+	out << path;
+	if (e.line != 0) out << L"(" << e.line << L"," << e.column << L")";
+	out << L": error: " << std::wstring(e.message.begin(), e.message.end());
+	if (e.code != ler::JsonErrorCode::Io && e.line != 0) {
+		out << L" (at " << (e.path.empty() ? L"root" : e.path) << L")";
+	}
+	return out.str();
+}
+
+static int runLint(const std::wstring& dir) {
+	try {
+		std::vector<std::wstring> files = ler::listFilesRecursive(dir, L".json");
+		std::vector<ler::JsonError> errors = ler::lintConfigFiles(files);
+		size_t invalid = 0;
+		for (size_t i = 0; i < files.size(); i++) {
+			if (errors[i].code == ler::JsonErrorCode::None) continue;
+			std::wcerr << formatError(files[i], errors[i]) << L"\n";
+			invalid++;
+		}
+		std::wcout << files.size() << L" config(s) checked, " << invalid << L" invalid\n";
+		return invalid ? 1 : 0;
+	}
+	catch (const std::exception& ex) {
+		std::string m = ex.what();
+		std::wcerr << L"Fatal: " << std::wstring(m.begin(), m.end()) << L"\n";
+		return 2;
+	}
+}
+
+// Milliseconds as "12.345s"
+static std::wstring formatSeconds(std::uint64_t milliseconds) {
+	std::wostringstream out;
+	out << milliseconds / 1000 << L"." << std::setw(3) << std::setfill(L'0') << milliseconds % 1000 << L"s";
+	return out.str();
+}
+
+// One line per run: start, exit code, duration (and a timeout mark).
+static int runHistoryReport(const std::wstring& configPath, const std::wstring& name, std::int64_t since) {
+	try {
+		// a run compacts the history under this lock (see readRunHistory)
+		ler::FileLock lock = ler::acquireLockFile(configPath + L".lock");
+		std::vector<ler::RunRecord> runs = ler::readRunHistory(configPath, name, since);
+		for (const ler::RunRecord& r : runs) {
+			std::wcout << ler::formatEpochSecondsAsIsoUtc(r.startEpochSeconds) << L"  exitCode=" << r.exitCode
+				<< L"  " << formatSeconds(r.durationMilliseconds) << (r.timedOut ? L"  (timed out)" : L"") << L"\n";
+		}
+		std::wcout << runs.size() << L" run(s) of " << name << L"\n";
+		return 0;
+	}
+	catch (const std::exception& ex) {
+		std::string m = ex.what();
+		std::wcerr << L"Fatal: " << std::wstring(m.begin(), m.end()) << L"\n";
+		return 2;
+	}
+}
+
+// One line per command of the config with recorded runs, in config order.
+static int runStatsReport(const std::wstring& configPath) {
+	try {
+		// loading rewrites the snapshots of edited fragments, which only a
+		// holder of the run lock may do
+		ler::FileLock lock = ler::acquireLockFile(configPath + L".lock");
+		ler::ConfigLoadResult loaded = ler::tryLoadAndValidateConfig(configPath);
+		if (!loaded.ok()) {
+			std::wcerr << L"Fatal: " << formatError(loaded.errorFile, loaded.error) << L"\n";
+			return 2;
+		}
+		std::unordered_map<std::uint64_t, ler::CommandStats> stats = ler::readRunStats(configPath);
+		size_t reported = 0;
+		for (const ler::CommandConfig& c : loaded.config.commands) {
+			auto it = stats.find(ler::stateKey(c.name));
+			if (it == stats.end()) continue;
+			const ler::CommandStats& s = it->second;
+			const ler::DurationSketch& d = s.durations;
+			std::wcout << c.name << L": runs=" << s.runs << L" failed=" << std::fixed << std::setprecision(1)
+				<< 100.0 * static_cast<double>(s.failures) / static_cast<double>(s.runs) << L"% timeouts=" << s.timeouts
+				<< L" p50=" << formatSeconds(d.quantile(0.50)) << L" p95=" << formatSeconds(d.quantile(0.95))
+				<< L" p99=" << formatSeconds(d.quantile(0.99)) << L" max=" << formatSeconds(d.max()) << L"\n";
+			reported++;
+		}
+		std::wcout << reported << L" command(s) with recorded runs\n";
+		return 0;
+	}
+	catch (const std::exception& ex) {
+		std::string m = ex.what();
+		std::wcerr << L"Fatal: " << std::wstring(m.begin(), m.end()) << L"\n";
+		return 2;
+	}
 }
 
 int wmain(int argc, wchar_t* argv[]) {
 	bool dryRun = false;
 	bool verbose = false;
+	bool showStats = false;
+	std::optional<std::wstring> historyName;
+	std::int64_t historySince = (std::numeric_limits<std::int64_t>::min)();
 	std::wstring configPath = ler::defaultConfigPath();
 
 	// Parse arguments (skip if argc <= 1, i.e., no arguments provided)
@@ -51,6 +166,33 @@ int wmain(int argc, wchar_t* argv[]) {
 				configPath = argv[++i];
 				continue;
 			}
+			if (a == L"--stats") {
+				showStats = true;
+				continue;
+			}
+			if (a == L"--history") {
+				if (i + 1 >= argc) {
+					std::wcerr << L"--history requires a command name\n";
+					return 2;
+				}
+				historyName = argv[++i];
+				continue;
+			}
+			if (a == L"--since") {
+				if (i + 1 >= argc || !ler::tryParseIsoUtcToEpochSeconds(argv[i + 1], historySince)) {
+					std::wcerr << L"--since requires a time (YYYY-MM-DDTHH:MM:SSZ)\n";
+					return 2;
+				}
+				i++;
+				continue;
+			}
+			if (a == L"--lint") {
+				if (i + 1 >= argc) {
+					std::wcerr << L"--lint requires a directory\n";
+					return 2;
+				}
+				return runLint(argv[i + 1]);
+			}
 
 			std::wcerr << L"Unknown argument: " << a << L"\n";
 			printUsage(argv[0]);
@@ -58,14 +200,62 @@ int wmain(int argc, wchar_t* argv[]) {
 		}
 	}
 
+	if (showStats) return runStatsReport(configPath);
+	if (historyName) return runHistoryReport(configPath, *historyName, historySince);
+	if (historySince != (std::numeric_limits<std::int64_t>::min)()) {
+		std::wcerr << L"--since requires --history\n";
+		return 2;
+	}
+
 	try {
+		// Most invocations find nothing due. The sidecar an earlier run left says
+		// so from the config's stamp alone, before locking or loading anything.
+		if (!dryRun && ler::nothingDue(configPath, ler::nowEpochSecondsUtc())) {
+			if (verbose) std::wcout << L"[skip] No command is due yet\n";
+			return 0;
+		}
+
 		// Auto-generate a sample config once (do not overwrite) to improve onboarding.
 		ler::ensureSampleConfigExists(configPath);
 
 		// Prevent concurrent runs against the same config file.
 		ler::FileLock lock = ler::acquireLockFile(configPath + L".lock");
+		ler::ConfigStamp stamp = ler::stampConfig(configPath);
+
+		// The config DOM lives for the whole invocation and is never freed piecemeal,
+		// so it is carved out of a monotonic arena released at exit.
+		std::pmr::monotonic_buffer_resource arena;
+		// An unchanged config comes from its compiled snapshot; otherwise it is
+		// parsed and validated, and the snapshot rebuilt for the next run. The
+		// snapshot of the version before the edit still has the commands that
+		// were not touched, so only the edited ones are read again.
+		ler::AppConfig cfg;
+		ler::AppConfig previous;
+		if (!ler::loadConfigSnapshot(configPath, cfg, &arena, &previous)) {
+			ler::ConfigLoadResult loaded = ler::tryLoadAndValidateConfig(configPath, &arena, &previous);
+			if (!loaded.ok()) {
+				std::wcerr << L"Fatal: " << formatError(loaded.errorFile, loaded.error) << L"\n";
+				return 2;
+			}
+			cfg = std::move(loaded.config);
+			ler::writeConfigSnapshot(configPath, cfg);
+		}
 
-		ler::AppConfig cfg = ler::loadAndValidateConfig(configPath);
+		// With stateStore "journal" run state lives beside the config, which is
+		// never written.
+		std::optional<ler::StateJournal> journal;
+		if (cfg.stateStore == ler::StateStore::Journal) {
+			journal.emplace(configPath);
+			journal->apply(cfg);
+		}
+		// Every run is also appended to the run history (RunHistory.h) and
+		// counted in the duration stats of its command (RunStats.h).
+		std::optional<ler::RunHistory> history;
+		std::optional<ler::RunStats> stats;
+		if (!dryRun) {
+			history.emplace(configPath);
+			stats.emplace(configPath);
+		}
 
 		// Check network status early if networkOption requires it
 		if (!ler::shouldExecuteBasedOnNetwork(cfg.networkOption)) {
@@ -78,8 +268,8 @@ int wmain(int argc, wchar_t* argv[]) {
 
 		// If localOnly pinning updated config, persist it now.
 		if (cfg.dirty) {
-			ler::applyCommandsToJson(cfg);
-			ler::writeWStringToUtf8FileAtomic(configPath, ler::writeJson(cfg.root));
+			ler::saveConfig(configPath, cfg);
+			ler::writeConfigSnapshot(configPath, cfg);
 			cfg.dirty = false;
 		}
 
@@ -105,7 +295,8 @@ int wmain(int argc, wchar_t* argv[]) {
 						std::wcout << L"[warn] " << c.name << L": lastRunUtc has invalid format; treating as never run\n";
 					}
 					c.hasLastRunUtc = false;
-					cfg.dirty = true;
+					if (journal) journal->append(c);
+					else cfg.dirty = true;
 				}
 			}
 
@@ -123,10 +314,10 @@ int wmain(int argc, wchar_t* argv[]) {
 			std::wcout << L"[run ] " << c.name << L"\n";
 
 			if (dryRun) {
-				std::wcout << L"       exe: " << c.exe << L"\n";
+				std::wcout << L"       exe: " << c.exe.str() << L"\n";
 				if (verbose && !c.args.empty()) {
 					std::wcout << L"       args:";
-					for (const auto& a : c.args) std::wcout << L" " << a;
+					for (const auto& a : c.args) std::wcout << L" " << a.str();
 					std::wcout << L"\n";
 				}
 				continue;
@@ -158,13 +349,23 @@ int wmain(int argc, wchar_t* argv[]) {
 			c.lastRunUtc = ler::formatEpochSecondsAsIsoUtc(startEpoch);
 			c.hasLastExitCode = true;
 			c.lastExitCode = rr.exitCode;
-			cfg.dirty = true;
+			if (journal) journal->append(c);
+			else cfg.dirty = true;
+			ler::RunRecord run{ startEpoch, rr.elapsedMilliseconds, rr.exitCode, rr.timedOut };
+			history->append(c.name, run);
+			stats->record(c.name, run);
 		}
 
-		if (cfg.dirty) {
-			ler::applyCommandsToJson(cfg);
-			ler::writeWStringToUtf8FileAtomic(configPath, ler::writeJson(cfg.root));
+		if (journal) {
+			journal->compactIfDue(cfg);
+		}
+		else if (cfg.dirty) {
+			ler::saveConfig(configPath, cfg);
+			ler::writeConfigSnapshot(configPath, cfg);
 		}
+		if (history) history->compactIfDue();
+		if (stats) stats->save(cfg.commands);
+		if (!dryRun) ler::writeNextDue(configPath, stamp, cfg);
 
 		return overallExit;
 	}